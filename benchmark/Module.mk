@@ -0,0 +1,5 @@
+MODULE_NAME      := benchmark-runner
+MODULE_LIBRARIES := util
+
+$(call use-google-benchmark)
+$(call add-executable-module,$(get-path))
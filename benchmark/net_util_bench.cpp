@@ -0,0 +1,54 @@
+#include "util/net_util.hpp"
+#include <benchmark/benchmark.h>
+#include <exception>
+#include <string_view>
+
+
+namespace {
+    void
+    bm_parse_ip_port(benchmark::State& state)
+    {
+        std::string_view ip_port = "239.255.100.200:12345";
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(ip_port);
+            benchmark::DoNotOptimize(net::parse_ip_port(ip_port));
+        }
+    }
+    BENCHMARK(bm_parse_ip_port);
+
+    void
+    bm_parse_ip_port_v6(benchmark::State& state)
+    {
+        std::string_view ip_port = "[2001:db8:85a3::8a2e:370:7334]:12345";
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(ip_port);
+            benchmark::DoNotOptimize(net::parse_ip_port(ip_port));
+        }
+    }
+    BENCHMARK(bm_parse_ip_port_v6);
+
+    void
+    bm_get_interfaces(benchmark::State& state)
+    {
+        try {
+            for (auto _ : state)
+                benchmark::DoNotOptimize(net::get_interfaces());
+        } catch (std::exception const& e) {
+            state.SkipWithError(e.what());
+        }
+    }
+    BENCHMARK(bm_get_interfaces);
+
+    void
+    bm_resolve_interface(benchmark::State& state)
+    {
+        try {
+            for (auto _ : state)
+                benchmark::DoNotOptimize(net::resolve_interface("lo"));
+        } catch (std::exception const& e) {
+            state.SkipWithError(e.what());
+        }
+    }
+    BENCHMARK(bm_resolve_interface);
+
+} // namespace
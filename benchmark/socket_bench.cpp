@@ -0,0 +1,309 @@
+#include "unix_domain/shm_ring.hpp"
+#include <arpa/inet.h> // ::htonl, ::inet_pton
+#include <benchmark/benchmark.h>
+#include <netinet/in.h>  // ip_mreq, sockaddr_in
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <poll.h>        // ::poll
+#include <sys/socket.h>  // socket calls
+#include <sys/time.h>    // timeval
+#include <unistd.h>      // ::close, ::dup
+#include <algorithm>     // std::min
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcpy, std::strerror
+#include <exception>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+    /// Closes the descriptor it holds when destroyed
+    class scoped_fd
+    {
+    public:
+        explicit scoped_fd(int fd = -1)
+                : fd_(fd)
+        {}
+
+        ~scoped_fd()
+        {
+            if (fd_ != -1)
+                ::close(fd_);
+        }
+
+        // No copies/moves
+        scoped_fd(scoped_fd const&) = delete;
+        scoped_fd(scoped_fd&&) = delete;
+        scoped_fd& operator=(scoped_fd const&) = delete;
+        scoped_fd&& operator=(scoped_fd&&) = delete;
+
+        int
+        get() const
+        {
+            return fd_;
+        }
+
+    private:
+        int fd_;
+    };
+
+    /// \return \c false on error or eof
+    bool
+    send_all(int fd, char const* data, std::size_t len)
+    {
+        while (len != 0) {
+            ssize_t const n = ::send(fd, data, len, MSG_NOSIGNAL);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            len -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    /// \return \c false on error or eof
+    bool
+    recv_all(int fd, char* data, std::size_t len)
+    {
+        while (len != 0) {
+            ssize_t const n = ::recv(fd, data, len, 0);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            len -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    std::string
+    last_error(char const* what)
+    {
+        return std::string(what) + ": " + std::strerror(errno);
+    }
+
+    /// Round trip of one message through an echo thread over loopback tcp
+    void
+    bm_tcp_echo_round_trip(benchmark::State& state)
+    {
+        auto const size = static_cast<std::size_t>(state.range(0));
+
+        scoped_fd listener(::socket(AF_INET, SOCK_STREAM, 0));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+        socklen_t addrlen = sizeof(addr);
+        if (listener.get() == -1
+                || ::bind(listener.get(), reinterpret_cast<sockaddr const*>(&addr), addrlen) == -1
+                || ::listen(listener.get(), 1) == -1
+                || ::getsockname(listener.get(), reinterpret_cast<sockaddr*>(&addr), &addrlen)
+                        == -1) {
+            state.SkipWithError(last_error("listen").c_str());
+            return;
+        }
+
+        scoped_fd client(::socket(AF_INET, SOCK_STREAM, 0));
+        if (client.get() == -1
+                || ::connect(client.get(), reinterpret_cast<sockaddr const*>(&addr), addrlen)
+                        == -1) {
+            state.SkipWithError(last_error("connect").c_str());
+            return;
+        }
+        scoped_fd server(::accept(listener.get(), nullptr, nullptr));
+        if (server.get() == -1) {
+            state.SkipWithError(last_error("accept").c_str());
+            return;
+        }
+
+        int const on = 1;
+        ::setsockopt(client.get(), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        ::setsockopt(server.get(), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        std::jthread echo([fd = server.get()] {
+            std::vector<char> buf(65536);
+            while (true) {
+                ssize_t const n = ::recv(fd, buf.data(), buf.size(), 0);
+                if (n == -1 && errno == EINTR)
+                    continue;
+                if (n <= 0 || !send_all(fd, buf.data(), static_cast<std::size_t>(n)))
+                    return;
+            }
+        });
+
+        std::vector<char> out(size, 'x');
+        std::vector<char> in(size);
+        for (auto _ : state) {
+            if (!send_all(client.get(), out.data(), size)
+                    || !recv_all(client.get(), in.data(), size)) {
+                state.SkipWithError(last_error("echo").c_str());
+                break;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(size));
+
+        ::shutdown(client.get(), SHUT_RDWR); // ends the echo thread
+    }
+    BENCHMARK(bm_tcp_echo_round_trip)->RangeMultiplier(8)->Range(64, 32768)->UseRealTime();
+
+    /// One-way throughput of a unix stream socket drained by another thread
+    void
+    bm_unix_stream_throughput(benchmark::State& state)
+    {
+        auto const size = static_cast<std::size_t>(state.range(0));
+
+        int fds[2] = {-1, -1};
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+            state.SkipWithError(last_error("socketpair").c_str());
+            return;
+        }
+        scoped_fd writer(fds[0]);
+        scoped_fd reader(fds[1]);
+
+        std::jthread drain([fd = reader.get()] {
+            std::vector<char> buf(65536);
+            while (true) {
+                ssize_t const n = ::recv(fd, buf.data(), buf.size(), 0);
+                if (n == -1 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return;
+            }
+        });
+
+        std::vector<char> out(size, 'x');
+        for (auto _ : state) {
+            if (!send_all(writer.get(), out.data(), size)) {
+                state.SkipWithError(last_error("send").c_str());
+                break;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(size));
+
+        ::shutdown(writer.get(), SHUT_WR); // ends the drain thread
+    }
+    BENCHMARK(bm_unix_stream_throughput)->RangeMultiplier(8)->Range(64, 65536)->UseRealTime();
+
+    /// Same as bm_unix_stream_throughput, through a shared-memory ring
+    void
+    bm_shm_ring_throughput(benchmark::State& state)
+    {
+        auto const size = static_cast<std::size_t>(state.range(0));
+
+        std::unique_ptr<shm::ring> producer;
+        std::unique_ptr<shm::ring> consumer;
+        try {
+            producer = std::make_unique<shm::ring>(1 << 20);
+            consumer = std::make_unique<shm::ring>(::dup(producer->memfd()),
+                    ::dup(producer->data_fd()), ::dup(producer->space_fd()));
+        } catch (std::exception const& e) {
+            state.SkipWithError(e.what());
+            return;
+        }
+
+        std::atomic<bool> done = false;
+        std::jthread drain([&consumer, &done] {
+            for (;;) {
+                std::span<char const> const data = consumer->readable();
+                if (!data.empty()) {
+                    consumer->consume(data.size());
+                    continue;
+                }
+                if (done.load(std::memory_order_acquire) && consumer->readable().empty())
+                    return;
+                if (consumer->arm_data_wakeup()) {
+                    pollfd pfd{.fd = consumer->data_fd(), .events = POLLIN, .revents = 0};
+                    ::poll(&pfd, 1, /*timeout=*/10);
+                    shm::ring::clear(consumer->data_fd());
+                }
+            }
+        });
+
+        std::vector<char> out(size, 'x');
+        for (auto _ : state) {
+            std::size_t sent = 0;
+            while (sent < size) {
+                std::span<char> const space = producer->writable();
+                if (space.empty()) {
+                    if (producer->arm_space_wakeup()) {
+                        pollfd pfd{.fd = producer->space_fd(), .events = POLLIN, .revents = 0};
+                        ::poll(&pfd, 1, /*timeout=*/10);
+                        shm::ring::clear(producer->space_fd());
+                    }
+                    continue;
+                }
+                std::size_t const n = std::min(space.size(), size - sent);
+                std::memcpy(space.data(), out.data() + sent, n);
+                producer->commit(n);
+                sent += n;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(size));
+
+        done.store(true, std::memory_order_release);
+    }
+    BENCHMARK(bm_shm_ring_throughput)->RangeMultiplier(8)->Range(64, 65536)->UseRealTime();
+
+    /// Send and receive of one datagram through a multicast group looped
+    /// back on lo
+    void
+    bm_udp_multicast_send_recv(benchmark::State& state)
+    {
+        auto const size = static_cast<std::size_t>(state.range(0));
+        static constexpr char const* Group = "239.255.42.99";
+
+        in_addr loopback{};
+        loopback.s_addr = ::htonl(INADDR_LOOPBACK);
+
+        scoped_fd rx(::socket(AF_INET, SOCK_DGRAM, 0));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
+        socklen_t addrlen = sizeof(addr);
+        ip_mreq mreq{};
+        ::inet_pton(AF_INET, Group, &mreq.imr_multiaddr);
+        mreq.imr_interface = loopback;
+        timeval const timeout{.tv_sec = 1, .tv_usec = 0};
+        if (rx.get() == -1
+                || ::bind(rx.get(), reinterpret_cast<sockaddr const*>(&addr), addrlen) == -1
+                || ::getsockname(rx.get(), reinterpret_cast<sockaddr*>(&addr), &addrlen) == -1
+                || ::setsockopt(rx.get(), IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))
+                        == -1
+                || ::setsockopt(rx.get(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))
+                        == -1) {
+            state.SkipWithError(last_error("receiver").c_str());
+            return;
+        }
+
+        scoped_fd tx(::socket(AF_INET, SOCK_DGRAM, 0));
+        addr.sin_addr = mreq.imr_multiaddr;
+        if (tx.get() == -1
+                || ::setsockopt(tx.get(), IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback))
+                        == -1
+                || ::connect(tx.get(), reinterpret_cast<sockaddr const*>(&addr), addrlen) == -1) {
+            state.SkipWithError(last_error("sender").c_str());
+            return;
+        }
+
+        std::vector<char> out(size, 'x');
+        std::vector<char> in(size);
+        for (auto _ : state) {
+            if (::send(tx.get(), out.data(), size, 0) == -1
+                    || ::recv(rx.get(), in.data(), in.size(), 0) == -1) {
+                state.SkipWithError(last_error("send/recv").c_str());
+                break;
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(size));
+    }
+    BENCHMARK(bm_udp_multicast_send_recv)->Arg(64)->Arg(512)->Arg(1472);
+
+} // namespace
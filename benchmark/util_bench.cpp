@@ -0,0 +1,79 @@
+#include "util/histogram.hpp"
+#include "util/logger.hpp"
+#include "util/spsc_ring.hpp"
+#include "util/stats.hpp"
+#include <benchmark/benchmark.h>
+#include <fcntl.h>  // ::open
+#include <unistd.h> // ::close, ::dup, ::dup2
+#include <cerrno>
+#include <cstdint>
+#include <cstring> // std::strerror
+
+
+namespace {
+    void
+    bm_histogram_record(benchmark::State& state)
+    {
+        util::histogram h;
+        std::uint64_t value = 1;
+        for (auto _ : state) {
+            h.record(value);
+            value = value * 6364136223846793005ULL + 1442695040888963407ULL; // lcg
+            value >>= 40;
+        }
+        benchmark::DoNotOptimize(h.count());
+    }
+    BENCHMARK(bm_histogram_record);
+
+    void
+    bm_spsc_ring_push_pop(benchmark::State& state)
+    {
+        util::spsc_ring<std::uint64_t> ring(1024);
+        std::uint64_t value = 0;
+        for (auto _ : state) {
+            ring.try_push(value);
+            ring.try_pop(value);
+            benchmark::DoNotOptimize(value);
+        }
+    }
+    BENCHMARK(bm_spsc_ring_push_pop);
+
+    void
+    bm_stat_counters_add(benchmark::State& state)
+    {
+        util::stat_counters stats;
+        for (auto _ : state)
+            stats.add(1, 64);
+        benchmark::DoNotOptimize(stats.load());
+    }
+    BENCHMARK(bm_stat_counters_add);
+
+    /// Cost to the calling thread only; records the logger can't keep
+    /// up with are dropped and counted rather than slowing the caller.
+    /// stderr points at /dev/null meanwhile, so the output stays readable.
+    void
+    bm_logger_log_error(benchmark::State& state)
+    {
+        int const null_fd = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+        int const saved_fd = ::dup(STDERR_FILENO);
+        if (null_fd == -1 || saved_fd == -1) {
+            state.SkipWithError(std::strerror(errno));
+            return;
+        }
+        ::dup2(null_fd, STDERR_FILENO);
+
+        util::logger::instance().add_thread();
+        int fd = 42;
+        for (auto _ : state) {
+            util::log_error("error: recv on fd {}: {}", fd, std::strerror(ECONNRESET));
+            benchmark::DoNotOptimize(fd);
+        }
+        util::logger::instance().flush();
+
+        ::dup2(saved_fd, STDERR_FILENO);
+        ::close(saved_fd);
+        ::close(null_fd);
+    }
+    BENCHMARK(bm_logger_log_error);
+
+} // namespace
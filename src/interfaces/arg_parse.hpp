@@ -0,0 +1,104 @@
+#pragma once
+
+#include "link_monitor.hpp"
+#include "version.h"
+#include "util/compiler.hpp"
+#include <getopt.h>
+#include <charconv> // std::from_chars
+#include <cstdio>   // std::FILE
+#include <cstdlib>  // std::exit
+#include <cstring>  // std::strlen
+#include <filesystem>
+#include <print>
+
+
+struct cli_args
+{
+    bool watch = false;
+    monitor_config config; ///< interfaces also limit the snapshot
+};
+
+
+inline cli_args
+arg_parse(int argc, char** argv)
+{
+    auto usage = [](std::FILE* outerr, std::filesystem::path const& app) {
+        std::print(outerr,
+                "usage: {} [-hvw] [-i <msecs>] [<interface> [<interface>] ...]\n"
+                "Prints every interface's flags, addresses and counters, or with --watch,\n"
+                "their rates until interrupted.\n"
+                "positional arguments:\n"
+                "  interface                only this interface (default: all)\n"
+                "optional arguments:\n"
+                "  -h, --help               this output\n"
+                "  -i, --interval=<msecs>   how often --watch prints rates; implies --watch\n"
+                "                           (default 1000)\n"
+                "  -v, --version            version\n"
+                "  -w, --watch              print each interface's packet, bit, drop and error\n"
+                "                           rates every interval, from 64-bit counters fetched\n"
+                "                           over rtnetlink, and report links and addresses as\n"
+                "                           they come, go or change state\n",
+                app.c_str());
+        std::exit(outerr == stdout ? EXIT_SUCCESS : EXIT_FAILURE);
+    };
+
+    auto to_uint = [](char const* str, auto& value) {
+        char const* const end = str + std::strlen(str);
+        auto [ptr, ec] = std::from_chars(str, end, value);
+        return ec == std::errc() && ptr == end;
+    };
+
+    auto const app = std::filesystem::path(argv[0]).filename();
+
+    cli_args args;
+    while (true) {
+        static constexpr option long_options[] = {
+                {"help", no_argument, nullptr, 'h'},
+                {"interval", required_argument, nullptr, 'i'},
+                {"version", no_argument, nullptr, 'v'},
+                {"watch", no_argument, nullptr, 'w'},
+                {nullptr, 0, nullptr, 0},
+        };
+
+        int const c = ::getopt_long(
+                argc, argv, "hi:vw", static_cast<option const*>(long_options), nullptr);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'h':
+                usage(stdout, app);
+                break;
+
+            case 'i':
+                if (!to_uint(optarg, args.config.interval_msecs)
+                        || args.config.interval_msecs <= 0) {
+                    std::println(stderr, "invalid interval: {}", optarg);
+                    usage(stderr, app);
+                }
+                args.watch = true;
+                break;
+
+            case 'v':
+                std::println("app_version={}\n{}", ::VERSION, get_version_info_multiline());
+                std::exit(EXIT_SUCCESS);
+                break;
+
+            case 'w':
+                args.watch = true;
+                break;
+
+            case '?':
+            default:
+                usage(stderr, app);
+                break;
+        }
+    } // while
+
+    while (optind < argc) {
+        args.config.interfaces.emplace_back(argv[optind]);
+        ++optind;
+    }
+
+    return args;
+}
@@ -0,0 +1,412 @@
+#include "link_monitor.hpp"
+#include <arpa/inet.h>       // ::inet_ntop
+#include <linux/if_addr.h>   // ifaddrmsg, IFA_*
+#include <linux/rtnetlink.h> // ifinfomsg, RTM_*, RTMGRP_*
+#include <net/if.h>          // IFF_RUNNING, IFF_UP
+#include <poll.h>            // ::poll
+#include <sys/socket.h>      // ::bind, ::getsockname, ::recv, ::send, ::setsockopt, ::socket
+#include <unistd.h>          // ::close
+#include <algorithm>         // std::max, std::min
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcpy, std::strerror
+#include <print>
+#include <stdexcept> // std::runtime_error
+#include <string>
+#include <string_view>
+
+
+namespace {
+    /// Invoke fn(type, data, len) on each attribute that follows the
+    /// fixed-size Msg at the start of hdr's payload
+    template <typename Msg, typename Fn>
+    void
+    for_each_attribute(nlmsghdr const& hdr, Fn&& fn)
+    {
+        char const* p = reinterpret_cast<char const*>(&hdr) + NLMSG_SPACE(sizeof(Msg));
+        char const* const end = reinterpret_cast<char const*>(&hdr) + hdr.nlmsg_len;
+        while (end - p >= static_cast<std::ptrdiff_t>(sizeof(rtattr))) {
+            rtattr attr{};
+            std::memcpy(&attr, p, sizeof(attr));
+            if (attr.rta_len < sizeof(rtattr) || attr.rta_len > end - p)
+                break;
+            fn(attr.rta_type, p + RTA_LENGTH(0), std::size_t{attr.rta_len} - RTA_LENGTH(0));
+            p += RTA_ALIGN(attr.rta_len);
+        }
+    }
+
+    /// Copy the fixed-size Msg at the start of hdr's payload
+    /// \return \c false if hdr is too short to hold one
+    template <typename Msg>
+    bool
+    payload(nlmsghdr const& hdr, Msg& msg)
+    {
+        if (hdr.nlmsg_len < NLMSG_LENGTH(sizeof(Msg)))
+            return false;
+        std::memcpy(&msg, reinterpret_cast<char const*>(&hdr) + NLMSG_HDRLEN, sizeof(Msg));
+        return true;
+    }
+
+    /// Counters can go backwards when a driver resets them
+    std::uint64_t
+    delta(std::uint64_t now, std::uint64_t then)
+    {
+        return now >= then ? now - then : now;
+    }
+
+    char const*
+    state(unsigned flags)
+    {
+        if ((flags & IFF_UP) == 0)
+            return "down";
+        return (flags & IFF_RUNNING) != 0 ? "up" : "up, no carrier";
+    }
+
+} // namespace
+
+
+link_monitor::link_monitor(monitor_config const& config)
+        : config_(config)
+        , links_()
+        , buf_(RecvBufferSizeBytes)
+{
+    sockfd_ = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sockfd_ == -1)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+
+    // Capped by net.core.rmem_max; overruns are survived regardless
+    int const size = SocketBufferSizeBytes;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1) {
+        int const error = errno;
+        ::close(sockfd_);
+        throw std::runtime_error(std::string("setsockopt(SO_RCVBUF): ") + std::strerror(error));
+    }
+
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (::bind(sockfd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        int const error = errno;
+        ::close(sockfd_);
+        throw std::runtime_error(std::string("bind: ") + std::strerror(error));
+    }
+
+    // The kernel picks the port id; replies to our dumps carry it,
+    // notifications carry that of whoever caused them
+    socklen_t addrlen = sizeof(addr);
+    if (::getsockname(sockfd_, reinterpret_cast<sockaddr*>(&addr), &addrlen) == -1) {
+        int const error = errno;
+        ::close(sockfd_);
+        throw std::runtime_error(std::string("getsockname: ") + std::strerror(error));
+    }
+    portid_ = addr.nl_pid;
+}
+
+
+link_monitor::~link_monitor()
+{
+    ::close(sockfd_);
+}
+
+
+bool
+link_monitor::run()
+{
+    auto const interval = std::chrono::milliseconds(config_.interval_msecs);
+    auto next_sample = clock::now();
+
+    pollfd fd{.fd = sockfd_, .events = POLLIN, .revents = 0};
+    while (true) {
+        if (clock::now() >= next_sample) {
+            if (!request_dump())
+                return false;
+            next_sample += interval;
+        }
+
+        // Wake up in time to sample even if nothing arrives
+        auto const wait = std::chrono::ceil<std::chrono::milliseconds>(next_sample - clock::now());
+        int const timeout
+                = static_cast<int>(std::max<std::chrono::milliseconds::rep>(wait.count(), 0));
+
+        int const rv = ::poll(&fd, 1, timeout);
+        if (rv == -1) {
+            if (errno == EINTR)
+                continue;
+            std::println(stderr, "error: poll: {}", std::strerror(errno));
+            return false;
+        }
+
+        if (rv == 1 && !on_incoming_data())
+            return false;
+    }
+
+    return true;
+}
+
+
+bool
+link_monitor::request_dump()
+{
+    // Only one dump can run on a socket at a time. A slow one costs
+    // this sample; the next measures across the gap.
+    if (dumping_)
+        return true;
+
+    struct
+    {
+        nlmsghdr hdr;
+        ifinfomsg ifi;
+    } request{};
+    request.hdr.nlmsg_len = sizeof(request);
+    request.hdr.nlmsg_type = RTM_GETLINK;
+    request.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.hdr.nlmsg_seq = ++last_seq_;
+    request.ifi.ifi_family = AF_UNSPEC;
+
+    dump_time_ = clock::now();
+    if (::send(sockfd_, &request, sizeof(request), 0) == -1) {
+        std::println(stderr, "error: send: {}", std::strerror(errno));
+        return false;
+    }
+
+    dumping_ = true;
+    return true;
+}
+
+
+bool
+link_monitor::on_incoming_data()
+{
+    while (true) {
+        ssize_t const n = ::recv(sockfd_, buf_.data(), buf_.size(), MSG_DONTWAIT);
+        if (n == -1) {
+            switch (errno) {
+                case EAGAIN:
+                    return true;
+
+                case EINTR:
+                    continue;
+
+                // Notifications came faster than they were read and some
+                // were dropped, possibly along with part of a dump. The
+                // next dump brings the links back in sync.
+                case ENOBUFS:
+                    std::println(stderr, "warning: rtnetlink overrun, notifications lost");
+                    dumping_ = false;
+                    continue;
+
+                default:
+                    std::println(stderr, "error: recv: {}", std::strerror(errno));
+                    return false;
+            }
+        }
+
+        char const* p = buf_.data();
+        char const* const end = p + n;
+        while (end - p >= static_cast<std::ptrdiff_t>(sizeof(nlmsghdr))) {
+            auto const* hdr = reinterpret_cast<nlmsghdr const*>(p);
+            if (hdr->nlmsg_len < sizeof(nlmsghdr) || hdr->nlmsg_len > end - p)
+                break;
+            if (!on_message(*hdr))
+                return false;
+            p += NLMSG_ALIGN(hdr->nlmsg_len);
+        }
+    }
+}
+
+
+bool
+link_monitor::on_message(nlmsghdr const& hdr)
+{
+    bool const reply = hdr.nlmsg_pid == portid_ && hdr.nlmsg_seq == last_seq_ && dumping_;
+
+    switch (hdr.nlmsg_type) {
+        case NLMSG_DONE:
+            if (reply) {
+                dumping_ = false;
+                on_dump_done();
+            }
+            return true;
+
+        case NLMSG_ERROR: {
+            nlmsgerr err{};
+            if (!reply || !payload(hdr, err))
+                return true;
+
+            // A dump cut short by an overrun may still be running in
+            // the kernel, so try again next interval
+            dumping_ = false;
+            if (err.error == -EBUSY)
+                return true;
+            std::println(stderr, "error: RTM_GETLINK: {}", std::strerror(-err.error));
+            return false;
+        }
+
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            on_link(hdr, reply);
+            return true;
+
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            on_address(hdr);
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+
+void
+link_monitor::on_link(nlmsghdr const& hdr, bool sample)
+{
+    ifinfomsg ifi{};
+    if (!payload(hdr, ifi))
+        return;
+
+    std::string_view name;
+    rtnl_link_stats64 stats{};
+    bool has_stats = false;
+    for_each_attribute<ifinfomsg>(hdr, [&](unsigned type, char const* data, std::size_t len) {
+        if (type == IFLA_IFNAME) {
+            name = std::string_view(data, ::strnlen(data, len));
+        } else if (type == IFLA_STATS64) {
+            // Older or newer kernels may have fewer or more counters
+            std::memcpy(&stats, data, std::min(len, sizeof(stats)));
+            has_stats = true;
+        }
+    });
+
+    auto it = links_.find(ifi.ifi_index);
+    if (hdr.nlmsg_type == RTM_DELLINK) {
+        if (it != links_.end()) {
+            if (wanted(it->second.name))
+                std::println("{}: link removed", it->second.name);
+            links_.erase(it);
+        }
+        return;
+    }
+
+    if (it == links_.end()) {
+        it = links_.emplace(ifi.ifi_index, link{}).first;
+        it->second.name = name;
+        it->second.flags = ifi.ifi_flags;
+        if (!sample && wanted(it->second.name))
+            std::println("{}: link added, {}", it->second.name, state(ifi.ifi_flags));
+    }
+
+    link& l = it->second;
+    if (!name.empty() && name != l.name) {
+        if (wanted(l.name) || wanted(std::string(name)))
+            std::println("{}: renamed to {}", l.name, name);
+        l.name = name;
+    }
+
+    constexpr unsigned StateFlags = IFF_UP | IFF_RUNNING;
+    if (((l.flags ^ ifi.ifi_flags) & StateFlags) != 0 && wanted(l.name))
+        std::println("{}: link {}", l.name, state(ifi.ifi_flags));
+    l.flags = ifi.ifi_flags;
+
+    // Notifications carry counters too, but only dumps are taken at a
+    // known time
+    if (!sample || !has_stats)
+        return;
+
+    if (l.sample_time != clock::time_point{} && wanted(l.name)) {
+        std::chrono::duration<double> const elapsed = dump_time_ - l.sample_time;
+        report(l, stats, elapsed.count());
+    }
+    l.stats = stats;
+    l.sample_time = dump_time_;
+}
+
+
+void
+link_monitor::on_address(nlmsghdr const& hdr)
+{
+    ifaddrmsg ifa{};
+    if (!payload(hdr, ifa))
+        return;
+
+    std::string const name = link_name(static_cast<int>(ifa.ifa_index));
+    if (!wanted(name))
+        return;
+
+    // IFA_ADDRESS is the peer on point-to-point links, so prefer
+    // IFA_LOCAL where there is one
+    char address[INET6_ADDRSTRLEN] = {};
+    bool has_local = false;
+    for_each_attribute<ifaddrmsg>(hdr, [&](unsigned type, char const* data, std::size_t len) {
+        if ((type != IFA_LOCAL && type != IFA_ADDRESS) || (type == IFA_ADDRESS && has_local))
+            return;
+        std::size_t const size = ifa.ifa_family == AF_INET6 ? 16 : 4;
+        if (len < size
+                || ::inet_ntop(ifa.ifa_family, data, static_cast<char*>(address), sizeof(address))
+                        == nullptr)
+            return;
+        has_local = type == IFA_LOCAL;
+    });
+
+    if (address[0] == '\0')
+        return;
+
+    std::println("{}: address {} {}/{}", name, hdr.nlmsg_type == RTM_NEWADDR ? "added" : "removed",
+            static_cast<char const*>(address), ifa.ifa_prefixlen);
+}
+
+
+void
+link_monitor::on_dump_done()
+{
+    std::erase_if(links_, [this](auto const& entry) {
+        link const& l = entry.second;
+        return l.sample_time != clock::time_point{} && l.sample_time != dump_time_;
+    });
+}
+
+
+void
+link_monitor::report(link const& l, rtnl_link_stats64 const& stats, double secs) const
+{
+    if (secs <= 0.0)
+        return;
+
+    auto rate = [secs](std::uint64_t now, std::uint64_t then) {
+        return static_cast<double>(delta(now, then)) / secs;
+    };
+    rtnl_link_stats64 const& prev = l.stats;
+
+    // rx_dropped is counted by the stack; packets the nic itself had
+    // no room for show up in rx_missed_errors or rx_fifo_errors,
+    // depending on the driver
+    std::println("{}: rx_pps={:.0f} rx_Mbps={:.2f} rx_drops/s={:.0f} rx_missed/s={:.0f} "
+                 "rx_errors/s={:.0f} tx_pps={:.0f} tx_Mbps={:.2f} tx_drops/s={:.0f} "
+                 "tx_errors/s={:.0f}",
+            l.name, rate(stats.rx_packets, prev.rx_packets),
+            rate(stats.rx_bytes, prev.rx_bytes) * 8 / 1e6, rate(stats.rx_dropped, prev.rx_dropped),
+            rate(stats.rx_missed_errors, prev.rx_missed_errors)
+                    + rate(stats.rx_fifo_errors, prev.rx_fifo_errors),
+            rate(stats.rx_errors, prev.rx_errors), rate(stats.tx_packets, prev.tx_packets),
+            rate(stats.tx_bytes, prev.tx_bytes) * 8 / 1e6, rate(stats.tx_dropped, prev.tx_dropped),
+            rate(stats.tx_errors, prev.tx_errors));
+}
+
+
+bool
+link_monitor::wanted(std::string const& name) const
+{
+    return config_.interfaces.empty()
+            || std::find(config_.interfaces.begin(), config_.interfaces.end(), name)
+            != config_.interfaces.end();
+}
+
+
+std::string
+link_monitor::link_name(int ifindex) const
+{
+    auto const it = links_.find(ifindex);
+    return it != links_.end() ? it->second.name : "if" + std::to_string(ifindex);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <linux/if_link.h> // rtnl_link_stats64
+#include <linux/netlink.h> // nlmsghdr
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+
+struct monitor_config
+{
+    int interval_msecs = 1000;           ///< how often to sample and print rates
+    std::vector<std::string> interfaces; ///< only these, or every interface if empty
+};
+
+/*  \class  link_monitor
+ *  \brief  Prints per-interface packet, bit, drop and error rates once
+ *          an interval, from the 64-bit counters of an RTM_GETLINK dump
+ *          over rtnetlink. The same socket subscribes to link and
+ *          address notifications, so interfaces appearing, going,
+ *          changing state or gaining and losing addresses are reported
+ *          as they happen rather than at the next sample.
+ */
+class link_monitor
+{
+public:
+    /// \throws std::exception On error
+    explicit link_monitor(monitor_config const& config);
+    ~link_monitor();
+
+    // No copies/moves
+    link_monitor(link_monitor const&) = delete;
+    link_monitor(link_monitor&&) = delete;
+    link_monitor& operator=(link_monitor const&) = delete;
+    link_monitor&& operator=(link_monitor&&) = delete;
+
+    /// Sample and print until an error occurs
+    /// \return \c false on error
+    bool run();
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct link
+    {
+        std::string name;
+        unsigned flags = 0;            ///< IFF_*
+        rtnl_link_stats64 stats{};     ///< counters as of sample_time
+        clock::time_point sample_time; ///< when stats were dumped, epoch if never
+    };
+
+    /// Ask for every link's counters, unless the last dump is still
+    /// being received
+    /// \return \c false on error
+    bool request_dump();
+
+    /// Read until the socket would block
+    /// \return \c false on error
+    bool on_incoming_data();
+
+    /// \return \c false on error
+    bool on_message(nlmsghdr const& hdr);
+
+    /// A link from the dump in progress, when sample is set, or from a
+    /// notification
+    void on_link(nlmsghdr const& hdr, bool sample);
+
+    /// An address added to or removed from a link
+    void on_address(nlmsghdr const& hdr);
+
+    /// Forget links the dump didn't include; their removal must have
+    /// been among lost notifications
+    void on_dump_done();
+
+    /// Print the rates of l since its last sample
+    void report(link const& l, rtnl_link_stats64 const& stats, double secs) const;
+
+    /// \return \c true if name was asked for, or nothing was
+    bool wanted(std::string const& name) const;
+
+    /// \return Name of ifindex, or "if<ifindex>" if unknown
+    std::string link_name(int ifindex) const;
+
+private:
+    enum
+    {
+        RecvBufferSizeBytes = 65536,     ///< enough for several dumped links per recv
+        SocketBufferSizeBytes = 1 << 20, ///< SO_RCVBUF, so bursts of notifications fit
+    };
+
+    monitor_config config_;        ///< interval and interfaces of interest
+    int sockfd_{-1};               ///< rtnetlink socket
+    std::uint32_t portid_{0};      ///< of sockfd_, as assigned by the kernel
+    std::uint32_t last_seq_{0};    ///< of the last dump requested
+    bool dumping_{false};          ///< dump of last_seq_ not yet done
+    clock::time_point dump_time_;  ///< when the dump of last_seq_ was requested
+    std::map<int, link> links_;    ///< by ifindex
+    std::vector<char> buf_;        ///< recv buffer
+
+}; // class link_monitor
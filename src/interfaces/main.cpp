@@ -1,14 +1,25 @@
+#include "arg_parse.hpp"
+#include "link_monitor.hpp"
 #include "util/net_util.hpp"
-#include <cstdio> // std::fprintf
+#include <algorithm> // std::find
+#include <cstdio>    // std::fprintf
+#include <cstdlib>   // EXIT_FAILURE, EXIT_SUCCESS
+#include <exception>
 #include <print>
+#include <string>
 #include <vector>
 
 
-int
-main()
-{
-    try {
-        std::vector<net::interface> const interfaces = net::get_interfaces();
+namespace {
+    void
+    print_interfaces(std::vector<std::string> const& names)
+    {
+        std::vector<net::interface> interfaces = net::get_interfaces();
+        if (!names.empty()) {
+            std::erase_if(interfaces, [&names](net::interface const& i) {
+                return std::find(names.begin(), names.end(), i.name) == names.end();
+            });
+        }
 
         std::println("Number of interfaces: {}", interfaces.size());
         for (auto const& i : interfaces) {
@@ -19,10 +30,8 @@ main()
             }
             std::println();
             for (auto const& a : i.addresses) {
-                std::string const& address = std::get<0>(a);
-                std::string const& service = std::get<1>(a);
-                if (!address.empty()) {
-                    std::println("    address: {}, service={}", address, service);
+                if (!a.host.empty()) {
+                    std::println("    address: {}, service={}", a.host, a.service);
                 }
             }
             std::println("    rx_packets={}, rx_bytes={}, rx_errors={}, rx_dropped={}",
@@ -31,6 +40,27 @@ main()
                     i.stats.tx_packets, i.stats.tx_bytes, i.stats.tx_errors, i.stats.tx_dropped);
             std::println("    multicast={}", i.stats.multicast);
         }
+    }
+
+} // namespace
+
+
+int
+main(int argc, char** argv)
+{
+    try {
+        cli_args const args = arg_parse(argc, argv);
+
+        if (!args.watch) {
+            print_interfaces(args.config.interfaces);
+            return EXIT_SUCCESS;
+        }
+
+        link_monitor monitor(args.config);
+        if (!monitor.run()) {
+            std::fprintf(stderr, "error: monitor stopped with an error\n");
+            return EXIT_FAILURE;
+        }
     } catch (std::exception const& e) {
         std::fprintf(stderr, "error: exception: %s\n", e.what());
         return EXIT_FAILURE;
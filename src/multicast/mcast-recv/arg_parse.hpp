@@ -1,10 +1,14 @@
 #pragma once
 
+#include "mcast_recv.hpp"
 #include "version.h"
 #include "util/compiler.hpp"
+#include "util/thread_util.hpp"
 #include <getopt.h>
-#include <cstdio>  // std::fprintf, std::FILE
-#include <cstdlib> // std::exit
+#include <charconv> // std::from_chars
+#include <cstdio>   // std::fprintf, std::FILE
+#include <cstdlib>  // std::exit
+#include <cstring>  // std::strlen
 #include <filesystem>
 #include <print>
 #include <string>
@@ -15,6 +19,8 @@ struct cli_args
 {
     std::string interface_name;
     std::vector<std::string> groups;
+    recv_config config;
+    std::vector<int> cpus; ///< receive thread, then worker
 };
 
 
@@ -23,17 +29,43 @@ arg_parse(int argc, char** argv)
 {
     auto usage = [](std::FILE* outerr, std::filesystem::path const& app) {
         std::print(outerr,
-                "usage: {} [-hv] [-i <interface>] <group> [[<group>] ...]\n"
+                "usage: {} [-hHsTvVwx] [-b <usecs>] [-c <cpus>] [-i <interface>] [-q <queue>]\n"
+                "       [-r <bytes>] <group> [[<group>] ...]\n"
                 "positional arguments:\n"
                 "  group                    multicast group in the for 'ip:port'\n"
                 "optional arguments:\n"
+                "  -b, --busy-poll=<usecs>  busy poll the device queue for up to usecs on each\n"
+                "                           read (SO_BUSY_POLL); may need CAP_NET_ADMIN\n"
+                "  -c, --cpus=<list>        pin the receive thread to the first cpu in list\n"
+                "                           and the worker to the second (e.g., 2,3)\n"
                 "  -h, --help               this output\n"
+                "  -H, --hw-timestamps      like -T, but using nic hardware timestamps when\n"
+                "                           supported\n"
                 "  -i, --interface=<name>   network interface name (e.g., eno1, lo)\n"
-                "  -v, --version            version\n",
+                "  -q, --xdp-queue=<num>    nic rx queue for --xdp (default: 0)\n"
+                "  -r, --rcvbuf=<bytes>     receive buffer size of each group's socket; beyond\n"
+                "                           net.core.rmem_max needs CAP_NET_ADMIN\n"
+                "  -s, --spin               read sockets in a tight loop instead of blocking\n"
+                "                           in epoll_wait (best with --cpus on isolated cpus)\n"
+                "  -T, --timestamps         print per-group latency from kernel receive to\n"
+                "                           dequeue every second\n"
+                "  -v, --version            version\n"
+                "  -V, --verbose            print every datagram received (slow; throughput\n"
+                "                           is reported once a second regardless)\n"
+                "  -w, --worker             process datagrams on a separate thread so socket\n"
+                "                           draining never waits on processing\n"
+                "  -x, --xdp                receive through an AF_XDP socket, bypassing the\n"
+                "                           kernel udp stack; falls back to sockets\n",
                 app.c_str());
         std::exit(outerr == stdout ? EXIT_SUCCESS : EXIT_FAILURE);
     };
 
+    auto to_uint = [](char const* str, auto& value) {
+        char const* const end = str + std::strlen(str);
+        auto [ptr, ec] = std::from_chars(str, end, value);
+        return ec == std::errc() && ptr == end;
+    };
+
     auto const app = std::filesystem::path(argv[0]).filename();
     if (argc == 1) {
         usage(stderr, app);
@@ -42,31 +74,96 @@ arg_parse(int argc, char** argv)
     cli_args args;
     while (true) {
         static constexpr option long_options[] = {
+                {"busy-poll", required_argument, nullptr, 'b'},
+                {"cpus", required_argument, nullptr, 'c'},
                 {"help", no_argument, nullptr, 'h'},
-                {"interface", no_argument, nullptr, 'i'},
+                {"hw-timestamps", no_argument, nullptr, 'H'},
+                {"interface", required_argument, nullptr, 'i'},
+                {"xdp-queue", required_argument, nullptr, 'q'},
+                {"rcvbuf", required_argument, nullptr, 'r'},
+                {"spin", no_argument, nullptr, 's'},
+                {"timestamps", no_argument, nullptr, 'T'},
+                {"verbose", no_argument, nullptr, 'V'},
                 {"version", no_argument, nullptr, 'v'},
+                {"worker", no_argument, nullptr, 'w'},
+                {"xdp", no_argument, nullptr, 'x'},
                 {nullptr, 0, nullptr, 0},
         };
 
         int const c = ::getopt_long(
-                argc, argv, "hi:v", static_cast<option const*>(long_options), nullptr);
+                argc, argv, "b:c:hHi:q:r:sTvVwx", static_cast<option const*>(long_options), nullptr);
         if (c == -1)
             break;
 
         switch (c) {
+            case 'b':
+                if (!to_uint(optarg, args.config.busy_poll_usecs)
+                        || args.config.busy_poll_usecs <= 0) {
+                    std::println(stderr, "invalid busy poll time: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'c':
+                args.cpus = util::parse_cpu_list(optarg);
+                if (args.cpus.empty()) {
+                    std::println(stderr, "invalid cpu list: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
             case 'h':
                 usage(stdout, app);
                 break;
 
+            case 'H':
+                args.config.timestamps = timestamp_mode::Hardware;
+                break;
+
             case 'i':
                 args.interface_name = optarg;
                 break;
 
+            case 'q':
+                if (!to_uint(optarg, args.config.xdp_queue)) {
+                    std::println(stderr, "invalid queue: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'r':
+                if (!to_uint(optarg, args.config.rcvbuf_bytes) || args.config.rcvbuf_bytes <= 0) {
+                    std::println(stderr, "invalid receive buffer size: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 's':
+                args.config.spin = true;
+                break;
+
+            case 'T':
+                if (args.config.timestamps == timestamp_mode::None)
+                    args.config.timestamps = timestamp_mode::Software;
+                break;
+
             case 'v':
                 std::println("app_version={}\n{}", ::VERSION, get_version_info_multiline());
                 std::exit(EXIT_SUCCESS);
                 break;
 
+            case 'V':
+                args.config.verbose = true;
+                break;
+
+            case 'w':
+                args.config.worker = true;
+                break;
+
+            case 'x':
+                args.config.xdp = true;
+                break;
+
             case '?':
             default:
                 usage(stderr, app);
@@ -85,5 +182,8 @@ arg_parse(int argc, char** argv)
         ++optind;
     }
 
+    if (args.config.worker && args.cpus.size() > 1)
+        args.config.worker_cpu = args.cpus[1];
+
     return args;
 }
@@ -1,8 +1,12 @@
 #include "arg_parse.hpp"
 #include "mcast_recv.hpp"
+#include "util/logger.hpp"
+#include "util/stats.hpp"
+#include "util/thread_util.hpp"
 #include <cstdio>  // std::fprintf
 #include <cstdlib> // EXIT_FAILURE, EXIT_SUCCESS
 #include <exception>
+#include <vector>
 
 
 int
@@ -15,7 +19,23 @@ main(int argc, char* argv[])
             return EXIT_FAILURE;
         }
 
-        mcast_recv app(args.interface_name, args.groups);
+        // Before pinning, so the reporter and logger threads don't inherit the cpu
+        util::stats_reporter reporter("mcast-recv");
+        util::logger::instance().add_thread();
+
+        // Before construction, so buffers are allocated near the cpu
+        if (!args.cpus.empty())
+            util::pin_thread(args.cpus.front());
+        if (args.config.spin) {
+            std::vector<int> pinned;
+            if (!args.cpus.empty())
+                pinned.push_back(args.cpus.front());
+            if (args.config.worker_cpu != -1)
+                pinned.push_back(args.config.worker_cpu);
+            util::check_isolation(pinned, "mcast-recv");
+        }
+
+        mcast_recv app(args.interface_name, args.groups, reporter.add_thread(), args.config);
         return app.run();
     } catch (std::exception const& e) {
         std::fprintf(stderr, "error: exception: %s\n", e.what());
@@ -1,28 +1,61 @@
 #include "mcast_recv.hpp"
+#include "multicast/wire_format.hpp"
+#include "util/buffer_pool.hpp"
+#include "util/logger.hpp"
 #include "util/net_util.hpp"
+#include "util/thread_util.hpp"
 #include <arpa/inet.h>
 #include <endian.h>
 #include <getopt.h>
-#include <net/if.h> // IFNAMSIZ
+#include <linux/net_tstamp.h> // hwtstamp_config, SOF_TIMESTAMPING_*
+#include <linux/sockios.h>    // SIOCSHWTSTAMP
+#include <net/if.h>           // IFNAMSIZ
 #include <netinet/in.h>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>  // ::ioctl
-#include <sys/socket.h> // ::recvmsg, ::setsockopt, ::socket
+#include <sys/socket.h> // ::recvmmsg, ::setsockopt, ::socket
 #include <sys/types.h>
-#include <unistd.h> // ::close
+#include <unistd.h>  // ::close
+#include <algorithm> // std::max
 #include <cerrno>
+#include <chrono>
 #include <cstdint>
-#include <cstring> // ::basename, std::strerror, std::strncpy
+#include <cstring> // ::basename, std::memcpy, std::strerror, std::strncpy
+#include <exception>
+#include <memory> // std::make_unique
 #include <print>
 #include <stdexcept> // std::runtime_error
 #include <string>
 #include <string_view>
-#include <tuple>
+#include <utility>
 
 
-mcast_recv::mcast_recv(std::string const& interface, std::vector<std::string> const& groups)
-        : interface_ip_()
+mcast_recv::mcast_recv(std::string const& interface, std::vector<std::string> const& groups,
+        util::stat_counters& stats, recv_config const& config)
+        : interface_(interface)
+        , interface_ip_()
+        , interface_addr_()
+        , timestamps_(config.timestamps)
+        , use_xdp_(config.xdp)
+        , xdp_queue_(config.xdp_queue)
+        , worker_cpu_(config.worker_cpu)
+        , spin_(config.spin)
+        , busy_poll_usecs_(config.busy_poll_usecs)
+        , rcvbuf_bytes_(config.rcvbuf_bytes)
+        , verbose_(config.verbose)
+        , stats_(stats)
         , groups_()
+        , bufs_()
+        , iovs_()
+        , control_()
+        , packets_()
+        , msgs_(RecvBatchSize)
+        , spare_()
+        , xdp_()
+        , groups_by_addr_()
+        , ready_()
+        , free_()
+        , worker_()
 {
     // Need a socket to get interface ip from name
     int const tmp_sock = ::socket(AF_INET, SOCK_DGRAM, 0);
@@ -43,18 +76,69 @@ mcast_recv::mcast_recv(std::string const& interface, std::vector<std::string> co
     // Convert/validate all requested groups
     groups_.reserve(groups.size());
     for (auto const& g : groups) {
-        auto [ip, port] = net::parse_ip_port(g);
-        if (ip.empty() || port == 0)
-            throw std::runtime_error("invalid group: " + g);
-        groups_.emplace_back(multicast_group{-1, ip, port});
+        auto const addr = net::parse_ip_port(g);
+        if (!addr || addr->family != AF_INET || addr->port == 0)
+            throw std::runtime_error("invalid group (expected ipv4 'ip:port'): " + g);
+        multicast_group& group = groups_.emplace_back();
+        group.addr = *addr;
+        group.name = net::to_string(*addr);
     }
 
-    interface_ip_ = ::inet_ntoa(reinterpret_cast<sockaddr_in*>(&req.ifr_addr)->sin_addr); // NOLINT
+    // Inline, one batch worth of slots is enough; a worker needs enough
+    // to absorb bursts while it is busy
+    std::size_t const num_slots = config.worker ? WorkerSlots : RecvBatchSize;
+    bufs_.reserve(num_slots);
+    iovs_.resize(num_slots);
+    packets_.resize(num_slots);
+    control_.resize(num_slots * ControlBufferSize);
+    for (std::size_t i = 0; i < num_slots; ++i) {
+        util::pooled_buffer& buf
+                = bufs_.emplace_back(util::buffer_pool::instance().acquire(DefaultBufferSize));
+        if (!buf)
+            throw std::runtime_error("buffer_pool: out of memory");
+
+        iovs_[i].iov_base = buf.data();
+        iovs_[i].iov_len = buf.capacity();
+    }
+
+    // Every slot starts out free
+    if (config.worker) {
+        ready_ = std::make_unique<util::spsc_ring<std::uint32_t>>(num_slots);
+        free_ = std::make_unique<util::spsc_ring<std::uint32_t>>(num_slots);
+        for (std::size_t i = 0; i < num_slots; ++i)
+            free_->try_push(static_cast<std::uint32_t>(i));
+        spare_.reserve(RecvBatchSize);
+    } else {
+        for (std::size_t i = 0; i < num_slots; ++i)
+            spare_.push_back(static_cast<std::uint32_t>(i));
+    }
+
+    interface_addr_ = reinterpret_cast<sockaddr_in*>(&req.ifr_addr)->sin_addr; // NOLINT
+    interface_ip_ = ::inet_ntoa(interface_addr_);
     std::println("listening on interface {} ({})", interface, interface_ip_);
 }
 
+mcast_recv::~mcast_recv()
+{
+    // The worker reads the xsk statistics and the groups, so it has to
+    // be gone before they are; members are destroyed only after this
+    // body has run
+    if (worker_.joinable()) {
+        worker_.request_stop();
+        worker_.join();
+    }
+
+    xdp_.reset(); // detach before leaving the groups
+    for (auto const& group : groups_) {
+        if (group.sock != -1)
+            ::close(group.sock);
+    }
+    if (epollfd_ != -1)
+        ::close(epollfd_);
+}
+
 int
-mcast_recv::subscribe(std::string_view ip, std::uint16_t port)
+mcast_recv::subscribe(net::endpoint const& group)
 {
     int const sock = ::socket(AF_INET, SOCK_DGRAM, 0);
     if (sock == -1) {
@@ -67,76 +151,548 @@ mcast_recv::subscribe(std::string_view ip, std::uint16_t port)
     int rv = ::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
     if (rv == -1) {
         std::println(stderr, "error: setsockopt(SO_REUSEADDR): {}", std::strerror(errno));
+        ::close(sock);
+        return -1;
+    }
+
+    if (timestamps_ != timestamp_mode::None) {
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if (timestamps_ == timestamp_mode::Hardware)
+            flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        rv = ::setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+        if (rv == -1) {
+            std::println(stderr, "error: setsockopt(SO_TIMESTAMPING): {}", std::strerror(errno));
+            ::close(sock);
+            return -1;
+        }
+    }
+
+    // Count datagrams dropped for lack of buffer space
+    rv = ::setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &yes, sizeof(yes));
+    if (rv == -1) {
+        std::println(stderr, "error: setsockopt(SO_RXQ_OVFL): {}", std::strerror(errno));
+        ::close(sock);
+        return -1;
+    }
+
+    if (rcvbuf_bytes_ > 0 && !set_rcvbuf(sock)) {
+        ::close(sock);
         return -1;
     }
 
+    if (busy_poll_usecs_ > 0) {
+        if (!net::set_busy_poll(sock, busy_poll_usecs_)) {
+            std::println(stderr, "error: set_busy_poll: {}", std::strerror(errno));
+            ::close(sock);
+            return -1;
+        }
+
+        // Optional; once refused, it would be refused on every socket
+        if (prefer_busy_poll_ && !net::set_prefer_busy_poll(sock)) {
+            std::println(stderr, "warning: SO_PREFER_BUSY_POLL: {}; busy polling with interrupts",
+                    std::strerror(errno));
+            prefer_busy_poll_ = false;
+        }
+    }
+
     // Bind to filter incoming messages by port
-    sockaddr_in addr = {};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htobe16(port);
-    addr.sin_addr.s_addr = ::inet_addr(std::string(ip).c_str());
-    rv = ::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    sockaddr_storage addr = {};
+    socklen_t const addrlen = group.to_sockaddr(addr);
+    rv = ::bind(sock, reinterpret_cast<sockaddr*>(&addr), addrlen);
     if (rv == -1) {
         std::println(stderr, "error: bind: {}", std::strerror(errno));
+        ::close(sock);
         return -1;
     }
 
     // Subscribe
     ip_mreqn mreq = {};
-    mreq.imr_multiaddr.s_addr = ::inet_addr(std::string(ip).c_str());
-    mreq.imr_address.s_addr = ::inet_addr(interface_ip_.c_str());
+    mreq.imr_multiaddr.s_addr = group.ipv4();
+    mreq.imr_address = interface_addr_;
     rv = ::setsockopt(
             sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<char*>(&mreq), sizeof(mreq));
     if (rv == -1) {
         std::println(stderr, "error: setsockopt(IP_ADD_MEMBERSHIP): {}", std::strerror(errno));
+        ::close(sock);
         return -1;
     }
 
     return sock;
 }
 
+bool
+mcast_recv::set_rcvbuf(int sock)
+{
+    // SO_RCVBUFFORCE needs CAP_NET_ADMIN; SO_RCVBUF is capped at
+    // net.core.rmem_max
+    int rv = ::setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf_bytes_, sizeof(rcvbuf_bytes_));
+    if (rv == -1 && errno == EPERM)
+        rv = ::setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf_bytes_, sizeof(rcvbuf_bytes_));
+    if (rv == -1) {
+        std::println(stderr, "error: setsockopt(SO_RCVBUF): {}", std::strerror(errno));
+        return false;
+    }
+
+    // The kernel doubles the requested size to allow for bookkeeping
+    int actual = 0;
+    socklen_t len = sizeof(actual);
+    rv = ::getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &actual, &len);
+    if (rv == 0 && actual / 2 < rcvbuf_bytes_) {
+        std::println(stderr,
+                "warning: receive buffer is {} bytes, not {}; raise net.core.rmem_max or run "
+                "with CAP_NET_ADMIN",
+                actual / 2, rcvbuf_bytes_);
+    }
+
+    return true;
+}
+
 int
 mcast_recv::run()
 {
-    std::vector<pollfd> fds;
+    if (timestamps_ == timestamp_mode::Hardware && !enable_hw_timestamps()) {
+        std::println(stderr, "warning: hardware timestamps unavailable, using software");
+        timestamps_ = timestamp_mode::Software;
+    }
 
-    for (auto const& group : groups_) {
-        int const sock = subscribe(group.ip, group.port);
-        if (sock == -1) {
-            std::println(stderr, "error: subscription failure: {}:{}", group.ip, group.port);
+    epollfd_ = ::epoll_create1(0);
+    if (epollfd_ == -1) {
+        std::println(stderr, "error: epoll_create1: {}", std::strerror(errno));
+        return 1;
+    }
+
+    for (auto& group : groups_) {
+        group.sock = subscribe(group.addr);
+        if (group.sock == -1) {
+            std::println(stderr, "error: subscription failure: {}", group.name);
             return -1;
         }
 
-        pollfd pfd{};
-        pfd.fd = sock;
-        pfd.events = (POLLIN | POLLPRI | POLLERR | POLLHUP | POLLNVAL);
-        pfd.revents = 0;
-        fds.emplace_back(pfd);
+        // Level-triggered; drain() may leave data behind when it sees a
+        // short batch.
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = &group;
+        if (int rv = ::epoll_ctl(epollfd_, EPOLL_CTL_ADD, group.sock, &event); rv == -1) {
+            std::println(stderr, "error: epoll_ctl: {}", std::strerror(errno));
+            return 1;
+        }
     }
 
+    // Sockets first: they hold the memberships that make the switch
+    // forward the groups to us
+    if (use_xdp_ && !attach_xdp())
+        std::println(stderr, "warning: af_xdp unavailable, using sockets");
+
+    // From here on the worker owns the groups' statistics
+    if (ready_)
+        worker_ = std::jthread([this](std::stop_token stop) { work(std::move(stop)); });
+
+    if (spin_)
+        return spin() ? 0 : 1;
+
+    using clock = std::chrono::steady_clock;
+    auto next_report = clock::now() + std::chrono::milliseconds(ReportIntervalMsecs);
+
+    epoll_event events[EpollMaxEvents];
     while (true) {
-        int const rv = ::ppoll(fds.data(), fds.size(), nullptr, nullptr);
-        if (rv == -1) {
-            std::println(stderr, "error: ppoll: {}", std::strerror(errno));
+        // Wake up in time to report even if nothing arrives
+        auto const wait = std::chrono::ceil<std::chrono::milliseconds>(next_report - clock::now());
+        int const timeout
+                = static_cast<int>(std::max<std::chrono::milliseconds::rep>(wait.count(), 0));
+
+        int const nfds
+                = ::epoll_wait(epollfd_, static_cast<epoll_event*>(events), EpollMaxEvents, timeout);
+        if (nfds == -1) {
+            if (errno == EINTR)
+                continue;
+            util::log_error("error: epoll_wait: {}", std::strerror(errno));
             return 1;
         }
-        if (rv == 0)
-            continue;
 
-        char buf[DefaultBufferSize];
-        for (pollfd const& fd : fds) {
-            if (fd.revents == 0)
+        for (int i = 0; i < nfds; ++i) {
+            // The xsk is registered without a group
+            auto* group = static_cast<multicast_group*>(events[i].data.ptr);
+            if (group == nullptr)
+                drain_xdp();
+            else if (!drain(*group))
+                return 1;
+        }
+
+        if (!ready_ && clock::now() >= next_report) {
+            report();
+            next_report += std::chrono::milliseconds(ReportIntervalMsecs);
+        }
+    }
+
+    return 0;
+}
+
+bool
+mcast_recv::drain(multicast_group& group)
+{
+    int const sock = group.sock;
+
+    while (true) {
+        // Out of slots: leave the rest in the socket until the worker
+        // catches up
+        if (!refill_spare())
+            return true;
+
+        std::size_t const batch = std::min(spare_.size(), RecvBatchSize);
+        for (std::size_t i = 0; i < batch; ++i) {
+            std::uint32_t const slot = spare_[i];
+            msghdr& hdr = msgs_[i].msg_hdr;
+            hdr.msg_iov = &iovs_[slot];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = control_.data() + slot * ControlBufferSize;
+            hdr.msg_controllen = ControlBufferSize;
+        }
+
+        int const n = ::recvmmsg(
+                sock, msgs_.data(), static_cast<unsigned>(batch), MSG_DONTWAIT, nullptr);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR)
                 continue;
 
-            ::ssize_t const nbytes
-                    = ::recvfrom(fd.fd, &buf, sizeof(buf), /*flags=*/0, nullptr, nullptr);
-            if (nbytes == -1) {
-                std::println(stderr, "error: recvfrom: {}", std::strerror(errno));
-                return 1;
+            util::log_error("error: recvmmsg: {}", std::strerror(errno));
+            stats_.add_errors();
+            return false;
+        }
+
+        // Dequeue time for the whole batch. Kernel software timestamps
+        // and wire::header send times are CLOCK_REALTIME; hardware
+        // timestamps are only comparable if the nic clock is
+        // synchronized to it (e.g., by phc2sys).
+        timespec now{};
+        ::clock_gettime(CLOCK_REALTIME, &now);
+
+        auto const count = static_cast<std::size_t>(n);
+        for (std::size_t i = 0; i < count; ++i) {
+            packet& pkt = packets_[spare_[i]];
+            pkt.group = &group;
+            pkt.len = msgs_[i].msg_len;
+            pkt.controllen = msgs_[i].msg_hdr.msg_controllen;
+            pkt.now = now;
+
+            // The buffer fits everything asked for, so something else
+            // crowded out the timestamp or drop count
+            if ((msgs_[i].msg_hdr.msg_flags & MSG_CTRUNC) != 0) [[unlikely]] {
+                if (truncated_control_++ == 0)
+                    util::log_error("error: recvmmsg: control data truncated (MSG_CTRUNC)");
+                stats_.add_errors();
             }
-            std::println("received {} bytes", nbytes);
         }
+        dispatch(count);
+
+        // A short batch means the queue is empty; skip the EAGAIN call
+        if (count < batch)
+            return true;
     }
+}
 
-    return 0;
+void
+mcast_recv::drain_xdp()
+{
+    timespec now{};
+    ::clock_gettime(CLOCK_REALTIME, &now);
+
+    // Frames go back to the kernel as soon as receive() returns, so with
+    // a worker the payload is copied into a slot
+    std::size_t used = 0;
+    auto on_packet = [this, &now, &used](xdp_receiver::endpoint const& dst, char const* data,
+                             std::size_t len) {
+        // The filter only redirects subscribed groups
+        auto const it = groups_by_addr_.find(addr_key(dst.ip, dst.port));
+        if (it == groups_by_addr_.end())
+            return;
+        if (!ready_) {
+            on_datagram(*it->second, data, len, now);
+            return;
+        }
+
+        std::uint32_t const slot = spare_[used++];
+        std::memcpy(bufs_[slot].data(), data, len);
+        packets_[slot] = {.group = it->second, .len = len, .controllen = 0, .now = now};
+    };
+
+    // Same batching as drain(); a short batch means the ring is empty
+    while (refill_spare()) {
+        std::size_t const batch = std::min(spare_.size(), RecvBatchSize);
+        used = 0;
+        std::size_t const n = xdp_->receive(on_packet, batch);
+        if (ready_)
+            dispatch(used);
+        if (n < batch)
+            return;
+        ::clock_gettime(CLOCK_REALTIME, &now);
+    }
+}
+
+bool
+mcast_recv::refill_spare()
+{
+    if (ready_ && spare_.size() < RecvBatchSize) {
+        std::size_t const have = spare_.size();
+        spare_.resize(RecvBatchSize);
+        spare_.resize(have + free_->try_pop(spare_.data() + have, RecvBatchSize - have));
+    }
+    return !spare_.empty();
+}
+
+void
+mcast_recv::dispatch(std::size_t n)
+{
+    if (!ready_) {
+        for (std::size_t i = 0; i < n; ++i)
+            process(spare_[i]);
+        return;
+    }
+
+    // Can't fail: the ring has room for every slot
+    ready_->try_push(spare_.data(), n);
+    spare_.erase(spare_.begin(), spare_.begin() + static_cast<std::ptrdiff_t>(n));
+}
+
+void
+mcast_recv::process(std::uint32_t slot)
+{
+    packet const& pkt = packets_[slot];
+    on_datagram(*pkt.group, bufs_[slot].data(), pkt.len, pkt.now);
+
+    if (pkt.controllen != 0) {
+        msghdr msg{};
+        msg.msg_control = control_.data() + slot * ControlBufferSize;
+        msg.msg_controllen = pkt.controllen;
+        read_control(*pkt.group, msg, pkt.now);
+    }
+}
+
+void
+mcast_recv::work(std::stop_token stop)
+{
+    util::logger::instance().add_thread();
+    if (worker_cpu_ != -1) {
+        try {
+            util::pin_thread(worker_cpu_);
+        } catch (std::exception const& e) {
+            util::log_error("warning: worker not pinned: {}", e.what());
+        }
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto next_report = clock::now() + std::chrono::milliseconds(ReportIntervalMsecs);
+
+    std::uint32_t slots[RecvBatchSize];
+    util::backoff_wait wait;
+    while (!stop.stop_requested()) {
+        std::size_t const n = ready_->try_pop(static_cast<std::uint32_t*>(slots), RecvBatchSize);
+        if (n == 0) {
+            if (spin_)
+                util::cpu_relax();
+            else
+                wait();
+        } else {
+            wait.reset();
+            for (std::size_t i = 0; i < n; ++i)
+                process(slots[i]);
+            free_->try_push(static_cast<std::uint32_t const*>(slots), n);
+        }
+
+        if (clock::now() >= next_report) {
+            report();
+            next_report += std::chrono::milliseconds(ReportIntervalMsecs);
+        }
+    }
+}
+
+bool
+mcast_recv::spin()
+{
+    using clock = std::chrono::steady_clock;
+    auto next_report = clock::now() + std::chrono::milliseconds(ReportIntervalMsecs);
+
+    while (true) {
+        for (auto& group : groups_) {
+            if (!drain(group))
+                return false;
+        }
+        if (xdp_)
+            drain_xdp();
+
+        if (!ready_ && clock::now() >= next_report) {
+            report();
+            next_report += std::chrono::milliseconds(ReportIntervalMsecs);
+        }
+    }
+}
+
+void
+mcast_recv::on_datagram(
+        multicast_group& group, void const* data, std::size_t len, timespec const& now)
+{
+    stats_.add(1, len);
+    if (verbose_)
+        util::log_info("received {} bytes", len);
+
+    if (wire::header hdr{}; wire::decode(data, len, hdr))
+        record_sequenced(group, hdr, now);
+}
+
+bool
+mcast_recv::attach_xdp()
+{
+    std::vector<xdp_receiver::endpoint> filter;
+    filter.reserve(groups_.size());
+    for (auto& group : groups_) {
+        xdp_receiver::endpoint const ep{
+                .ip = group.addr.ipv4(),
+                .port = htobe16(group.addr.port),
+        };
+        filter.push_back(ep);
+        groups_by_addr_[addr_key(ep.ip, ep.port)] = &group;
+    }
+
+    try {
+        xdp_ = std::make_unique<xdp_receiver>(interface_, xdp_queue_, filter);
+    } catch (std::exception const& e) {
+        std::println(stderr, "error: xdp_receiver: {}", e.what());
+        return false;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (int rv = ::epoll_ctl(epollfd_, EPOLL_CTL_ADD, xdp_->fd(), &event); rv == -1) {
+        std::println(stderr, "error: epoll_ctl: {}", std::strerror(errno));
+        xdp_.reset();
+        return false;
+    }
+
+    std::println("af_xdp attached to {} queue {} ({} mode)", interface_, xdp_queue_,
+            xdp_->native_mode() ? "native" : "generic");
+    return true;
+}
+
+bool
+mcast_recv::enable_hw_timestamps()
+{
+    int const sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == -1) {
+        std::println(stderr, "error: socket: {}", std::strerror(errno));
+        return false;
+    }
+
+    hwtstamp_config config = {};
+    config.tx_type = HWTSTAMP_TX_OFF;
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+    ifreq req = {};
+    std::strncpy(req.ifr_name, interface_.c_str(), IFNAMSIZ - 1); // NOLINT
+    req.ifr_data = reinterpret_cast<char*>(&config);              // NOLINT
+    int const rv = ::ioctl(sock, SIOCSHWTSTAMP, &req);
+    int const error = errno;
+    ::close(sock);
+    if (rv == -1) {
+        std::println(stderr, "error: ioctl(SIOCSHWTSTAMP): {}", std::strerror(error));
+        return false;
+    }
+
+    return true;
+}
+
+void
+mcast_recv::read_control(multicast_group& group, msghdr const& msg, timespec const& now)
+{
+    for (cmsghdr const* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+            cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&msg), const_cast<cmsghdr*>(cmsg))) {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+            continue;
+
+        // Only present once the socket has dropped something
+        if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            std::uint32_t drops = 0;
+            std::memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            stats_.add_drops(drops - group.drops);
+            group.drops = drops;
+            continue;
+        }
+
+        if (cmsg->cmsg_type != SCM_TIMESTAMPING)
+            continue;
+
+        scm_timestamping tss{};
+        std::memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+
+        // ts[0] is software, ts[2] raw hardware; prefer hardware when
+        // the nic provided one
+        timespec const& ts = (tss.ts[2].tv_sec != 0 || tss.ts[2].tv_nsec != 0) ? tss.ts[2]
+                                                                                : tss.ts[0];
+        if (ts.tv_sec == 0 && ts.tv_nsec == 0)
+            continue;
+
+        std::int64_t const delta = (now.tv_sec - ts.tv_sec) * 1'000'000'000L
+                + (now.tv_nsec - ts.tv_nsec);
+        group.latency.record(delta > 0 ? static_cast<std::uint64_t>(delta) : 0);
+    }
+}
+
+void
+mcast_recv::record_sequenced(multicast_group& group, wire::header const& hdr, timespec const& now)
+{
+    multicast_group::publisher* pub = nullptr;
+    for (auto& p : group.publishers) {
+        if (p.id == hdr.publisher_id) {
+            pub = &p;
+            break;
+        }
+    }
+    if (pub == nullptr) {
+        pub = &group.publishers.emplace_back();
+        pub->id = hdr.publisher_id;
+    }
+
+    pub->seqs.record(hdr.seq);
+
+    std::int64_t const now_nsec = now.tv_sec * 1'000'000'000L + now.tv_nsec;
+    auto const delta = now_nsec - static_cast<std::int64_t>(hdr.send_time_nsec);
+    pub->one_way.record(delta > 0 ? static_cast<std::uint64_t>(delta) : 0);
+}
+
+void
+mcast_recv::report()
+{
+    if (xdp_) {
+        if (xdp_statistics stats{}; xdp_->statistics(stats)) {
+            std::println("af_xdp rx_dropped={} rx_invalid_descs={} rx_ring_full={} "
+                         "rx_fill_ring_empty_descs={}",
+                    stats.rx_dropped, stats.rx_invalid_descs, stats.rx_ring_full,
+                    stats.rx_fill_ring_empty_descs);
+        }
+    }
+
+    for (auto& group : groups_) {
+        if (util::histogram& h = group.latency; h.count() != 0) {
+            std::println("{} latency(ns) n={} min={} p50={} p90={} p99={} p99.9={} max={} "
+                         "mean={:.0f}",
+                    group.name, h.count(), h.min(), h.percentile(50), h.percentile(90),
+                    h.percentile(99), h.percentile(99.9), h.max(), h.mean());
+            h.reset();
+        }
+
+        for (auto& pub : group.publishers) {
+            util::histogram& h = pub.one_way;
+            if (h.count() == 0)
+                continue;
+
+            std::println("{} publisher={} received={} missing={} duplicates={} reordered={} "
+                         "one-way(ns) n={} min={} p50={} p99={} p99.9={} max={}",
+                    group.name, pub.id, pub.seqs.received(), pub.seqs.missing(),
+                    pub.seqs.duplicates(), pub.seqs.reordered(), h.count(), h.min(),
+                    h.percentile(50), h.percentile(99), h.percentile(99.9), h.max());
+            h.reset();
+        }
+    }
 }
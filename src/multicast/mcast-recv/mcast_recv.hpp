@@ -1,29 +1,219 @@
 #pragma once
 
+#include "sequence_tracker.hpp"
+#include "xdp_receiver.hpp"
+#include "multicast/wire_format.hpp"
+#include "util/buffer_pool.hpp"
+#include "util/histogram.hpp"
+#include "util/net_util.hpp"
+#include "util/spsc_ring.hpp"
+#include "util/stats.hpp"
+#include <linux/errqueue.h> // scm_timestamping
+#include <netinet/in.h>     // in_addr
+#include <sys/socket.h>     // mmsghdr
+#include <sys/uio.h>        // iovec
 #include <cstdint>
+#include <ctime>  // timespec
+#include <memory> // std::unique_ptr
+#include <stop_token>
 #include <string>
-#include <string_view>
+#include <thread> // std::jthread
+#include <unordered_map>
 #include <vector>
 
 
 struct multicast_group
 {
+    /// Sender identified by wire::header::publisher_id
+    struct publisher
+    {
+        std::uint16_t id = 0;
+        sequence_tracker seqs;
+        util::histogram one_way; ///< nsecs from send time to dequeue
+    };
+
     int sock = -1;
-    std::string ip = "";
-    std::uint16_t port = 0;
+    net::endpoint addr;                ///< ipv4 group and port
+    std::string name;                  ///< "ip:port", for reports
+    util::histogram latency;           ///< nsecs from kernel rx timestamp to dequeue
+    std::vector<publisher> publishers; ///< seen sending wire::header datagrams
+    std::uint32_t drops = 0;           ///< SO_RXQ_OVFL: dropped by the socket, cumulative
+};
+
+enum class timestamp_mode
+{
+    None,
+    Software, ///< kernel stamps datagrams on receive
+    Hardware, ///< nic stamps datagrams, falls back to software
+};
+
+struct recv_config
+{
+    timestamp_mode timestamps = timestamp_mode::None;
+    bool xdp = false;        ///< receive through AF_XDP, falls back to sockets
+    unsigned xdp_queue = 0;  ///< nic rx queue to attach the xsk to
+    bool worker = false;     ///< process datagrams on a separate thread
+    int worker_cpu = -1;     ///< cpu to pin the worker to, -1 for any
+    bool spin = false;       ///< poll sockets in a tight loop instead of blocking
+    int busy_poll_usecs = 0; ///< SO_BUSY_POLL on each socket, 0 to disable
+    int rcvbuf_bytes = 0;    ///< SO_RCVBUF(FORCE) of each socket, 0 for the default
+    bool verbose = false;    ///< print every datagram received
 };
 
+/*  \class  mcast_recv
+ *  \brief  Receives from any number of multicast groups, one socket
+ *          per group, all registered with a single epoll instance.
+ *          Each registration carries a pointer to its group, so a
+ *          readiness event leads straight to the group that fired
+ *          without scanning the others. Optionally, datagrams
+ *          arriving on one nic queue are taken through an AF_XDP socket
+ *          instead, bypassing the kernel udp stack; the group sockets
+ *          still hold the IGMP memberships and receive whatever arrives
+ *          on other queues.
+ *
+ *          Datagrams are received into a fixed set of slots. Inline,
+ *          each batch is processed before the next receive. With a
+ *          worker, filled slots are handed to a processing thread over
+ *          one lock-free ring and come back over another, so the I/O
+ *          thread keeps draining the sockets while the worker is busy
+ *          and the kernel buffers only fill up once every slot is
+ *          queued.
+ *
+ *          When spinning, epoll is bypassed and every socket is read
+ *          without blocking in a tight loop, and the worker never
+ *          sleeps either. Combined with SO_BUSY_POLL, each read also
+ *          polls the device queue.
+ */
 class mcast_recv final
 {
 public:
-    mcast_recv(std::string const& interface, std::vector<std::string> const& groups);
+    /// \param stats Datagrams and drops are counted by the thread that
+    ///        processes datagrams (the worker, if any), receive errors by
+    ///        the thread that calls run(); each counter has one writer
+    mcast_recv(std::string const& interface, std::vector<std::string> const& groups,
+            util::stat_counters& stats, recv_config const& config = {});
+    ~mcast_recv();
+
+    // No copies/moves
+    mcast_recv(mcast_recv const&) = delete;
+    mcast_recv(mcast_recv&&) = delete;
+    mcast_recv& operator=(mcast_recv const&) = delete;
+    mcast_recv&& operator=(mcast_recv&&) = delete;
+
     int run();
 
 private:
-    int subscribe(std::string_view ip, std::uint16_t port);
+    int subscribe(net::endpoint const& group);
+
+    /// Ask the nic to timestamp all received packets (SIOCSHWTSTAMP)
+    /// \return \c false on error
+    bool enable_hw_timestamps();
+
+    /// Size the receive buffer of sock, bypassing net.core.rmem_max
+    /// when permitted
+    /// \return \c false on error
+    bool set_rcvbuf(int sock);
+
+    /// Pick up the drop count and the receive timestamp (recording the
+    /// time msg spent between the kernel and dequeue) from the
+    /// ancillary data of msg
+    void read_control(multicast_group& group, msghdr const& msg, timespec const& now);
+
+    /// Track sequence and one-way latency of a datagram with a header
+    void record_sequenced(multicast_group& group, wire::header const& hdr, timespec const& now);
+
+    /// Print and reset the latency histograms of each group, and print
+    /// af_xdp drops; throughput is left to the stats reporter
+    void report();
+
+    /// Handle one datagram, however it was received
+    void on_datagram(
+            multicast_group& group, void const* data, std::size_t len, timespec const& now);
+
+    /// Attach the AF_XDP receive path and register it with epoll
+    /// \return \c false if unavailable
+    bool attach_xdp();
+
+    /// Receive datagrams from group with recvmmsg, a batch at a time,
+    /// until it would block or no slots are free
+    /// \return \c false on error
+    bool drain(multicast_group& group);
+
+    /// Like drain(), for the AF_XDP socket, which carries datagrams of
+    /// all groups
+    void drain_xdp();
+
+    /// Top up spare_ with slots the worker has finished with
+    /// \return \c false if none are available
+    bool refill_spare();
+
+    /// Process the first n slots of spare_, inline or by handing them
+    /// to the worker
+    void dispatch(std::size_t n);
+
+    /// Handle the datagram received into a slot
+    void process(std::uint32_t slot);
+
+    /// Worker thread: process handed-off slots and report until stopped
+    void work(std::stop_token stop);
+
+    /// Read every socket without blocking until one fails
+    /// \return \c false on error
+    bool spin();
+
+    /// Key of groups_by_addr_
+    static std::uint64_t
+    addr_key(std::uint32_t ip, std::uint16_t port)
+    {
+        return (std::uint64_t{ip} << 16) | port;
+    }
 
 private:
-    static constexpr std::size_t DefaultBufferSize = 4096;
+    /// Datagram received into a slot
+    struct packet
+    {
+        multicast_group* group = nullptr;
+        std::size_t len = 0;
+        std::size_t controllen = 0; ///< bytes of control_ written by the kernel
+        timespec now{};             ///< dequeue time
+    };
+
+    static constexpr std::size_t DefaultBufferSize = 65536; ///< fits any udp datagram
+    static constexpr std::size_t RecvBatchSize = 64;        ///< max num of datagrams per recvmmsg
+    static constexpr int EpollMaxEvents = 64;               ///< max num of events per epoll_wait
+    static constexpr int ReportIntervalMsecs = 1000;        ///< how often to print statistics
+    static constexpr std::size_t WorkerSlots = 1024;        ///< num of slots with a worker
+    static constexpr std::size_t ControlBufferSize
+            = CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(std::uint32_t));
+    std::string interface_;
     std::string interface_ip_;
-    std::vector<multicast_group> groups_;
+    in_addr interface_addr_{}; ///< interface_ip_, for socket options
+    timestamp_mode timestamps_ = timestamp_mode::None;
+    bool use_xdp_ = false;
+    unsigned xdp_queue_ = 0;
+    int worker_cpu_ = -1;
+    bool spin_ = false;
+    int busy_poll_usecs_ = 0;
+    bool prefer_busy_poll_ = true; ///< until SO_PREFER_BUSY_POLL is refused
+    int rcvbuf_bytes_ = 0;
+    bool verbose_ = false;
+    util::stat_counters& stats_;
+    std::uint64_t truncated_control_ = 0; ///< MSG_CTRUNC datagrams; only the first is logged
+    int epollfd_ = -1;
+    std::vector<multicast_group> groups_;   ///< never resized after construction
+    std::vector<util::pooled_buffer> bufs_; ///< one per slot
+    std::vector<iovec> iovs_;               ///< iovs_[i] covers bufs_[i]
+    std::vector<char> control_;             ///< ControlBufferSize bytes per slot
+    std::vector<packet> packets_;           ///< one per slot
+    std::vector<mmsghdr> msgs_;             ///< one per slot of the current batch
+    std::vector<std::uint32_t> spare_;      ///< slots owned by the I/O thread
+    std::unique_ptr<xdp_receiver> xdp_;     ///< null unless attached
+
+    /// addr_key(ip, port) -> group, both in network byte order
+    std::unordered_map<std::uint64_t, multicast_group*> groups_by_addr_;
+
+    // Only with a worker
+    std::unique_ptr<util::spsc_ring<std::uint32_t>> ready_; ///< I/O thread -> worker
+    std::unique_ptr<util::spsc_ring<std::uint32_t>> free_;  ///< worker -> I/O thread
+    std::jthread worker_; ///< joined first thing in the destructor
 };
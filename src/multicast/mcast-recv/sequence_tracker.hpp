@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*  \class  sequence_tracker
+ *  \brief  Classifies the sequence numbers of one publisher's stream.
+ *          The last Window sequence numbers below the highest seen are
+ *          remembered in a bitmap, so a late arrival can be told apart
+ *          from a duplicate and taken back off the missing count.
+ *          Anything older than that is counted as reordered.
+ */
+class sequence_tracker
+{
+public:
+    static constexpr std::uint64_t Window = 64;
+
+    enum class result
+    {
+        InOrder,
+        Gap,       ///< one or more sequence numbers skipped
+        Duplicate, ///< already seen
+        Reordered, ///< older than the highest seen, not seen before
+    };
+
+    result
+    record(std::uint64_t seq)
+    {
+        ++received_;
+
+        if (!started_ || seq >= next_) {
+            std::uint64_t const skipped = started_ ? seq - next_ : 0;
+            std::uint64_t const shift = skipped + 1;
+            seen_ = (started_ && shift < Window) ? (seen_ << shift) | 1 : 1;
+            next_ = seq + 1;
+            started_ = true;
+            missing_ += skipped;
+            return skipped == 0 ? result::InOrder : result::Gap;
+        }
+
+        // Bit i of seen_ is set if (next_ - 1 - i) has arrived
+        std::uint64_t const age = next_ - 1 - seq;
+        if (age < Window) {
+            std::uint64_t const bit = std::uint64_t{1} << age;
+            if ((seen_ & bit) != 0) {
+                ++duplicates_;
+                return result::Duplicate;
+            }
+            seen_ |= bit;
+            if (missing_ != 0)
+                --missing_;
+        }
+        ++reordered_;
+        return result::Reordered;
+    }
+
+    std::uint64_t
+    received() const
+    {
+        return received_;
+    }
+
+    /// Num of sequence numbers skipped and not (yet) seen late
+    std::uint64_t
+    missing() const
+    {
+        return missing_;
+    }
+
+    std::uint64_t
+    duplicates() const
+    {
+        return duplicates_;
+    }
+
+    std::uint64_t
+    reordered() const
+    {
+        return reordered_;
+    }
+
+private:
+    bool started_ = false;
+    std::uint64_t next_ = 0; ///< one past the highest seen
+    std::uint64_t seen_ = 0; ///< arrivals among the Window below next_
+    std::uint64_t received_ = 0;
+    std::uint64_t missing_ = 0;
+    std::uint64_t duplicates_ = 0;
+    std::uint64_t reordered_ = 0;
+};
@@ -0,0 +1,426 @@
+#include "xdp_receiver.hpp"
+#include <endian.h>        // htobe16
+#include <linux/bpf.h>     // bpf_attr, bpf_insn, BPF_*
+#include <linux/if_link.h> // XDP_FLAGS_SKB_MODE
+#include <net/if.h>        // ::if_nametoindex
+#include <netinet/in.h>    // IPPROTO_UDP
+#include <sys/mman.h>      // ::mmap, ::munmap
+#include <sys/socket.h>    // ::bind, ::getsockopt, ::recvfrom, ::setsockopt, ::socket
+#include <sys/syscall.h>   // SYS_bpf
+#include <unistd.h>        // ::close, ::syscall
+#include <cerrno>
+#include <cstddef> // offsetof
+#include <cstdint>
+#include <cstring> // std::strerror
+#include <stdexcept>
+#include <string>
+#include <utility> // std::pair
+#include <vector>
+
+
+namespace {
+    int
+    sys_bpf(bpf_cmd cmd, bpf_attr& attr)
+    {
+        return static_cast<int>(::syscall(SYS_bpf, cmd, &attr, sizeof(attr)));
+    }
+
+    std::runtime_error
+    error(std::string const& what)
+    {
+        return std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    /*  \class  assembler
+     *  \brief  Just enough of an eBPF assembler for the XDP filter.
+     *          Forward jumps are emitted against labels and patched once
+     *          the label is bound.
+     */
+    class assembler
+    {
+    public:
+        enum reg : std::uint8_t
+        {
+            R0,
+            R1,
+            R2,
+            R3,
+            R4,
+            R5,
+            R6,
+            R7,
+        };
+
+        using label = std::size_t;
+
+        label
+        make_label()
+        {
+            labels_.push_back(NoTarget);
+            return labels_.size() - 1;
+        }
+
+        void
+        bind(label l)
+        {
+            labels_[l] = code_.size();
+        }
+
+        void
+        mov(reg dst, reg src)
+        {
+            emit(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0);
+        }
+
+        void
+        mov(reg dst, std::int32_t imm)
+        {
+            emit(BPF_ALU64 | BPF_MOV | BPF_K, dst, R0, 0, imm);
+        }
+
+        void
+        add(reg dst, std::int32_t imm)
+        {
+            emit(BPF_ALU64 | BPF_ADD | BPF_K, dst, R0, 0, imm);
+        }
+
+        /// 32-bit and
+        void
+        and32(reg dst, std::int32_t imm)
+        {
+            emit(BPF_ALU | BPF_AND | BPF_K, dst, R0, 0, imm);
+        }
+
+        /// dst = *(size*)(src + off), size one of BPF_B, BPF_H, BPF_W
+        void
+        load(std::uint8_t size, reg dst, reg src, std::int16_t off)
+        {
+            emit(BPF_LDX | size | BPF_MEM, dst, src, off, 0);
+        }
+
+        /// dst = map referred to by fd
+        void
+        load_map_fd(reg dst, int fd)
+        {
+            emit(BPF_LD | BPF_DW | BPF_IMM, dst, static_cast<reg>(BPF_PSEUDO_MAP_FD), 0, fd);
+            emit(0, R0, R0, 0, 0);
+        }
+
+        /// if (dst > src) goto target
+        void
+        jgt(reg dst, reg src, label target)
+        {
+            jump_to(target);
+            emit(BPF_JMP | BPF_JGT | BPF_X, dst, src, 0, 0);
+        }
+
+        /// if ((u32)dst != (u32)imm) goto target
+        void
+        jne32(reg dst, std::int32_t imm, label target)
+        {
+            jump_to(target);
+            emit(BPF_JMP32 | BPF_JNE | BPF_K, dst, R0, 0, imm);
+        }
+
+        void
+        ja(label target)
+        {
+            jump_to(target);
+            emit(BPF_JMP | BPF_JA, R0, R0, 0, 0);
+        }
+
+        void
+        call(std::int32_t helper)
+        {
+            emit(BPF_JMP | BPF_CALL, R0, R0, 0, helper);
+        }
+
+        void
+        exit()
+        {
+            emit(BPF_JMP | BPF_EXIT, R0, R0, 0, 0);
+        }
+
+        /// \return Program with all jumps resolved
+        std::vector<bpf_insn>
+        finish()
+        {
+            for (auto const& [at, target] : fixups_) {
+                auto const off = static_cast<std::ptrdiff_t>(labels_[target])
+                        - static_cast<std::ptrdiff_t>(at + 1);
+                code_[at].off = static_cast<std::int16_t>(off);
+            }
+            return code_;
+        }
+
+    private:
+        void
+        emit(int code, reg dst, reg src, std::int16_t off, std::int32_t imm)
+        {
+            bpf_insn insn{};
+            insn.code = static_cast<std::uint8_t>(code);
+            insn.dst_reg = dst & 0xf;
+            insn.src_reg = src & 0xf;
+            insn.off = off;
+            insn.imm = imm;
+            code_.push_back(insn);
+        }
+
+        void
+        jump_to(label target)
+        {
+            fixups_.emplace_back(code_.size(), target);
+        }
+
+    private:
+        static constexpr std::size_t NoTarget = SIZE_MAX;
+
+        std::vector<bpf_insn> code_;
+        std::vector<std::size_t> labels_;                   ///< insn index per label
+        std::vector<std::pair<std::size_t, label>> fixups_; ///< jump insn, target
+    };
+
+} // namespace
+
+
+xdp_receiver::xdp_receiver(
+        std::string const& interface, unsigned queue, std::vector<endpoint> const& filter)
+{
+    try {
+        int const ifindex = static_cast<int>(::if_nametoindex(interface.c_str()));
+        if (ifindex == 0)
+            throw error("if_nametoindex(" + interface + ")");
+        if (queue >= MaxQueues)
+            throw std::runtime_error("xdp queue out of range: " + std::to_string(queue));
+
+        setup_socket(ifindex, queue);
+        load_program(ifindex, queue, filter);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+xdp_receiver::~xdp_receiver()
+{
+    release();
+}
+
+void
+xdp_receiver::setup_socket(int ifindex, unsigned queue)
+{
+    xsk_fd_ = ::socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (xsk_fd_ == -1)
+        throw error("socket(AF_XDP)");
+
+    // Packet memory shared with the kernel
+    umem_size_ = std::size_t{NumFrames} * FrameSize;
+    void* const umem = ::mmap(nullptr, umem_size_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (umem == MAP_FAILED)
+        throw error("mmap(umem)");
+    umem_ = static_cast<char*>(umem);
+
+    xdp_umem_reg reg{};
+    reg.addr = reinterpret_cast<std::uintptr_t>(umem_);
+    reg.len = umem_size_;
+    reg.chunk_size = FrameSize;
+    reg.headroom = 0;
+    if (::setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) == -1)
+        throw error("setsockopt(XDP_UMEM_REG)");
+
+    // The fill ring can hold every frame, so returning frames never
+    // has to wait for space
+    auto set_size = [this](int opt, char const* name, std::uint32_t entries) {
+        if (::setsockopt(xsk_fd_, SOL_XDP, opt, &entries, sizeof(entries)) == -1)
+            throw error(std::string("setsockopt(") + name + ")");
+    };
+    set_size(XDP_UMEM_FILL_RING, "XDP_UMEM_FILL_RING", NumFrames);
+    set_size(XDP_UMEM_COMPLETION_RING, "XDP_UMEM_COMPLETION_RING", CompletionSize);
+    set_size(XDP_RX_RING, "XDP_RX_RING", NumFrames);
+
+    xdp_mmap_offsets off{};
+    socklen_t len = sizeof(off);
+    if (::getsockopt(xsk_fd_, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) == -1)
+        throw error("getsockopt(XDP_MMAP_OFFSETS)");
+
+    auto map_ring = [this](ring& r, xdp_ring_offset const& ro, std::uint32_t entries,
+                            std::size_t desc_size, off_t pgoff, char const* name) {
+        r.map_size = ro.desc + entries * desc_size;
+        r.map = ::mmap(nullptr, r.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                xsk_fd_, pgoff);
+        if (r.map == MAP_FAILED) {
+            r.map = nullptr;
+            throw error(std::string("mmap(") + name + ")");
+        }
+        auto* base = static_cast<char*>(r.map);
+        r.producer = reinterpret_cast<std::uint32_t*>(base + ro.producer);
+        r.consumer = reinterpret_cast<std::uint32_t*>(base + ro.consumer);
+        r.flags = reinterpret_cast<std::uint32_t*>(base + ro.flags);
+        r.descs = base + ro.desc;
+        r.mask = entries - 1;
+    };
+    map_ring(fill_, off.fr, NumFrames, sizeof(std::uint64_t), XDP_UMEM_PGOFF_FILL_RING, "fill");
+    map_ring(completion_, off.cr, CompletionSize, sizeof(std::uint64_t),
+            XDP_UMEM_PGOFF_COMPLETION_RING, "completion");
+    map_ring(rx_, off.rx, NumFrames, sizeof(xdp_desc), XDP_PGOFF_RX_RING, "rx");
+
+    // Give the kernel every frame to receive into
+    auto* fill = static_cast<std::uint64_t*>(fill_.descs);
+    for (std::uint32_t i = 0; i < NumFrames; ++i)
+        fill[i] = std::uint64_t{i} * FrameSize;
+    __atomic_store_n(fill_.producer, NumFrames, __ATOMIC_RELEASE);
+
+    // Let the kernel pick zero-copy if the driver supports it
+    sockaddr_xdp addr{};
+    addr.sxdp_family = AF_XDP;
+    addr.sxdp_flags = XDP_USE_NEED_WAKEUP;
+    addr.sxdp_ifindex = static_cast<std::uint32_t>(ifindex);
+    addr.sxdp_queue_id = queue;
+    if (::bind(xsk_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+        throw error("bind(AF_XDP)");
+}
+
+void
+xdp_receiver::load_program(int ifindex, unsigned queue, std::vector<endpoint> const& filter)
+{
+    // Queue index -> xsk
+    bpf_attr attr{};
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(std::uint32_t);
+    attr.value_size = sizeof(std::uint32_t);
+    attr.max_entries = MaxQueues;
+    map_fd_ = sys_bpf(BPF_MAP_CREATE, attr);
+    if (map_fd_ == -1)
+        throw error("bpf(BPF_MAP_CREATE)");
+
+    std::uint32_t const key = queue;
+    auto const value = static_cast<std::uint32_t>(xsk_fd_);
+    attr = {};
+    attr.map_fd = static_cast<std::uint32_t>(map_fd_);
+    attr.key = reinterpret_cast<std::uintptr_t>(&key);
+    attr.value = reinterpret_cast<std::uintptr_t>(&value);
+    attr.flags = BPF_ANY;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, attr) == -1)
+        throw error("bpf(BPF_MAP_UPDATE_ELEM)");
+
+    // The filter. Equivalent C:
+    //   if (data + 42 > data_end) return XDP_PASS;
+    //   if (eth->h_proto != htons(ETH_P_IP)) return XDP_PASS;
+    //   if (ip->version_ihl != 0x45 || ip->protocol != IPPROTO_UDP) return XDP_PASS;
+    //   if (ip->frag_off & htons(IP_MF | IP_OFFMASK)) return XDP_PASS;
+    //   for each (addr, port) in filter:
+    //       if (ip->daddr == addr && udp->dest == port)
+    //           return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+    //   return XDP_PASS;
+    using asm_t = assembler;
+    asm_t a;
+    asm_t::label const pass = a.make_label();
+    asm_t::label const redirect = a.make_label();
+
+    a.mov(asm_t::R6, asm_t::R1); // ctx
+    a.load(BPF_W, asm_t::R2, asm_t::R6, offsetof(xdp_md, data));
+    a.load(BPF_W, asm_t::R3, asm_t::R6, offsetof(xdp_md, data_end));
+    a.mov(asm_t::R4, asm_t::R2);
+    a.add(asm_t::R4, HeadersSize);
+    a.jgt(asm_t::R4, asm_t::R3, pass);
+    a.load(BPF_H, asm_t::R5, asm_t::R2, 12); // eth type
+    a.jne32(asm_t::R5, htobe16(0x0800), pass);
+    a.load(BPF_B, asm_t::R5, asm_t::R2, 14); // ip version, ihl
+    a.jne32(asm_t::R5, 0x45, pass);
+    a.load(BPF_B, asm_t::R5, asm_t::R2, 23); // ip protocol
+    a.jne32(asm_t::R5, IPPROTO_UDP, pass);
+    a.load(BPF_H, asm_t::R5, asm_t::R2, 20); // ip fragment flags, offset
+    a.and32(asm_t::R5, htobe16(0x3fff));
+    a.jne32(asm_t::R5, 0, pass);
+    a.load(BPF_W, asm_t::R5, asm_t::R2, DstIpOffset);
+    a.load(BPF_H, asm_t::R7, asm_t::R2, DstPortOffset);
+    for (endpoint const& ep : filter) {
+        asm_t::label const next = a.make_label();
+        a.jne32(asm_t::R5, static_cast<std::int32_t>(ep.ip), next);
+        a.jne32(asm_t::R7, ep.port, next);
+        a.ja(redirect);
+        a.bind(next);
+    }
+    a.bind(pass);
+    a.mov(asm_t::R0, XDP_PASS);
+    a.exit();
+    a.bind(redirect);
+    a.load(BPF_W, asm_t::R2, asm_t::R6, offsetof(xdp_md, rx_queue_index));
+    a.load_map_fd(asm_t::R1, map_fd_);
+    a.mov(asm_t::R3, XDP_PASS); // if no xsk is bound to this queue
+    a.call(BPF_FUNC_redirect_map);
+    a.exit();
+    std::vector<bpf_insn> const prog = a.finish();
+
+    static char const license[] = "GPL";
+    attr = {};
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = reinterpret_cast<std::uintptr_t>(prog.data());
+    attr.insn_cnt = static_cast<std::uint32_t>(prog.size());
+    attr.license = reinterpret_cast<std::uintptr_t>(static_cast<char const*>(license));
+    prog_fd_ = sys_bpf(BPF_PROG_LOAD, attr);
+    if (prog_fd_ == -1) {
+        // Load again for the verifier's explanation
+        std::vector<char> log(64 * 1024);
+        attr.log_level = 1;
+        attr.log_buf = reinterpret_cast<std::uintptr_t>(log.data());
+        attr.log_size = static_cast<std::uint32_t>(log.size());
+        int const saved = errno;
+        sys_bpf(BPF_PROG_LOAD, attr);
+        errno = saved;
+        throw error(std::string("bpf(BPF_PROG_LOAD): ") + log.data());
+    }
+
+    // Attach through a bpf link so the program is detached when the
+    // link fd is closed, even if the process dies. Prefer the driver
+    // hook; fall back to the generic one.
+    for (std::uint32_t const flags : {0U, std::uint32_t{XDP_FLAGS_SKB_MODE}}) {
+        attr = {};
+        attr.link_create.prog_fd = static_cast<std::uint32_t>(prog_fd_);
+        attr.link_create.target_ifindex = static_cast<std::uint32_t>(ifindex);
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = flags;
+        link_fd_ = sys_bpf(BPF_LINK_CREATE, attr);
+        if (link_fd_ != -1) {
+            native_ = (flags == 0);
+            return;
+        }
+    }
+    throw error("bpf(BPF_LINK_CREATE)");
+}
+
+void
+xdp_receiver::wakeup_if_needed()
+{
+    if ((__atomic_load_n(fill_.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) != 0)
+        ::recvfrom(xsk_fd_, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+}
+
+bool
+xdp_receiver::statistics(xdp_statistics& stats) const
+{
+    socklen_t len = sizeof(stats);
+    return ::getsockopt(xsk_fd_, SOL_XDP, XDP_STATISTICS, &stats, &len) == 0;
+}
+
+void
+xdp_receiver::release()
+{
+    for (int* fd : {&link_fd_, &prog_fd_, &map_fd_}) {
+        if (*fd != -1)
+            ::close(*fd);
+        *fd = -1;
+    }
+    for (ring* r : {&rx_, &completion_, &fill_}) {
+        if (r->map != nullptr)
+            ::munmap(r->map, r->map_size);
+        *r = ring{};
+    }
+    if (xsk_fd_ != -1)
+        ::close(xsk_fd_);
+    xsk_fd_ = -1;
+    if (umem_ != nullptr)
+        ::munmap(umem_, umem_size_);
+    umem_ = nullptr;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <endian.h>       // be16toh
+#include <linux/if_xdp.h> // xdp_desc, xdp_statistics
+#include <algorithm>      // std::min
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcpy
+#include <string>
+#include <vector>
+
+
+/*  \class  xdp_receiver
+ *  \brief  AF_XDP receive path for one queue of an interface. A small
+ *          XDP program, assembled at run time, redirects ipv4/udp
+ *          packets addressed to any of the given (group, port) tuples
+ *          into an XSK socket and passes everything else to the
+ *          kernel as usual. Redirected packets land in a UMEM shared
+ *          with user space and are handed to the caller in place, so
+ *          the kernel udp stack is bypassed entirely. Built directly on
+ *          bpf(2) and AF_XDP (no libbpf/libxdp). Requires Linux 5.9 or
+ *          later and CAP_NET_ADMIN and CAP_BPF (or root).
+ */
+class xdp_receiver
+{
+public:
+    /// Both fields in network byte order
+    struct endpoint
+    {
+        std::uint32_t ip = 0;
+        std::uint16_t port = 0;
+    };
+
+    /// \throws std::exception If AF_XDP is unavailable or setup fails
+    xdp_receiver(std::string const& interface, unsigned queue, std::vector<endpoint> const& filter);
+    ~xdp_receiver();
+
+    // No copies/moves
+    xdp_receiver(xdp_receiver const&) = delete;
+    xdp_receiver(xdp_receiver&&) = delete;
+    xdp_receiver& operator=(xdp_receiver const&) = delete;
+    xdp_receiver&& operator=(xdp_receiver&&) = delete;
+
+    /// XSK socket; readable when packets are waiting
+    int
+    fd() const
+    {
+        return xsk_fd_;
+    }
+
+    /// \return \c true if the program runs in the driver rather than in
+    ///         the generic (skb) hook
+    bool
+    native_mode() const
+    {
+        return native_;
+    }
+
+    /// Invoke fn(endpoint, payload, len) on each waiting udp datagram,
+    /// at most max of them, then hand their frames back to the kernel.
+    /// Payloads are only valid during the call.
+    /// \return Num of datagrams processed
+    template <typename Fn>
+    std::size_t
+    receive(Fn&& fn, std::size_t max)
+    {
+        std::uint32_t const cons = *rx_.consumer;
+        std::uint32_t const avail = __atomic_load_n(rx_.producer, __ATOMIC_ACQUIRE) - cons;
+        auto const n = static_cast<std::uint32_t>(std::min<std::size_t>(avail, max));
+        if (n == 0)
+            return 0;
+
+        auto const* descs = static_cast<xdp_desc const*>(rx_.descs);
+        auto* fill = static_cast<std::uint64_t*>(fill_.descs);
+        std::uint32_t const fill_prod = *fill_.producer;
+        for (std::uint32_t i = 0; i < n; ++i) {
+            xdp_desc const& desc = descs[(cons + i) & rx_.mask];
+            char const* frame = umem_ + desc.addr;
+
+            // The filter only redirects option-less ipv4/udp, so the
+            // headers are at fixed offsets
+            endpoint dst;
+            std::uint16_t udp_len = 0;
+            std::memcpy(&dst.ip, frame + DstIpOffset, sizeof(dst.ip));
+            std::memcpy(&dst.port, frame + DstPortOffset, sizeof(dst.port));
+            std::memcpy(&udp_len, frame + UdpLenOffset, sizeof(udp_len));
+            std::size_t const len = std::min<std::size_t>(
+                    desc.len - HeadersSize, be16toh(udp_len) - UdpHeaderSize);
+            fn(dst, frame + HeadersSize, len);
+
+            // Frames are handed back whole, whatever offset the driver
+            // placed the packet at
+            fill[(fill_prod + i) & fill_.mask] = desc.addr & ~std::uint64_t{FrameSize - 1};
+        }
+
+        __atomic_store_n(rx_.consumer, cons + n, __ATOMIC_RELEASE);
+        __atomic_store_n(fill_.producer, fill_prod + n, __ATOMIC_RELEASE);
+        wakeup_if_needed();
+        return n;
+    }
+
+    /// Kernel drop counters
+    /// \return \c false on error
+    bool statistics(xdp_statistics& stats) const;
+
+private:
+    struct ring
+    {
+        std::uint32_t* producer = nullptr;
+        std::uint32_t* consumer = nullptr;
+        std::uint32_t* flags = nullptr;
+        void* descs = nullptr;
+        std::uint32_t mask = 0;
+        void* map = nullptr;
+        std::size_t map_size = 0;
+    };
+
+    void setup_socket(int ifindex, unsigned queue);
+    void load_program(int ifindex, unsigned queue, std::vector<endpoint> const& filter);
+    void wakeup_if_needed();
+
+    /// Detach, unmap and close everything
+    void release();
+
+private:
+    enum : std::uint32_t
+    {
+        NumFrames = 4096,    ///< num of umem frames (power of two)
+        FrameSize = 4096,    ///< bytes per frame (power of two)
+        CompletionSize = 64, ///< unused for rx, but required to bind
+        MaxQueues = 256,     ///< xskmap entries
+    };
+
+    enum : std::size_t
+    {
+        DstIpOffset = 30,   ///< eth 14 + offsetof(iphdr, daddr)
+        DstPortOffset = 36, ///< eth 14 + ip 20 + offsetof(udphdr, dest)
+        UdpLenOffset = 38,  ///< eth 14 + ip 20 + offsetof(udphdr, len)
+        UdpHeaderSize = 8,  ///< sizeof(udphdr)
+        HeadersSize = 42,   ///< eth + ip + udp
+    };
+
+    int xsk_fd_{-1};
+    int map_fd_{-1};
+    int prog_fd_{-1};
+    int link_fd_{-1};
+    bool native_{false};
+    char* umem_{nullptr};
+    std::size_t umem_size_{0};
+    ring fill_;
+    ring completion_;
+    ring rx_;
+};
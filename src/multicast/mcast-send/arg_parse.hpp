@@ -1,9 +1,13 @@
 #pragma once
 
+#include "mcast_send.hpp"
 #include "version.h"
 #include "util/compiler.hpp"
+#include "util/net_util.hpp"
 #include <getopt.h>
-#include <cstdlib> // std::exit
+#include <charconv> // std::from_chars
+#include <cstdlib>  // std::exit
+#include <cstring>  // std::strlen
 #include <filesystem>
 #include <print>
 #include <string>
@@ -15,6 +19,7 @@ struct cli_args
     std::string interface_name;
     std::string text;
     std::vector<std::string> groups;
+    publish_config publish;
 };
 
 
@@ -23,18 +28,37 @@ arg_parse(int argc, char** argv)
 {
     auto usage = [](std::FILE* outerr, std::filesystem::path const& app) {
         std::print(outerr,
-                "usage: {} [-hv] [-i <interface>] [-t <text>] <group> [[<group>] ...]\n"
+                "usage: {} [-ghqv] [-b <num>] [-i <interface>] [-n <num>] [-p <id>] [-r <rate>]\n"
+                "       [-s <size>] [-t <text>] <group> [[<group>] ...]\n"
                 "positional arguments:\n"
                 "  group                    multicast group in the for 'ip:port'\n"
                 "optional arguments:\n"
+                "  -b, --batch=<num>        max num of datagrams per sendmmsg call (default 32)\n"
+                "  -g, --gso                use udp segmentation offload if available, up to\n"
+                "                           64 datagrams per send; datagrams must fit the mtu\n"
+                "                           of the interface\n"
                 "  -h, --help               this output\n"
                 "  -i, --interface=<name>   network interface name (e.g., eno1, lo)\n"
+                "  -n, --count=<num>        num of datagrams per group, 0 for unlimited\n"
+                "                           (default 1)\n"
+                "  -p, --publisher=<id>     publisher id written to headers (default 0)\n"
+                "  -q, --sequenced          prefix each datagram with a header carrying\n"
+                "                           publisher id, sequence num and send time\n"
+                "  -r, --rate=<num>         datagrams/sec per group, 0 for unpaced (default 0)\n"
+                "  -s, --size=<bytes>       datagram size, text is repeated to fill\n"
+                "                           (default size of text)\n"
                 "  -t, --text=<text>        text to send\n"
                 "  -v, --version            version\n",
                 app.c_str());
         std::exit(outerr == stdout ? EXIT_SUCCESS : EXIT_FAILURE);
     };
 
+    auto to_uint = [](char const* str, auto& value) {
+        char const* const end = str + std::strlen(str);
+        auto [ptr, ec] = std::from_chars(str, end, value);
+        return ec == std::errc() && ptr == end;
+    };
+
     auto const app = std::filesystem::path(argv[0]).filename();
     if (argc == 1)
         usage(stderr, app);
@@ -42,19 +66,38 @@ arg_parse(int argc, char** argv)
     cli_args args;
     while (true) {
         static constexpr option long_options[] = {
+                {"batch", required_argument, nullptr, 'b'},
+                {"count", required_argument, nullptr, 'n'},
+                {"gso", no_argument, nullptr, 'g'},
                 {"help", no_argument, nullptr, 'h'},
-                {"interface", no_argument, nullptr, 'i'},
-                {"text", no_argument, nullptr, 'i'},
-                {"version", no_argument, nullptr, 't'},
+                {"interface", required_argument, nullptr, 'i'},
+                {"publisher", required_argument, nullptr, 'p'},
+                {"rate", required_argument, nullptr, 'r'},
+                {"sequenced", no_argument, nullptr, 'q'},
+                {"size", required_argument, nullptr, 's'},
+                {"text", required_argument, nullptr, 't'},
+                {"version", no_argument, nullptr, 'v'},
                 {nullptr, 0, nullptr, 0},
         };
 
         int const c = ::getopt_long(
-                argc, argv, "hi:t:v", static_cast<option const*>(long_options), nullptr);
+                argc, argv, "b:ghi:n:p:qr:s:t:v", static_cast<option const*>(long_options), nullptr);
         if (c == -1)
             break;
 
         switch (c) {
+            case 'b':
+                if (!to_uint(optarg, args.publish.batch) || args.publish.batch == 0
+                        || args.publish.batch > UIO_MAXIOV) {
+                    std::println(stderr, "invalid batch size: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'g':
+                args.publish.gso = true;
+                break;
+
             case 'h':
                 usage(stdout, app);
                 break;
@@ -63,6 +106,38 @@ arg_parse(int argc, char** argv)
                 args.interface_name = optarg;
                 break;
 
+            case 'n':
+                if (!to_uint(optarg, args.publish.count)) {
+                    std::println(stderr, "invalid count: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'p':
+                if (!to_uint(optarg, args.publish.publisher_id)) {
+                    std::println(stderr, "invalid publisher id: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'q':
+                args.publish.sequenced = true;
+                break;
+
+            case 'r':
+                if (!to_uint(optarg, args.publish.rate)) {
+                    std::println(stderr, "invalid rate: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 's':
+                if (!to_uint(optarg, args.publish.size)) {
+                    std::println(stderr, "invalid size: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
             case 't':
                 args.text = optarg;
                 break;
@@ -90,5 +165,18 @@ arg_parse(int argc, char** argv)
         ++optind;
     }
 
+    // The kernel fails a gso send whose segments don't each fit the
+    // mtu, and multicast has no path mtu discovery to lower it. The
+    // num of segments per send is capped at MaxGsoSegments when sending.
+    if (args.publish.gso) {
+        std::size_t const size = datagram_size(args.text, args.publish);
+        int const mtu = net::interface_mtu(args.interface_name);
+        if (mtu > 0 && size + mcast_send::HeadersSize > static_cast<std::size_t>(mtu)) {
+            std::println(stderr, "--gso needs datagrams of at most {} bytes to fit the mtu of {}",
+                    static_cast<std::size_t>(mtu) - mcast_send::HeadersSize, args.interface_name);
+            usage(stderr, app);
+        }
+    }
+
     return args;
 }
@@ -1,5 +1,6 @@
 #include "arg_parse.hpp"
 #include "mcast_send.hpp"
+#include "util/logger.hpp"
 #include <cstdio> // std::fprintf
 #include <cstdlib> // EXIT_FAILURE, EXIT_SUCCESS
 
@@ -14,7 +15,8 @@ main(int argc, char* argv[])
             return EXIT_FAILURE;
         }
 
-        mcast_send app(args.interface_name, args.groups, args.text);
+        util::logger::instance().add_thread();
+        mcast_send app(args.interface_name, args.groups, args.text, args.publish);
         return app.run();
     } catch (std::exception const& e) {
         std::fprintf(stderr, "error: %s\n", e.what());
@@ -1,26 +1,51 @@
 #include "mcast_send.hpp"
+#include "multicast/wire_format.hpp"
+#include "util/logger.hpp"
 #include "util/net_util.hpp"
 #include <arpa/inet.h>
 #include <endian.h>
 #include <net/if.h> // IFNAMSIZ
 #include <netinet/in.h>
+#include <netinet/udp.h> // UDP_SEGMENT
 #include <sys/ioctl.h>
-#include <sys/socket.h> // ::recvmsg, ::setsockopt, ::socket
+#include <sys/socket.h> // ::connect, ::sendmmsg, ::setsockopt, ::socket
 #include <sys/types.h>
-#include <unistd.h> // ::close
+#include <unistd.h>  // ::close
+#include <algorithm> // std::max, std::min
 #include <cerrno>
-#include <cstring> // std::strerror
+#include <chrono>
+#include <cstring> // std::memcpy, std::strerror
+#include <ctime>   // ::clock_gettime
 #include <print>
 #include <stdexcept>
-#include <tuple>
+#include <string>
+#include <thread> // std::this_thread::sleep_until
 
 
-mcast_send::mcast_send(
-        std::string const& interface_name, std::vector<std::string> const& groups, std::string text)
+std::size_t
+datagram_size(std::string const& text, publish_config const& config)
+{
+    std::size_t const size = config.size != 0 ? config.size : text.size();
+    return config.sequenced ? std::max(size, sizeof(wire::header)) : size;
+}
+
+mcast_send::mcast_send(std::string const& interface_name,
+        std::vector<std::string> const& groups, std::string text, publish_config const& config)
         : groups_()
         , interface_ip_()
+        , interface_addr_()
         , text_(std::move(text))
+        , config_(config)
+        , size_(datagram_size(text_, config))
+        , payload_()
+        , iovs_(config.batch)
+        , msgs_(config.batch)
 {
+    if (size_ > MaxDatagramSize)
+        throw std::runtime_error("datagram size exceeds " + std::to_string(MaxDatagramSize));
+    if (config_.batch == 0)
+        throw std::runtime_error("batch size must be at least 1");
+
     // Need a socket to get interface ip from name
     int const tmp_sock = ::socket(AF_INET, SOCK_DGRAM, 0);
     if (tmp_sock == -1)
@@ -40,13 +65,41 @@ mcast_send::mcast_send(
     // Convert/validate all requested groups
     groups_.reserve(groups.size());
     for (auto const& g : groups) {
-        auto [ip, port] = net::parse_ip_port(g);
-        if (ip.empty() || port == 0)
-            throw std::runtime_error("invalid group: " + g);
-        groups_.emplace_back(multicast_group{-1, ip, port});
+        auto const addr = net::parse_ip_port(g);
+        if (!addr || addr->family != AF_INET || addr->port == 0)
+            throw std::runtime_error("invalid group (expected ipv4 'ip:port'): " + g);
+        groups_.emplace_back().addr = *addr;
+    }
+
+    // With gso, each sendmmsg entry carries several datagrams that the
+    // kernel (or nic) splits at size_ boundaries. A super-packet must
+    // still fit in one ip datagram.
+    if (config_.gso && size_ != 0) {
+        gso_segments_ = std::min({MaxGsoSegments, MaxDatagramSize / size_,
+                static_cast<std::size_t>(config_.batch)});
+    }
+
+    // Datagram is text repeated to fill size_ (after the header, if
+    // sequenced). Unsequenced datagrams are identical, so only enough
+    // copies for one gso super-packet are needed; sequenced ones each
+    // get their own copy with its own header.
+    std::size_t const copies = config_.sequenced ? config_.batch : gso_segments_;
+    std::size_t const text_offset = config_.sequenced ? sizeof(wire::header) : 0;
+    payload_.resize(size_ * copies);
+    for (std::size_t i = text_offset; i < size_; ++i)
+        payload_[i] = text_.empty() ? '\0' : text_[(i - text_offset) % text_.size()];
+    for (std::size_t copy = 1; copy < copies; ++copy)
+        std::memcpy(payload_.data() + copy * size_, payload_.data(), size_);
+
+    for (std::size_t i = 0; i < msgs_.size(); ++i) {
+        iovs_[i].iov_base = payload_.data();
+        msgs_[i] = {};
+        msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
     }
 
-    interface_ip_ = ::inet_ntoa(reinterpret_cast<sockaddr_in*>(&req.ifr_addr)->sin_addr); // NOLINT
+    interface_addr_ = reinterpret_cast<sockaddr_in*>(&req.ifr_addr)->sin_addr; // NOLINT
+    interface_ip_ = ::inet_ntoa(interface_addr_);
     std::println("sending on interface {} ({})", interface_name, interface_ip_);
 }
 
@@ -62,29 +115,132 @@ mcast_send::run()
         }
 
         // Set sending interface
-        in_addr iface = {};
-        iface.s_addr = ::inet_addr(interface_ip_.c_str());
-        int rv = ::setsockopt(group.sock, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface));
+        int rv = ::setsockopt(group.sock, IPPROTO_IP, IP_MULTICAST_IF, &interface_addr_,
+                sizeof(interface_addr_));
         if (rv == -1) {
             std::println(stderr, "error: setsockopt(IP_MULTICAST_IF): {}", std::strerror(errno));
             return 1;
         }
     }
 
+    std::size_t gso_segments = gso_segments_;
     for (auto const& group : groups_) {
-        // Set target address
-        sockaddr_in addr = {};
-        addr.sin_family = AF_INET;
-        addr.sin_port = htobe16(group.port);
-        addr.sin_addr.s_addr = ::inet_addr(group.ip.c_str());
-
-        ::ssize_t const nbytes = ::sendto(group.sock, text_.c_str(), text_.size(),
-                /*flag=*/0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)); // NOLINT
-        if (nbytes == -1) {
-            std::println(stderr, "error: sendto: {}", std::strerror(errno));
+        // Set target address once so sendmmsg entries need no msg_name
+        sockaddr_storage addr = {};
+        socklen_t const addrlen = group.addr.to_sockaddr(addr);
+        int rv = ::connect(group.sock, reinterpret_cast<sockaddr*>(&addr), addrlen);
+        if (rv == -1) {
+            std::println(stderr, "error: connect: {}", std::strerror(errno));
             return 1;
         }
+
+        if (gso_segments_ > 1) {
+            int const segment_size = static_cast<int>(size_);
+            rv = ::setsockopt(
+                    group.sock, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size));
+            if (rv == -1) {
+                std::println(stderr, "warning: setsockopt(UDP_SEGMENT): {}, gso disabled",
+                        std::strerror(errno));
+                gso_segments = 1;
+            }
+        }
+    }
+    gso_segments_ = gso_segments;
+
+    using clock = std::chrono::steady_clock;
+    using seconds = std::chrono::duration<double>;
+
+    auto report = [this](std::uint64_t sent, std::uint64_t count, clock::duration elapsed) {
+        double const secs = seconds(elapsed).count();
+        double const msgs = static_cast<double>(count * groups_.size());
+        std::println("sent {} datagrams to each of {} group(s): {:.0f} msgs/sec, {:.1f} Mbps", sent,
+                groups_.size(), msgs / secs, msgs * static_cast<double>(size_) * 8 / secs / 1e6);
+    };
+
+    double const interval = config_.rate != 0 ? 1.0 / static_cast<double>(config_.rate) : 0.0;
+    auto const start = clock::now();
+    auto last_report = start;
+    std::uint64_t sent = 0; // num of datagrams sent to each group
+    std::uint64_t last_sent = 0;
+
+    while (config_.count == 0 || sent < config_.count) {
+        std::uint64_t due = config_.batch;
+        if (config_.count != 0)
+            due = std::min(due, config_.count - sent);
+
+        // Pace against the schedule since start rather than the last
+        // send, so oversleeping is made up for (in bursts of at most
+        // batch) instead of lowering the rate.
+        if (config_.rate != 0) {
+            auto const target = static_cast<std::uint64_t>(
+                    seconds(clock::now() - start).count() * static_cast<double>(config_.rate));
+            if (target <= sent) {
+                std::this_thread::sleep_until(start
+                        + std::chrono::duration_cast<clock::duration>(
+                                seconds(static_cast<double>(sent + 1) * interval)));
+                continue;
+            }
+            due = std::min(due, target - sent);
+        }
+
+        for (auto& group : groups_) {
+            if (!send_batch(group, due))
+                return 1;
+        }
+        sent += due;
+
+        if (config_.count != 1) {
+            auto const now = clock::now();
+            if (now - last_report >= std::chrono::seconds(1)) {
+                report(sent, sent - last_sent, now - last_report);
+                last_report = now;
+                last_sent = sent;
+            }
+        }
     }
 
+    if (config_.count != 1)
+        report(sent, sent, clock::now() - start);
+
     return 0;
 }
+
+bool
+mcast_send::send_batch(multicast_group& group, std::size_t n)
+{
+    // Each datagram is stamped as it is filled rather than once per
+    // batch, so a receiver's one-way latency doesn't charge the later
+    // datagrams of a batch with the time spent filling the earlier ones
+    if (config_.sequenced) {
+        for (std::size_t i = 0; i < n; ++i) {
+            timespec now{};
+            ::clock_gettime(CLOCK_REALTIME, &now);
+            auto const send_time = static_cast<std::uint64_t>(now.tv_sec) * 1'000'000'000UL
+                    + static_cast<std::uint64_t>(now.tv_nsec);
+            wire::encode(payload_.data() + i * size_, config_.publisher_id, group.seq++, send_time);
+        }
+    }
+
+    std::size_t nmsgs = 0;
+    for (std::size_t first = 0; first < n; ++nmsgs) {
+        std::size_t const segments = std::min(n - first, gso_segments_);
+        iovs_[nmsgs].iov_base = payload_.data() + (config_.sequenced ? first * size_ : 0);
+        iovs_[nmsgs].iov_len = segments * size_;
+        first += segments;
+    }
+
+    std::size_t done = 0;
+    while (done < nmsgs) {
+        int const rv
+                = ::sendmmsg(group.sock, &msgs_[done], static_cast<unsigned>(nmsgs - done), 0);
+        if (rv == -1) {
+            if (errno == EINTR)
+                continue;
+            util::log_error("error: sendmmsg: {}", std::strerror(errno));
+            return false;
+        }
+        done += static_cast<std::size_t>(rv);
+    }
+
+    return true;
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "util/net_util.hpp"
+#include <netinet/in.h> // in_addr
+#include <sys/socket.h> // mmsghdr
+#include <sys/uio.h>    // iovec
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -8,19 +13,52 @@
 struct multicast_group
 {
     int sock = -1;
-    std::string ip = "";
-    std::uint16_t port = 0;
+    net::endpoint addr;    ///< ipv4 group and port
+    std::uint64_t seq = 0; ///< next sequence number, if sequenced
 };
 
+/// Publisher settings. The defaults send text once to each group.
+struct publish_config
+{
+    std::size_t size = 0;    ///< datagram size, 0 for size of text
+    std::uint64_t count = 1; ///< num of datagrams per group, 0 for unlimited
+    std::uint64_t rate = 0;  ///< datagrams/sec per group, 0 for unpaced
+    unsigned batch = 32;     ///< max num of datagrams per group per syscall
+    bool gso = false;        ///< use udp segmentation offload if available
+    bool sequenced = false;  ///< prefix each datagram with a wire::header
+    std::uint16_t publisher_id = 0;
+};
+
+/// \return Size of each datagram sending text with config
+std::size_t datagram_size(std::string const& text, publish_config const& config);
+
 class mcast_send final
 {
 public:
+    static constexpr std::size_t MaxDatagramSize = 65507; ///< max udp payload over ipv4
+    static constexpr std::size_t MaxGsoSegments = 64;     ///< UDP_MAX_SEGMENTS
+    static constexpr std::size_t HeadersSize = 28;        ///< ipv4 and udp, without options
+
     mcast_send(std::string const& interface_name, std::vector<std::string> const& groups,
-            std::string text);
+            std::string text, publish_config const& config = {});
     int run();
 
+private:
+    /// Send n datagrams to group with as few sendmmsg calls as
+    /// possible, first stamping each header, if sequenced, with the
+    /// time it was filled
+    /// \return \c false on error
+    bool send_batch(multicast_group& group, std::size_t n);
+
 private:
     std::vector<multicast_group> groups_;
     std::string interface_ip_;
+    in_addr interface_addr_{}; ///< interface_ip_, for socket options
     std::string const text_;
+    publish_config const config_;
+    std::size_t size_{0};         ///< datagram size
+    std::size_t gso_segments_{1}; ///< num of datagrams per sendmmsg entry
+    std::vector<char> payload_;   ///< back-to-back copies of the datagram
+    std::vector<iovec> iovs_;     ///< iovs_[i] covers some of payload_
+    std::vector<mmsghdr> msgs_;   ///< msgs_[i] gathers iovs_[i]
 };
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "util/compiler.hpp"
+#include <endian.h> // htole16, htole32, htole64, le16toh, le32toh, le64toh
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcpy
+
+
+/// Header that mcast-send can put at the front of each datagram so
+/// mcast-recv can detect loss, duplication and reordering and measure
+/// one-way latency. All fields are little-endian on the wire.
+namespace wire {
+    constexpr std::uint32_t Magic = 0x5453434d; ///< "MCST"
+    constexpr std::uint8_t Version = 1;
+
+    struct PACKED header
+    {
+        std::uint32_t magic;
+        std::uint8_t version;
+        std::uint8_t flags;           ///< reserved, 0
+        std::uint16_t publisher_id;   ///< distinguishes senders to the same group
+        std::uint64_t seq;            ///< per publisher and group, starting at 0
+        std::uint64_t send_time_nsec; ///< CLOCK_REALTIME at send
+    };
+    static_assert(sizeof(header) == 24);
+
+    /// Write a header to the front of buf, which must have room for
+    /// sizeof(header) bytes
+    inline void
+    encode(void* buf, std::uint16_t publisher_id, std::uint64_t seq, std::uint64_t send_time_nsec)
+    {
+        header const hdr{
+                .magic = htole32(Magic),
+                .version = Version,
+                .flags = 0,
+                .publisher_id = htole16(publisher_id),
+                .seq = htole64(seq),
+                .send_time_nsec = htole64(send_time_nsec),
+        };
+        std::memcpy(buf, &hdr, sizeof(hdr));
+    }
+
+    /// Read the header from the front of a datagram
+    /// \return \c false if the datagram doesn't start with a header
+    inline bool
+    decode(void const* buf, std::size_t len, header& hdr)
+    {
+        if (len < sizeof(header))
+            return false;
+
+        std::memcpy(&hdr, buf, sizeof(hdr));
+        if (le32toh(hdr.magic) != Magic || hdr.version != Version)
+            return false;
+
+        hdr.magic = Magic;
+        hdr.publisher_id = le16toh(hdr.publisher_id);
+        hdr.seq = le64toh(hdr.seq);
+        hdr.send_time_nsec = le64toh(hdr.send_time_nsec);
+        return true;
+    }
+
+} // namespace wire
@@ -0,0 +1,61 @@
+#!/bin/sh
+
+# Sends a sequenced multicast feed from mcast-send to mcast-recv --xdp
+# across a veth pair, each end in its own network namespace, and checks
+# that every datagram arrived. Needs root (namespaces, XDP attach).
+# Returns 1 if mcast-recv missed or didn't report any datagram
+# Returns 0 otherwise
+
+# usage: xdp-veth-test.sh [<bin dir>] [<num datagrams>]
+#        bin dir defaults to the tree's bin directory
+
+bin_dir=${1:-$(dirname "$0")/../../bin}
+count=${2:-100000}
+rate=100000
+
+tx_ns=mcast-tx
+rx_ns=mcast-rx
+group=239.1.1.1:5000
+output=$(mktemp)
+
+cleanup() {
+    ip netns pids ${rx_ns} 2>/dev/null | xargs -r kill 2>/dev/null
+    ip netns del ${tx_ns} 2>/dev/null
+    ip netns del ${rx_ns} 2>/dev/null
+    rm -f "${output}"
+}
+trap cleanup EXIT
+
+set -e
+ip netns add ${tx_ns}
+ip netns add ${rx_ns}
+ip link add veth-tx netns ${tx_ns} type veth peer name veth-rx netns ${rx_ns}
+
+ip -n ${tx_ns} addr add 10.99.0.1/24 dev veth-tx
+ip -n ${rx_ns} addr add 10.99.0.2/24 dev veth-rx
+ip -n ${tx_ns} link set veth-tx up
+ip -n ${rx_ns} link set veth-rx up
+ip -n ${tx_ns} route add 224.0.0.0/4 dev veth-tx
+ip -n ${rx_ns} route add 224.0.0.0/4 dev veth-rx
+
+# The receiver reports once a second; give it time to print the last one
+ip netns exec ${rx_ns} timeout $((count / rate + 4)) stdbuf -oL \
+    "${bin_dir}/mcast-recv" -i veth-rx -x ${group} > "${output}" 2>&1 &
+sleep 1
+ip netns exec ${tx_ns} "${bin_dir}/mcast-send" -i veth-tx -q -n "${count}" -r ${rate} ${group} \
+    > /dev/null
+wait || true
+set +e
+
+cat "${output}"
+if ! grep -q "^af_xdp attached" "${output}"; then
+    echo "error: af_xdp not attached" >&2
+    exit 1
+fi
+
+# Each report carries the cumulative count; the last one must have them all
+last=$(grep "publisher=" "${output}" | tail -n 1)
+case ${last} in
+    *"received=${count} missing=0 "*) exit 0 ;;
+    *) echo "error: expected received=${count} missing=0" >&2; exit 1 ;;
+esac
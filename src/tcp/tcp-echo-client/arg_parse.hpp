@@ -0,0 +1,173 @@
+#pragma once
+
+#include "tcp_echo_client.hpp"
+#include "version.h"
+#include "util/compiler.hpp"
+#include "util/net_util.hpp"
+#include "util/thread_util.hpp"
+#include <getopt.h>
+#include <charconv> // std::from_chars
+#include <chrono>
+#include <cstdint>
+#include <cstdio>  // std::FILE
+#include <cstdlib> // std::exit
+#include <cstring> // std::strlen
+#include <filesystem>
+#include <print>
+#include <vector>
+
+
+struct cli_args
+{
+    net::endpoint server = *net::parse_ip_port("127.0.0.1:42483");
+    int connections = 1;
+    int threads = 1;
+    std::vector<int> cpus;
+    client_config config;
+};
+
+
+inline cli_args
+arg_parse(int argc, char** argv)
+{
+    auto usage = [](std::FILE* outerr, std::filesystem::path const& app) {
+        std::print(outerr,
+                "usage: {} [-hv] [-c <cpus>] [-d <secs>] [-n <num>] [-r <rate>] [-s <size>]\n"
+                "       [-t <threads>] [<server>]\n"
+                "positional arguments:\n"
+                "  server                   echo server in the form 'ip:port' or '[ipv6]:port'\n"
+                "                           (default 127.0.0.1:42483)\n"
+                "optional arguments:\n"
+                "  -c, --cpus=<list>        pin thread n to the n-th cpu in list (e.g., 0,2-4)\n"
+                "  -d, --duration=<secs>    num of seconds to send for (default 10)\n"
+                "  -h, --help               this output\n"
+                "  -n, --connections=<num>  num of connections, spread over the threads\n"
+                "                           (default 1)\n"
+                "  -r, --rate=<num>         open loop: msgs/sec per connection, sent on\n"
+                "                           schedule whether or not echoes have returned;\n"
+                "                           0 for closed loop, one message in flight per\n"
+                "                           connection (default 0)\n"
+                "  -s, --size=<bytes>       message size (default 64)\n"
+                "  -t, --threads=<num>      num of threads, each with its own epoll loop\n"
+                "                           (default 1)\n"
+                "  -v, --version            version\n",
+                app.c_str());
+        std::exit(outerr == stdout ? EXIT_SUCCESS : EXIT_FAILURE);
+    };
+
+    auto to_uint = [](char const* str, auto& value) {
+        char const* const end = str + std::strlen(str);
+        auto [ptr, ec] = std::from_chars(str, end, value);
+        return ec == std::errc() && ptr == end;
+    };
+
+    auto const app = std::filesystem::path(argv[0]).filename();
+
+    cli_args args;
+    while (true) {
+        static constexpr option long_options[] = {
+                {"connections", required_argument, nullptr, 'n'},
+                {"cpus", required_argument, nullptr, 'c'},
+                {"duration", required_argument, nullptr, 'd'},
+                {"help", no_argument, nullptr, 'h'},
+                {"rate", required_argument, nullptr, 'r'},
+                {"size", required_argument, nullptr, 's'},
+                {"threads", required_argument, nullptr, 't'},
+                {"version", no_argument, nullptr, 'v'},
+                {nullptr, 0, nullptr, 0},
+        };
+
+        int const c = ::getopt_long(
+                argc, argv, "c:d:hn:r:s:t:v", static_cast<option const*>(long_options), nullptr);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'c':
+                args.cpus = util::parse_cpu_list(optarg);
+                if (args.cpus.empty()) {
+                    std::println(stderr, "invalid cpu list: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'd': {
+                unsigned secs = 0;
+                if (!to_uint(optarg, secs) || secs == 0) {
+                    std::println(stderr, "invalid duration: {}", optarg);
+                    usage(stderr, app);
+                }
+                args.config.duration = std::chrono::seconds(secs);
+            } break;
+
+            case 'h':
+                usage(stdout, app);
+                break;
+
+            case 'n':
+                if (!to_uint(optarg, args.connections) || args.connections <= 0) {
+                    std::println(stderr, "invalid number of connections: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'r':
+                if (!to_uint(optarg, args.config.rate)) {
+                    std::println(stderr, "invalid rate: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 's':
+                if (!to_uint(optarg, args.config.size) || args.config.size == 0) {
+                    std::println(stderr, "invalid size: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 't':
+                if (!to_uint(optarg, args.threads) || args.threads <= 0) {
+                    std::println(stderr, "invalid number of threads: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'v':
+                std::println("app_version={}\n{}", ::VERSION, get_version_info_multiline());
+                std::exit(EXIT_SUCCESS);
+                break;
+
+            case '?':
+            default:
+                usage(stderr, app);
+                break;
+        }
+    } // while
+
+    if (optind < argc) {
+        auto const server = net::parse_ip_port(argv[optind]);
+        if (!server || server->port == 0) {
+            std::println(stderr, "invalid server: {}\n", argv[optind]);
+            usage(stderr, app);
+        }
+        args.server = *server;
+        ++optind;
+    }
+
+    if (optind != argc) {
+        std::println(stderr, "unexpected argument: {}\n", argv[optind]);
+        usage(stderr, app);
+    }
+
+    if (args.connections < args.threads) {
+        std::println(stderr, "need at least one connection per thread\n");
+        usage(stderr, app);
+    }
+
+    if (!args.cpus.empty() && args.cpus.size() < static_cast<std::size_t>(args.threads)) {
+        std::println(stderr, "cpu list must contain at least one cpu per thread\n");
+        usage(stderr, app);
+    }
+
+    return args;
+}
@@ -0,0 +1,136 @@
+#include "arg_parse.hpp"
+#include "tcp_echo_client.hpp"
+#include "util/histogram.hpp"
+#include "util/logger.hpp"
+#include "util/stats.hpp"
+#include "util/thread_util.hpp"
+#include <algorithm> // std::max
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>    // std::fprintf
+#include <cstdlib>   // EXIT_FAILURE, EXIT_SUCCESS
+#include <exception>
+#include <print>
+#include <thread>
+#include <vector>
+
+
+namespace {
+    struct thread_result
+    {
+        util::histogram rtt;                 ///< round-trip times in nanoseconds
+        std::uint64_t incomplete{0};         ///< messages not echoed by the end
+        std::chrono::nanoseconds elapsed{0}; ///< measured length of the run
+    };
+
+    /// Each thread owns its connections and event loop, so there is no
+    /// state shared between threads until the results are merged.
+    /// \return \c false on error
+    bool
+    run_thread(cli_args const& args, int id, util::stats_reporter& reporter, thread_result& result)
+    {
+        try {
+            if (!args.cpus.empty())
+                util::pin_thread(args.cpus[static_cast<std::size_t>(id)]);
+
+            // Spread the connections as evenly as possible
+            int const connections
+                    = args.connections / args.threads + (id < args.connections % args.threads);
+
+            util::stat_counters& stats = reporter.add_thread();
+            util::logger::instance().add_thread();
+
+            tcp_echo_client client(args.server, connections, args.config, stats);
+            bool const ok = client.run();
+            result.rtt.merge(client.rtt());
+            result.incomplete = client.incomplete();
+            result.elapsed = client.elapsed();
+            if (!ok) {
+                std::fprintf(stderr, "error: thread %d: client shutdown with an error\n", id);
+                return false;
+            }
+        } catch (std::exception const& e) {
+            std::fprintf(stderr, "error: thread %d: exception: %s\n", id, e.what());
+            return false;
+        } catch (...) {
+            std::fprintf(stderr, "error: thread %d: exception: ???\n", id);
+            return false;
+        }
+
+        return true;
+    }
+
+    void
+    report(cli_args const& args, std::vector<thread_result> const& results)
+    {
+        // Threads run side by side, so the longest covers them all
+        util::histogram rtt;
+        std::uint64_t incomplete = 0;
+        std::chrono::nanoseconds elapsed{0};
+        for (auto const& result : results) {
+            rtt.merge(result.rtt);
+            incomplete += result.incomplete;
+            elapsed = std::max(elapsed, result.elapsed);
+        }
+
+        if (args.config.rate == 0) {
+            std::println("{} connection(s) over {} thread(s), {} byte messages, closed loop",
+                    args.connections, args.threads, args.config.size);
+        } else {
+            std::println("{} connection(s) over {} thread(s), {} byte messages, open loop at "
+                         "{} msgs/s per connection",
+                    args.connections, args.threads, args.config.size, args.config.rate);
+        }
+
+        double const secs = std::chrono::duration<double>(elapsed).count();
+        double const msgs = static_cast<double>(rtt.count());
+        std::println("msgs={} msgs/s={:.0f} MB/s={:.2f} incomplete={}", rtt.count(), msgs / secs,
+                msgs * static_cast<double>(args.config.size) / secs / 1e6, incomplete);
+
+        if (rtt.count() != 0) {
+            std::println("rtt(ns) n={} min={} p50={} p90={} p99={} p99.9={} p99.99={} max={} "
+                         "mean={:.0f}",
+                    rtt.count(), rtt.min(), rtt.percentile(50), rtt.percentile(90),
+                    rtt.percentile(99), rtt.percentile(99.9), rtt.percentile(99.99), rtt.max(),
+                    rtt.mean());
+        }
+    }
+
+} // namespace
+
+
+int
+main(int argc, char** argv)
+{
+    try {
+        cli_args const args = arg_parse(argc, argv);
+
+        std::atomic<bool> failed = false;
+        std::vector<thread_result> results(static_cast<std::size_t>(args.threads));
+        util::stats_reporter reporter("tcp-echo-client");
+        util::logger::instance(); // start its thread before the others pin themselves
+        {
+            std::vector<std::jthread> threads;
+            threads.reserve(static_cast<std::size_t>(args.threads));
+            for (int id = 0; id < args.threads; ++id) {
+                threads.emplace_back([&args, &failed, &reporter, &results, id] {
+                    if (!run_thread(args, id, reporter, results[static_cast<std::size_t>(id)]))
+                        failed = true;
+                });
+            }
+        } // join all threads
+
+        if (failed)
+            return EXIT_FAILURE;
+        report(args, results);
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "error: exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    } catch (...) {
+        std::fprintf(stderr, "error: exception: ???\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
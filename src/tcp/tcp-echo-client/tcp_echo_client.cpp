@@ -0,0 +1,300 @@
+#include "tcp_echo_client.hpp"
+#include "util/logger.hpp"
+#include <fcntl.h>       // ::fcntl, O_NONBLOCK
+#include <netinet/in.h>  // IPPROTO_TCP
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <sys/epoll.h>
+#include <sys/socket.h> // socket calls
+#include <unistd.h>     // ::close
+#include <algorithm>    // std::max, std::min
+#include <cerrno>
+#include <cstring>   // std::strerror
+#include <ctime>     // timespec
+#include <stdexcept> // std::runtime_error
+#include <string>
+
+
+tcp_echo_client::tcp_echo_client(net::endpoint const& server, int connections,
+        client_config const& config, util::stat_counters& stats)
+        : config_(config)
+        , stats_(stats)
+        , conns_(static_cast<std::size_t>(connections))
+        , payload_()
+        , in_buf_(IncomingBufferSizeBytes)
+        , start_()
+        , rtt_()
+{
+    if (config_.size == 0)
+        throw std::runtime_error("message size must be non-zero");
+
+    // Enough copies of the message to fill one send call
+    std::size_t const copies = std::max<std::size_t>(1, MaxSendBytes / config_.size);
+    payload_.resize(copies * config_.size);
+    for (std::size_t i = 0; i < payload_.size(); ++i)
+        payload_[i] = static_cast<char>('a' + i % config_.size % 26);
+
+    sockaddr_storage addr{};
+    socklen_t const addrlen = server.to_sockaddr(addr);
+
+    auto fail = [this](char const* what) {
+        int const error = errno;
+        for (auto const& conn : conns_) {
+            if (conn.fd != -1)
+                ::close(conn.fd);
+        }
+        if (epollfd_ != -1)
+            ::close(epollfd_);
+        throw std::runtime_error(std::string(what) + ": " + std::strerror(error));
+    };
+
+    epollfd_ = ::epoll_create1(0);
+    if (epollfd_ == -1)
+        fail("epoll_create1");
+
+    // Connect while still blocking, then switch to non-blocking i/o
+    for (std::size_t i = 0; i < conns_.size(); ++i) {
+        connection& conn = conns_[i];
+        conn.fd = ::socket(server.family, SOCK_STREAM, 0);
+        if (conn.fd == -1)
+            fail("socket");
+
+        if (::connect(conn.fd, reinterpret_cast<sockaddr const*>(&addr), addrlen) == -1)
+            fail("connect");
+
+        int const on = 1;
+        if (::setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == -1)
+            fail("setsockopt(TCP_NODELAY)");
+
+        if (::fcntl(conn.fd, F_SETFL, ::fcntl(conn.fd, F_GETFL) | O_NONBLOCK) == -1)
+            fail("fcntl");
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        if (::epoll_ctl(epollfd_, EPOLL_CTL_ADD, conn.fd, &event) == -1)
+            fail("epoll_ctl");
+
+        // Spread this client's connections evenly over one interval
+        if (config_.rate != 0)
+            conn.phase_nsec = i * 1'000'000'000UL / config_.rate / conns_.size();
+    }
+}
+
+
+tcp_echo_client::~tcp_echo_client()
+{
+    ::close(epollfd_);
+    for (auto const& conn : conns_)
+        ::close(conn.fd);
+}
+
+
+bool
+tcp_echo_client::run()
+{
+    bool const open_loop = config_.rate != 0;
+    end_nsec_ = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(config_.duration).count());
+    std::uint64_t const drain_end_nsec = end_nsec_ + DrainTimeoutMsecs * 1'000'000UL;
+
+    start_ = std::chrono::steady_clock::now();
+    if (!open_loop) {
+        for (auto& conn : conns_) {
+            schedule_one(conn, elapsed_nsec());
+            if (!flush(conn))
+                return false;
+        }
+    }
+
+    epoll_event events[EpollMaxEvents];
+    for (;;) {
+        std::uint64_t now = elapsed_nsec();
+
+        // Once sending stops, only wait for what is still outstanding,
+        // so a closed loop's last message per connection isn't counted
+        // as incomplete
+        bool const draining = now >= end_nsec_;
+        if (draining && (now >= drain_end_nsec || incomplete() == 0))
+            break;
+
+        // Sleep until the next message is due or the run ends
+        std::uint64_t wake = draining ? drain_end_nsec : end_nsec_;
+        if (open_loop && !draining) {
+            for (auto& conn : conns_) {
+                schedule(conn, now);
+                if (conn.unsent != 0 && !conn.write_interest && !flush(conn))
+                    return false;
+                wake = std::min(
+                        wake, conn.phase_nsec + conn.scheduled * 1'000'000'000UL / config_.rate);
+            }
+            now = elapsed_nsec();
+        }
+
+        timespec timeout{};
+        if (wake > now) {
+            timeout.tv_sec = static_cast<time_t>((wake - now) / 1'000'000'000UL);
+            timeout.tv_nsec = static_cast<long>((wake - now) % 1'000'000'000UL);
+        }
+        int const num_events = ::epoll_pwait2(
+                epollfd_, static_cast<epoll_event*>(events), EpollMaxEvents, &timeout, nullptr);
+        if (num_events == -1) {
+            if (errno == EINTR)
+                continue;
+            util::log_error("error: epoll_pwait2: {}", std::strerror(errno));
+            return false;
+        }
+
+        for (int i = 0; i < num_events; ++i) {
+            connection& conn = conns_[events[i].data.u64]; // NOLINT
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) { // NOLINT
+                util::log_error("error: unexpected event on fd {}", conn.fd);
+                stats_.add_errors();
+                return false;
+            }
+            if ((events[i].events & EPOLLOUT) && !flush(conn)) // NOLINT
+                return false;
+            if ((events[i].events & EPOLLIN) && !on_readable(conn)) // NOLINT
+                return false;
+        }
+    }
+
+    elapsed_ = std::chrono::steady_clock::now() - start_;
+    return true;
+}
+
+
+std::uint64_t
+tcp_echo_client::incomplete() const
+{
+    std::uint64_t n = 0;
+    for (auto const& conn : conns_)
+        n += conn.due.size();
+    return n;
+}
+
+
+void
+tcp_echo_client::schedule(connection& conn, std::uint64_t now)
+{
+    for (;;) {
+        std::uint64_t const due
+                = conn.phase_nsec + conn.scheduled * 1'000'000'000UL / config_.rate;
+        if (due > now)
+            break;
+        conn.due.push_back(due);
+        conn.unsent += config_.size;
+        ++conn.scheduled;
+    }
+}
+
+
+void
+tcp_echo_client::schedule_one(connection& conn, std::uint64_t now)
+{
+    conn.due.push_back(now);
+    conn.unsent += config_.size;
+    ++conn.scheduled;
+}
+
+
+bool
+tcp_echo_client::flush(connection& conn)
+{
+    while (conn.unsent != 0) {
+        // payload_ holds whole messages, so it can be sent from any
+        // offset within the first
+        std::size_t const len = std::min(conn.unsent, payload_.size() - conn.send_offset);
+        ssize_t const bytes_sent
+                = ::send(conn.fd, payload_.data() + conn.send_offset, len, MSG_NOSIGNAL);
+        if (bytes_sent == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return conn.write_interest || set_write_interest(conn, true);
+            util::log_error("error: send: {}", std::strerror(errno));
+            stats_.add_errors();
+            return false;
+        }
+
+        auto const n = static_cast<std::size_t>(bytes_sent);
+        conn.unsent -= n;
+        conn.send_offset = (conn.send_offset + n) % config_.size;
+    }
+
+    return !conn.write_interest || set_write_interest(conn, false);
+}
+
+
+bool
+tcp_echo_client::on_readable(connection& conn)
+{
+    bool const open_loop = config_.rate != 0;
+    std::uint64_t echoes = 0;
+
+    for (;;) {
+        ssize_t const bytes_recvd = ::recv(conn.fd, in_buf_.data(), in_buf_.size(), 0);
+        if (bytes_recvd == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            util::log_error("error: recv: {}", std::strerror(errno));
+            stats_.add_errors();
+            return false;
+        }
+        if (bytes_recvd == 0) {
+            util::log_error("error: server closed the connection on fd {}", conn.fd);
+            stats_.add_errors();
+            return false;
+        }
+
+        std::uint64_t const now = elapsed_nsec();
+        conn.recv_offset += static_cast<std::size_t>(bytes_recvd);
+        while (conn.recv_offset >= config_.size) {
+            if (conn.due.empty()) {
+                util::log_error("error: fd {} received more than was sent", conn.fd);
+                stats_.add_errors();
+                return false;
+            }
+            conn.recv_offset -= config_.size;
+            rtt_.record(now - conn.due.front());
+            conn.due.pop_front();
+            ++echoes;
+        }
+    }
+
+    stats_.add(echoes, echoes * config_.size);
+
+    if (!open_loop && echoes != 0) {
+        std::uint64_t const now = elapsed_nsec();
+        if (now >= end_nsec_)
+            return true;
+        schedule_one(conn, now);
+        return flush(conn);
+    }
+    return true;
+}
+
+
+bool
+tcp_echo_client::set_write_interest(connection& conn, bool enable)
+{
+    epoll_event event{};
+    event.events = enable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.u64 = static_cast<std::uint64_t>(&conn - conns_.data());
+    if (::epoll_ctl(epollfd_, EPOLL_CTL_MOD, conn.fd, &event) == -1) {
+        util::log_error("error: epoll_ctl (EPOLL_CTL_MOD): {}", std::strerror(errno));
+        return false;
+    }
+    conn.write_interest = enable;
+    return true;
+}
+
+
+std::uint64_t
+tcp_echo_client::elapsed_nsec() const
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_)
+                    .count());
+}
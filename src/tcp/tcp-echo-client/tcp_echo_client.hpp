@@ -0,0 +1,128 @@
+#pragma once
+
+#include "util/histogram.hpp"
+#include "util/net_util.hpp"
+#include "util/stats.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+
+struct client_config
+{
+    std::size_t size = 64;             ///< message size in bytes
+    std::uint64_t rate = 0;            ///< msgs/sec per connection, 0 for closed loop
+    std::chrono::seconds duration{10}; ///< how long run() sends for
+};
+
+/*  \class  tcp_echo_client
+ *  \brief  Single-threaded epoll load generator for an echo server.
+ *          Every message is the same size, so echoes are matched to
+ *          messages by byte count alone.
+ *          Closed loop: each connection keeps one message in flight and
+ *          sends the next as soon as the echo completes, measuring
+ *          round trips from the actual send.
+ *          Open loop: each connection sends on a fixed schedule
+ *          regardless of replies, and round trips are measured from
+ *          when a message was due rather than when it went out, so a
+ *          stalled server is charged for every message it delayed
+ *          (no coordinated omission). Connections are staggered across
+ *          the interval so they don't all send at once.
+ */
+class tcp_echo_client
+{
+public:
+    /// Connects every connection before returning
+    /// \param stats Updated for every echo and error; only by the
+    ///        thread that calls run()
+    /// \throws std::exception On error
+    tcp_echo_client(net::endpoint const& server, int connections, client_config const& config,
+            util::stat_counters& stats);
+    ~tcp_echo_client();
+
+    // No copies/moves
+    tcp_echo_client(tcp_echo_client const&) = delete;
+    tcp_echo_client(tcp_echo_client&&) = delete;
+    tcp_echo_client& operator=(tcp_echo_client const&) = delete;
+    tcp_echo_client&& operator=(tcp_echo_client&&) = delete;
+
+    /// Send for config.duration, then wait up to DrainTimeoutMsecs for
+    /// the echoes still outstanding
+    /// \return \c false on error
+    bool run();
+
+    /// Round-trip times in nanoseconds, complete once run() returns
+    util::histogram const&
+    rtt() const
+    {
+        return rtt_;
+    }
+
+    /// Num of messages due but not echoed when run() returned
+    std::uint64_t incomplete() const;
+
+    /// How long run() took, the wait for outstanding echoes included
+    std::chrono::nanoseconds
+    elapsed() const
+    {
+        return elapsed_;
+    }
+
+private:
+    struct connection
+    {
+        int fd = -1;
+        std::uint64_t phase_nsec = 0;  ///< offset of this connection's schedule
+        std::uint64_t scheduled = 0;   ///< num of messages due so far
+        std::deque<std::uint64_t> due; ///< when each unechoed message was due
+        std::size_t unsent = 0;        ///< bytes due but not yet sent
+        std::size_t send_offset = 0;   ///< bytes of the current message sent
+        std::size_t recv_offset = 0;   ///< bytes of the current echo received
+        bool write_interest = false;   ///< EPOLLOUT registered
+    };
+
+    /// Queue every message whose time has come (open loop)
+    void schedule(connection& conn, std::uint64_t now);
+
+    /// Queue one message, due now (closed loop)
+    void schedule_one(connection& conn, std::uint64_t now);
+
+    /// Send queued bytes until none remain or the socket would block
+    /// \return \c false on error
+    bool flush(connection& conn);
+
+    /// Read echoes until the socket would block, recording the round
+    /// trip of each completed message
+    /// \return \c false on error
+    bool on_readable(connection& conn);
+
+    /// Add or remove EPOLLOUT from the events registered for conn
+    /// \return \c false on error
+    bool set_write_interest(connection& conn, bool enable);
+
+    /// \return Time in nanoseconds since start_
+    std::uint64_t elapsed_nsec() const;
+
+private:
+    enum
+    {
+        EpollMaxEvents = 64,             ///< max num of pending epoll events
+        IncomingBufferSizeBytes = 65536, ///< size of recv buffer
+        MaxSendBytes = 65536,            ///< max num of bytes per send call
+        DrainTimeoutMsecs = 1000,        ///< max wait for echoes once sending stops
+    };
+
+    client_config const config_;                  ///< message size, rate and duration
+    util::stat_counters& stats_;                  ///< echoes, bytes and errors of this client
+    int epollfd_{-1};                             ///< epoll file descriptor
+    std::vector<connection> conns_;               ///< indexed by epoll data
+    std::vector<char> payload_;                   ///< back-to-back copies of the message
+    std::vector<char> in_buf_;                    ///< recv buffer, shared by all connections
+    std::chrono::steady_clock::time_point start_; ///< when run() began
+    std::uint64_t end_nsec_{0};                   ///< since start_, when sending stops
+    std::chrono::nanoseconds elapsed_{0};         ///< how long run() took
+    util::histogram rtt_;                         ///< round-trip times in nanoseconds
+
+}; // class tcp_echo_client
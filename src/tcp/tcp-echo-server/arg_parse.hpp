@@ -0,0 +1,193 @@
+#pragma once
+
+#include "version.h"
+#include "util/compiler.hpp"
+#include "util/thread_util.hpp"
+#include <getopt.h>
+#include <charconv> // std::from_chars
+#include <cstdint>
+#include <cstdio>  // std::FILE
+#include <cstdlib> // std::exit
+#include <cstring> // std::strlen
+#include <filesystem>
+#include <print>
+#include <string_view>
+#include <vector>
+
+
+enum class engine_type
+{
+    Epoll,
+    IoUring,
+};
+
+struct cli_args
+{
+    engine_type engine = engine_type::Epoll;
+    std::uint16_t port = 42483;
+    int workers = 1;
+    std::vector<int> cpus;
+    bool zero_copy = false;
+    bool spin = false;
+    int busy_poll_usecs = 0;
+    bool huge_pages = false;
+    bool verbose = false;
+};
+
+
+inline cli_args
+arg_parse(int argc, char** argv)
+{
+    auto usage = [](std::FILE* outerr, std::filesystem::path const& app) {
+        std::print(outerr,
+                "usage: {} [-hHsvVz] [-b <usecs>] [-c <cpus>] [-e <engine>] [-p <port>]\n"
+                "       [-w <workers>]\n"
+                "optional arguments:\n"
+                "  -b, --busy-poll=<usecs>  busy poll the device queue for up to usecs on each\n"
+                "                           read (SO_BUSY_POLL); may need CAP_NET_ADMIN\n"
+                "  -c, --cpus=<list>        pin worker n to the n-th cpu in list (e.g., 0,2-4)\n"
+                "  -e, --engine=<engine>    event engine, 'epoll' or 'io_uring' (default epoll);\n"
+                "                           io_uring falls back to epoll if unavailable\n"
+                "  -h, --help               this output\n"
+                "  -H, --huge-pages         back i/o buffers with hugepages if available\n"
+                "  -p, --port=<port>        listening port (default 42483)\n"
+                "  -s, --spin               never sleep in epoll_wait; each worker spins on a\n"
+                "                           core (best with --cpus on isolated cpus)\n"
+                "  -v, --version            version\n"
+                "  -V, --verbose            print every message received (slow; throughput\n"
+                "                           is reported once a second regardless)\n"
+                "  -w, --workers=<num>      num of worker threads, each with its own\n"
+                "                           SO_REUSEPORT listening socket (default 1)\n"
+                "  -z, --zero-copy          echo with splice(2) through a per-connection\n"
+                "                           pipe, bypassing user space (epoll engine only)\n",
+                app.c_str());
+        std::exit(outerr == stdout ? EXIT_SUCCESS : EXIT_FAILURE);
+    };
+
+    auto to_int = [](char const* str, int& value) {
+        char const* const end = str + std::strlen(str);
+        auto [ptr, ec] = std::from_chars(str, end, value);
+        return ec == std::errc() && ptr == end;
+    };
+
+    auto const app = std::filesystem::path(argv[0]).filename();
+
+    cli_args args;
+    while (true) {
+        static constexpr option long_options[] = {
+                {"busy-poll", required_argument, nullptr, 'b'},
+                {"cpus", required_argument, nullptr, 'c'},
+                {"engine", required_argument, nullptr, 'e'},
+                {"help", no_argument, nullptr, 'h'},
+                {"huge-pages", no_argument, nullptr, 'H'},
+                {"port", required_argument, nullptr, 'p'},
+                {"spin", no_argument, nullptr, 's'},
+                {"verbose", no_argument, nullptr, 'V'},
+                {"version", no_argument, nullptr, 'v'},
+                {"workers", required_argument, nullptr, 'w'},
+                {"zero-copy", no_argument, nullptr, 'z'},
+                {nullptr, 0, nullptr, 0},
+        };
+
+        int const c = ::getopt_long(
+                argc, argv, "b:c:e:hHp:svVw:z", static_cast<option const*>(long_options), nullptr);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'b':
+                if (!to_int(optarg, args.busy_poll_usecs) || args.busy_poll_usecs <= 0) {
+                    std::println(stderr, "invalid busy poll time: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'c':
+                args.cpus = util::parse_cpu_list(optarg);
+                if (args.cpus.empty()) {
+                    std::println(stderr, "invalid cpu list: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'e':
+                if (std::string_view(optarg) == "epoll") {
+                    args.engine = engine_type::Epoll;
+                } else if (std::string_view(optarg) == "io_uring") {
+                    args.engine = engine_type::IoUring;
+                } else {
+                    std::println(stderr, "invalid engine: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'h':
+                usage(stdout, app);
+                break;
+
+            case 'H':
+                args.huge_pages = true;
+                break;
+
+            case 'p': {
+                int port = 0;
+                if (!to_int(optarg, port) || port <= 0 || port > UINT16_MAX) {
+                    std::println(stderr, "invalid port: {}", optarg);
+                    usage(stderr, app);
+                }
+                args.port = static_cast<std::uint16_t>(port);
+            } break;
+
+            case 's':
+                args.spin = true;
+                break;
+
+            case 'v':
+                std::println("app_version={}\n{}", ::VERSION, get_version_info_multiline());
+                std::exit(EXIT_SUCCESS);
+                break;
+
+            case 'V':
+                args.verbose = true;
+                break;
+
+            case 'w':
+                if (!to_int(optarg, args.workers) || args.workers <= 0) {
+                    std::println(stderr, "invalid number of workers: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'z':
+                args.zero_copy = true;
+                break;
+
+            case '?':
+            default:
+                usage(stderr, app);
+                break;
+        }
+    } // while
+
+    if (optind != argc) {
+        std::println(stderr, "unexpected argument: {}\n", argv[optind]);
+        usage(stderr, app);
+    }
+
+    if (!args.cpus.empty() && args.cpus.size() < static_cast<std::size_t>(args.workers)) {
+        std::println(stderr, "cpu list must contain at least one cpu per worker\n");
+        usage(stderr, app);
+    }
+
+    if (args.zero_copy && args.engine != engine_type::Epoll) {
+        std::println(stderr, "--zero-copy is only supported by the epoll engine\n");
+        usage(stderr, app);
+    }
+
+    if ((args.spin || args.busy_poll_usecs > 0) && args.engine != engine_type::Epoll) {
+        std::println(stderr, "--spin and --busy-poll are only supported by the epoll engine\n");
+        usage(stderr, app);
+    }
+
+    return args;
+}
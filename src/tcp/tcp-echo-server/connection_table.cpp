@@ -0,0 +1,58 @@
+#include "connection_table.hpp"
+#include <cassert>
+#include <utility> // std::move
+
+
+connection*
+connection_table::insert(int fd)
+{
+    assert(fd >= 0);
+    auto const ufd = static_cast<std::size_t>(fd);
+
+    // fds are allocated lowest-first by the kernel, so this index stays
+    // about as large as the peak number of open descriptors.
+    if (ufd >= slots_.size())
+        slots_.resize(ufd + 1, NoSlot);
+
+    if (slots_[ufd] != NoSlot)
+        return nullptr;
+
+    slots_[ufd] = static_cast<std::uint32_t>(conns_.size());
+
+    connection& conn = conns_.emplace_back();
+    conn.fd = fd;
+    conn.connected_at = connection::clock::now();
+    conn.last_active_at = conn.connected_at;
+    return &conn;
+}
+
+
+connection*
+connection_table::find(int fd)
+{
+    auto const ufd = static_cast<std::size_t>(fd);
+    if (fd < 0 || ufd >= slots_.size() || slots_[ufd] == NoSlot)
+        return nullptr;
+
+    return &conns_[slots_[ufd]];
+}
+
+
+bool
+connection_table::erase(int fd)
+{
+    auto const ufd = static_cast<std::size_t>(fd);
+    if (fd < 0 || ufd >= slots_.size() || slots_[ufd] == NoSlot)
+        return false;
+
+    // Move the last connection into the vacated slot.
+    std::uint32_t const slot = slots_[ufd];
+    if (std::size_t const last = conns_.size() - 1; slot != last) {
+        conns_[slot] = std::move(conns_[last]);
+        slots_[static_cast<std::size_t>(conns_[slot].fd)] = slot;
+    }
+
+    conns_.pop_back();
+    slots_[ufd] = NoSlot;
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "util/byte_ring.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/// Per-connection state
+struct connection
+{
+    using clock = std::chrono::steady_clock;
+
+    int fd = -1;                        ///< connected socket
+    std::uint64_t bytes_recvd = 0;      ///< total num of bytes received
+    std::uint64_t bytes_sent = 0;       ///< total num of bytes sent
+    std::uint64_t recv_calls = 0;       ///< num of successful recv calls
+    clock::time_point connected_at{};   ///< time of accept
+    clock::time_point last_active_at{}; ///< time of last successful recv
+    util::byte_ring out;                ///< bytes not yet accepted by send
+    int pipe_rd = -1;                   ///< zero-copy mode: read end of pipe
+    int pipe_wr = -1;                   ///< zero-copy mode: write end of pipe
+    std::size_t pipe_bytes = 0;         ///< zero-copy mode: bytes in pipe
+    bool write_armed = false;           ///< registered for EPOLLOUT
+    bool read_paused = false;           ///< stopped reading, out is full
+    bool closing = false;               ///< peer shut down, close once out drains
+};
+
+
+/*  \class  connection_table
+ *  \brief  Table of connections indexed by fd. Connections are stored
+ *          contiguously; a second, fd-indexed array maps each fd to its
+ *          slot, giving O(1) insert, lookup and removal. Removal moves
+ *          the last connection into the vacated slot, so pointers
+ *          returned by insert() and find() are only valid until the
+ *          next insert() or erase().
+ */
+class connection_table
+{
+public:
+    using iterator = std::vector<connection>::iterator;
+
+    connection_table() = default;
+
+    /// \return Newly added connection, or \c nullptr if fd is already
+    ///         present
+    connection* insert(int fd);
+
+    /// \return \c nullptr if fd is not present
+    connection* find(int fd);
+
+    /// \return \c false if fd is not present
+    bool erase(int fd);
+
+    std::size_t
+    size() const
+    {
+        return conns_.size();
+    }
+
+    bool
+    empty() const
+    {
+        return conns_.empty();
+    }
+
+    iterator
+    begin()
+    {
+        return conns_.begin();
+    }
+
+    iterator
+    end()
+    {
+        return conns_.end();
+    }
+
+private:
+    static constexpr std::uint32_t NoSlot = UINT32_MAX;
+
+    std::vector<connection> conns_;    ///< densely packed connections
+    std::vector<std::uint32_t> slots_; ///< fd -> index into conns_
+};
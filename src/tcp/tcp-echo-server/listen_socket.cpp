@@ -0,0 +1,71 @@
+#include "listen_socket.hpp"
+#include <fcntl.h>
+#include <netdb.h>      // ::getaddrinfo
+#include <sys/socket.h> // socket calls
+#include <sys/types.h>  // addrinfo
+#include <unistd.h>     // ::close
+#include <cerrno>
+#include <cstring>   // std::memset, std::strerror
+#include <stdexcept> // std::runtime_error
+#include <string>
+
+
+int
+open_listen_socket(std::uint16_t port)
+{
+    addrinfo hints{};
+
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;     // ipv4 or ipv6
+    hints.ai_socktype = SOCK_STREAM; // tcp
+    hints.ai_flags = AI_PASSIVE;     // wildcard ip
+    hints.ai_protocol = 0;
+    hints.ai_canonname = nullptr;
+    hints.ai_addr = nullptr;
+    hints.ai_next = nullptr;
+
+    // Get local address.
+    addrinfo* result = nullptr;
+    if (int rv = ::getaddrinfo(nullptr, std::to_string(port).c_str(), &hints, &result); rv != 0) {
+        throw std::runtime_error(std::string("getaddrinfo: ") + ::gai_strerror(rv));
+    }
+
+    auto fail = [&result](int sock, std::string const& what) {
+        std::string msg = what + ": " + std::strerror(errno);
+        if (sock != -1)
+            ::close(sock);
+        ::freeaddrinfo(result);
+        throw std::runtime_error(msg);
+    };
+
+    // Get socket
+    int const sock = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (sock == -1) {
+        fail(sock, "socket");
+    }
+
+    // Allow for socket reuse
+    int const yes = 1;
+    if (int rv = ::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)); rv == -1) {
+        fail(sock, "setsockopt (SO_REUSEADDR)");
+    }
+
+    if (int rv = ::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)); rv == -1) {
+        fail(sock, "setsockopt (SO_REUSEPORT)");
+    }
+
+    // Bind
+    if (int rv = ::bind(sock, result->ai_addr, result->ai_addrlen); rv == -1) {
+        fail(sock, "bind");
+    }
+
+    ::freeaddrinfo(result);
+    result = nullptr;
+
+    // Set socket as non-blocking
+    if (int rv = ::fcntl(sock, F_SETFL, O_NONBLOCK); rv == -1) {
+        fail(sock, "fcntl (O_NONBLOCK)");
+    }
+
+    return sock;
+}
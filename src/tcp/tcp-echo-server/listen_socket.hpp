@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+
+/// Create a non-blocking tcp socket bound (with SO_REUSEADDR and
+/// SO_REUSEPORT) to the wildcard address on port. The caller is
+/// responsible for calling listen() and for closing the socket.
+/// \throws std::exception On error
+int open_listen_socket(std::uint16_t port);
@@ -1,18 +1,120 @@
+#include "arg_parse.hpp"
 #include "tcp_echo_server.hpp"
-#include <cstdio>  // std::fprintf
-#include <cstdlib> // EXIT_FAILURE, EXIT_SUCCESS
+#include "uring_echo_server.hpp"
+#include "util/buffer_pool.hpp"
+#include "util/logger.hpp"
+#include "util/stats.hpp"
+#include "util/thread_util.hpp"
+#include <sys/resource.h> // ::getrlimit, ::setrlimit
+#include <cstdio>         // std::fflush, std::fprintf
+#include <cstdlib>        // EXIT_FAILURE, EXIT_SUCCESS, std::_Exit
 #include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+    /// The default soft limit of 1024 descriptors would cap the num of
+    /// connections, so raise it as far as the hard limit allows
+    void
+    raise_fd_limit()
+    {
+        rlimit limit{};
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            ::setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    /// Each worker owns its own listening socket and event loop, so
+    /// there is no state shared between workers.
+    /// \return \c false on error
+    bool
+    run_worker(cli_args const& args, int id, util::stats_reporter& reporter)
+    {
+        try {
+            std::vector<int> pinned;
+            if (!args.cpus.empty()) {
+                pinned.push_back(args.cpus[static_cast<std::size_t>(id)]);
+                util::pin_thread(pinned.front());
+            }
+            if (args.spin)
+                util::check_isolation(pinned, "worker " + std::to_string(id));
+
+            server_config const config{
+                    .zero_copy = args.zero_copy,
+                    .spin = args.spin,
+                    .busy_poll_usecs = args.busy_poll_usecs,
+                    .verbose = args.verbose,
+            };
+            util::stat_counters& stats = reporter.add_thread();
+            util::logger::instance().add_thread();
+
+            bool ok = false;
+            if (args.engine == engine_type::IoUring) {
+                std::unique_ptr<uring_echo_server> server;
+                try {
+                    server = std::make_unique<uring_echo_server>(args.port, stats);
+                } catch (std::exception const& e) {
+                    std::fprintf(stderr,
+                            "warning: worker %d: io_uring unavailable (%s), using epoll\n", id,
+                            e.what());
+                }
+                if (server)
+                    ok = server->run();
+                else
+                    ok = tcp_echo_server(args.port, config, stats).run();
+            } else {
+                ok = tcp_echo_server(args.port, config, stats).run();
+            }
+
+            if (!ok) {
+                std::fprintf(stderr, "error: worker %d: server shutdown with an error\n", id);
+                return false;
+            }
+        } catch (std::exception const& e) {
+            std::fprintf(stderr, "error: worker %d: exception: %s\n", id, e.what());
+            return false;
+        } catch (...) {
+            std::fprintf(stderr, "error: worker %d: exception: ???\n", id);
+            return false;
+        }
+
+        return true;
+    }
+
+} // namespace
 
 
 int
-main(int, char**)
+main(int argc, char** argv)
 {
     try {
-        tcp_echo_server server;
-        if (!server.run()) {
-            std::fprintf(stderr, "error: server shutdown with an error\n");
-            return EXIT_FAILURE;
-        }
+        cli_args const args = arg_parse(argc, argv);
+        raise_fd_limit();
+        util::buffer_pool::configure({.huge_pages = args.huge_pages});
+
+        util::stats_reporter reporter("tcp-echo-server");
+        util::logger::instance(); // start its thread before workers pin themselves
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(static_cast<std::size_t>(args.workers));
+            for (int id = 0; id < args.workers; ++id) {
+                workers.emplace_back([&args, &reporter, id] {
+                    if (run_worker(args, id, reporter))
+                        return;
+
+                    // The other workers only stop on an error of their
+                    // own, so joining them would wait forever; take the
+                    // process down, with whatever was logged
+                    util::logger::instance().flush();
+                    std::fflush(nullptr);
+                    std::_Exit(EXIT_FAILURE);
+                });
+            }
+        } // join all workers
     } catch (std::exception const& e) {
         std::fprintf(stderr, "error: exception: %s\n", e.what());
         return EXIT_FAILURE;
@@ -1,71 +1,57 @@
 #include "tcp_echo_server.hpp"
-#include <fcntl.h>
-#include <netdb.h> // ::getaddrinfo
+#include "listen_socket.hpp"
+#include "util/logger.hpp"
+#include "util/net_util.hpp"
+#include <fcntl.h> // ::splice, O_NONBLOCK
 #include <sys/epoll.h>
 #include <sys/socket.h> // socket calls
-#include <sys/types.h>  // addrinfo
 #include <unistd.h>     // ::close
-#include <algorithm>
+#include <algorithm>    // std::min
 #include <cassert>
 #include <cerrno>
-#include <cstring> // std::memset, std::strerror
+#include <cstring> // std::strerror
+#include <new>     // std::bad_alloc
 #include <print>
+#include <span>
 #include <stdexcept> // std::runtime_error
 #include <string>
 
 
-tcp_echo_server::tcp_echo_server()
-        : clients_()
+tcp_echo_server::tcp_echo_server(
+        std::uint16_t port, server_config const& config, util::stat_counters& stats)
+        : port_(port)
+        , config_(config)
+        , stats_(stats)
+        , clients_()
+        , in_buf_(util::buffer_pool::instance().acquire(IncomingBufferSizeBytes))
 {
-    addrinfo hints{};
-
-    std::memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;     // ipv4 or ipv6
-    hints.ai_socktype = SOCK_STREAM; // tcp
-    hints.ai_flags = AI_PASSIVE;     // wildcard ip
-    hints.ai_protocol = 0;
-    hints.ai_canonname = nullptr;
-    hints.ai_addr = nullptr;
-    hints.ai_next = nullptr;
-
-    // Get local address.
-    addrinfo* result = nullptr;
-    if (int rv = ::getaddrinfo(nullptr, std::to_string(port_).c_str(), &hints, &result); rv != 0) {
-        throw std::runtime_error(std::string("getaddrinfo: ") + std::strerror(errno));
-    }
-
-    // Get socket
-    sockfd_ = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
-    if (sockfd_ == -1) {
-        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
-    }
-
-    // Allow for socket reuse
-    int const yes = 1;
-    if (int rv = ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)); rv == -1) {
-        throw std::runtime_error(std::string("setsockopt (SO_REUSEADDR): ") + std::strerror(errno));
-    }
-
-    if (int rv = ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)); rv == -1) {
-        throw std::runtime_error(std::string("setsockopt (SO_REUSEPORT): ") + std::strerror(errno));
-    }
-
-    // Bind
-    if (int rv = ::bind(sockfd_, result->ai_addr, result->ai_addrlen); rv == -1) {
-        throw std::runtime_error(std::string("bind: ") + std::strerror(errno));
-    }
-
-    ::freeaddrinfo(result);
+    if (!in_buf_)
+        throw std::runtime_error("buffer_pool: out of memory");
+
+    sockfd_ = open_listen_socket(port_);
+
+    // Check up front that busy polling is permitted; connections get
+    // the same settings when accepted
+    if (config_.busy_poll_usecs > 0) {
+        if (!net::set_busy_poll(sockfd_, config_.busy_poll_usecs)) {
+            int const error = errno;
+            ::close(sockfd_);
+            throw std::runtime_error(std::string("set_busy_poll: ") + std::strerror(error));
+        }
 
-    // Set socket as non-blocking
-    if (int rv = ::fcntl(sockfd_, F_SETFL, O_NONBLOCK); rv == -1) {
-        throw std::runtime_error(std::string("fcntl (O_NONBLOCK): ") + std::strerror(errno));
+        prefer_busy_poll_ = net::set_prefer_busy_poll(sockfd_);
+        if (!prefer_busy_poll_) {
+            std::println(stderr, "warning: SO_PREFER_BUSY_POLL: {}; busy polling with interrupts",
+                    std::strerror(errno));
+        }
     }
 
     // Get epoll fd
     epollfd_ = ::epoll_create1(0);
     if (epollfd_ == -1) {
-        throw std::runtime_error(std::string("epoll_create1: ") + std::strerror(errno));
+        int const error = errno;
+        ::close(sockfd_);
+        throw std::runtime_error(std::string("epoll_create1: ") + std::strerror(error));
     }
 }
 
@@ -75,8 +61,12 @@ tcp_echo_server::~tcp_echo_server()
     ::close(sockfd_);
     ::close(epollfd_);
 
-    for (auto sock : clients_) {
-        ::close(sock);
+    for (auto const& conn : clients_) {
+        ::close(conn.fd);
+        if (conn.pipe_rd != -1) {
+            ::close(conn.pipe_rd);
+            ::close(conn.pipe_wr);
+        }
     }
 }
 
@@ -100,26 +90,38 @@ tcp_echo_server::run()
         return false;
     }
 
+    int const timeout = config_.spin ? 0 : EpollTimeoutMsecs;
     epoll_event events[EpollMaxEvents];
     for (;;) {
         int const num_events = ::epoll_wait(
-                epollfd_, static_cast<epoll_event*>(events), EpollMaxEvents, EpollTimeoutMsecs);
+                epollfd_, static_cast<epoll_event*>(events), EpollMaxEvents, timeout);
         if (num_events == -1) {
-            std::println(stderr, "error: epoll_wait: {}", std::strerror(errno));
+            if (errno == EINTR)
+                continue;
+            util::log_error("error: epoll_wait: {}", std::strerror(errno));
             return false;
         }
 
+        // epoll_wait never blocks for longer than AcceptRetryMsecs
+        if (!accepting_ && clock::now() >= resume_accept_ && !resume_accepting())
+            return false;
 
         for (int i = 0; i < num_events; ++i) {
             // Check for flag that we aren't listening for. Not sure if this is necessary.
             if ((events[i].events & EPOLLERR) || (events[i].events & EPOLLHUP)) { // NOLINT
-                std::println(stderr, "error: unexpected event on fd {}", i);
+                int const fd = events[i].data.fd; // NOLINT
+                stats_.add_errors();
 
-                auto itr = std::find(clients_.begin(), clients_.end(), events[i].data.fd); // NOLINT
-                assert(itr != clients_.end());
+                // The listener isn't a client; there is nothing to close
+                if (fd == sockfd_) {
+                    util::log_error("error: unexpected event on listening socket {}", fd);
+                    return false;
+                }
 
-                clients_.erase(itr);
-                ::close(events[i].data.fd); // NOLINT
+                util::log_error("error: unexpected event on fd {}", fd);
+                if (!close_connection(fd)) {
+                    return false;
+                }
                 continue;
             }
 
@@ -128,7 +130,18 @@ tcp_echo_server::run()
                 if (!status) {
                     return false;
                 }
-            } else {
+                continue;
+            }
+
+            // Flush first: draining the output buffer may resume a paused
+            // reader, which on_incoming_data would otherwise skip.
+            if (events[i].events & EPOLLOUT) {                          // NOLINT
+                bool const status = on_outgoing_ready(events[i].data.fd); // NOLINT
+                if (!status) {
+                    return false;
+                }
+            }
+            if (events[i].events & EPOLLIN) {                          // NOLINT
                 bool const status = on_incoming_data(events[i].data.fd); // NOLINT
                 if (!status) {
                     return false;
@@ -144,77 +157,384 @@ tcp_echo_server::run()
 bool
 tcp_echo_server::on_incoming_connection(int)
 {
-    // Accept the connection
-    sockaddr_storage their_addr{};
-    socklen_t addr_size = sizeof(their_addr);
-    int const accepted_sock
-            = ::accept(sockfd_, reinterpret_cast<sockaddr*>(&their_addr), &addr_size);
-    if (accepted_sock == -1) {
-        if (errno == EAGAIN)
-            return true; // not an error
+    // The listening socket is edge-triggered, so accept every pending
+    // connection before returning to epoll_wait.
+    for (;;) {
+        sockaddr_storage their_addr{};
+        socklen_t addr_size = sizeof(their_addr);
+        int const accepted_sock = ::accept4(
+                sockfd_, reinterpret_cast<sockaddr*>(&their_addr), &addr_size, SOCK_NONBLOCK);
+        if (accepted_sock == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true; // not an error
+
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            int const error = errno;
+            stats_.add_errors();
+            util::log_error("error: accept4: {}", std::strerror(error));
+            if (error != EMFILE && error != ENFILE && error != ENOBUFS && error != ENOMEM)
+                return false;
+
+            // Out of descriptors or memory, with connections still
+            // pending. Stop watching the listener until a client goes or
+            // a while has passed, rather than taking down every worker;
+            // watching it again reports whatever is still pending.
+            return pause_accepting();
+        }
+
+        if (config_.busy_poll_usecs > 0
+                && (!net::set_busy_poll(accepted_sock, config_.busy_poll_usecs)
+                        || (prefer_busy_poll_ && !net::set_prefer_busy_poll(accepted_sock)))) {
+            util::log_error("error: set_busy_poll: {}", std::strerror(errno));
+            stats_.add_errors();
+            ::close(accepted_sock);
+            continue;
+        }
+
+        util::log_info("client connected on fd {}", accepted_sock);
+
+        // Successfully connected. Store the new fd.
+        connection* conn = clients_.insert(accepted_sock);
+        assert(conn != nullptr);
+
+        if (config_.zero_copy) {
+            int fds[2] = {-1, -1};
+            if (int rv = ::pipe2(static_cast<int*>(fds), O_NONBLOCK | O_CLOEXEC); rv == -1) {
+                util::log_error("error: pipe2: {}", std::strerror(errno));
+                clients_.erase(accepted_sock);
+                ::close(accepted_sock);
+                continue;
+            }
+            conn->pipe_rd = fds[0];
+            conn->pipe_wr = fds[1];
+        }
 
-        throw std::runtime_error(std::string("accept: ") + std::strerror(errno));
+        // Add the new fd to epoll.
+        epoll_event event{};
+        event.events = (EPOLLIN | EPOLLET);
+        event.data.fd = accepted_sock;
+        if (int rv = ::epoll_ctl(epollfd_, EPOLL_CTL_ADD, accepted_sock, &event); rv == -1) {
+            util::log_error("error: epoll_ctl (EPOLL_CTL_ADD): {}", std::strerror(errno));
+            return false;
+        }
+    }
+}
+
+
+bool
+tcp_echo_server::on_incoming_data(int fd)
+{
+    connection* conn = clients_.find(fd);
+    if (conn == nullptr || conn->read_paused || conn->closing)
+        return true; // closed earlier in this batch, or waiting on EPOLLOUT
+
+    if (config_.zero_copy)
+        return splice_echo(*conn);
+
+    char* const buf = in_buf_.data();
+
+    // Edge-triggered: keep reading until the kernel queue is empty.
+    for (;;) {
+        // Never read more than can be queued if the peer isn't reading
+        // its echoes; leaving data in the kernel lets tcp flow control
+        // push back on the sender.
+        std::size_t const max_bytes = conn->out.empty()
+                ? in_buf_.capacity()
+                : std::min(in_buf_.capacity(), conn->out.free_space());
+        if (max_bytes == 0) {
+            conn->read_paused = true;
+            break;
+        }
+
+        ::ssize_t const bytes_recvd = ::recv(fd, buf, max_bytes, 0);
+        if (bytes_recvd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+
+            stats_.add_errors();
+
+            util::log_error("error: recv: {}", std::strerror(errno));
+            return close_connection(fd);
+        }
+
+        // Client disconnected. Finish echoing what's queued first.
+        if (bytes_recvd == 0) {
+            util::log_info("client on fd {} disconnected", fd);
+            if (conn->out.empty())
+                return close_connection(fd);
+            conn->closing = true;
+            break;
+        }
+
+        conn->bytes_recvd += static_cast<std::uint64_t>(bytes_recvd);
+        ++conn->recv_calls;
+        stats_.add(1, static_cast<std::uint64_t>(bytes_recvd));
+        conn->last_active_at = connection::clock::now();
+
+        // Echo. Only send directly if nothing is queued, otherwise bytes
+        // would be reordered.
+        auto const len = static_cast<std::size_t>(bytes_recvd);
+        std::size_t sent = 0;
+        if (conn->out.empty()) {
+            ::ssize_t const bytes_sent = ::send(fd, buf, len, MSG_NOSIGNAL);
+            if (bytes_sent == -1) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    stats_.add_errors();
+                    util::log_error("error: send: {}", std::strerror(errno));
+                    return close_connection(fd);
+                }
+            } else {
+                sent = static_cast<std::size_t>(bytes_sent);
+                conn->bytes_sent += sent;
+            }
+        }
+
+        // Queue whatever the socket didn't take
+        if (sent < len) {
+            if (conn->out.capacity() == 0) {
+                // The pool is shared by every worker; running out only
+                // costs this client its connection
+                try {
+                    conn->out = util::byte_ring(OutputBufferSizeBytes);
+                } catch (std::bad_alloc const&) {
+                    stats_.add_errors();
+                    util::log_error("error: fd {}: buffer_pool: out of memory", fd);
+                    return close_connection(fd);
+                }
+            }
+            [[maybe_unused]] std::size_t const queued = conn->out.write(buf + sent, len - sent);
+            assert(queued == len - sent);
+        }
+
+        if (config_.verbose) {
+            buf[bytes_recvd - 1] = '\0'; // NOLINT
+            util::log_info("on_incoming_data fd={}, buf={}", fd, buf);
+        }
     }
 
-    std::println(stderr, "error: on_incoming_connection: Client connected on socket fd: {}",
-            accepted_sock);
+    if (!conn->out.empty() && !conn->write_armed)
+        return set_write_interest(*conn, true);
+
+    return true;
+}
+
 
-    // Successfully connected. Store the new fd.
-    clients_.emplace_back(accepted_sock);
+bool
+tcp_echo_server::on_outgoing_ready(int fd)
+{
+    connection* conn = clients_.find(fd);
+    if (conn == nullptr)
+        return true; // closed earlier in this batch
 
-    // Add the new fd to epoll.
+    flush_status const status = config_.zero_copy ? flush_pipe(*conn) : flush_ring(*conn);
+    if (status == flush_status::Failed)
+        return close_connection(fd);
+    if (status == flush_status::Pending)
+        return true; // wait for next EPOLLOUT
+
+    if (conn->closing)
+        return close_connection(fd);
+
+    // Hand the emptied ring's storage back to the pool rather than
+    // holding 64 KiB per idle connection.
+    conn->out = util::byte_ring();
+
+    if (!set_write_interest(*conn, false))
+        return false;
+
+    // No new edge will arrive for data that was left in the kernel
+    // while reading was paused, so resume reading now.
+    if (conn->read_paused) {
+        conn->read_paused = false;
+        return on_incoming_data(fd);
+    }
+
+    return true;
+}
+
+
+bool
+tcp_echo_server::splice_echo(connection& conn)
+{
+    int const fd = conn.fd;
+
+    // The pipe is always empty at the top of the loop (reading pauses
+    // otherwise), so EAGAIN can only mean the socket has been drained.
+    for (;;) {
+        ::ssize_t const bytes_recvd = ::splice(fd, nullptr, conn.pipe_wr, nullptr,
+                OutputBufferSizeBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (bytes_recvd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+
+            stats_.add_errors();
+
+            util::log_error("error: splice: {}", std::strerror(errno));
+            return close_connection(fd);
+        }
+
+        // Client disconnected
+        if (bytes_recvd == 0) {
+            util::log_info("client on fd {} disconnected", fd);
+            return close_connection(fd);
+        }
+
+        conn.pipe_bytes += static_cast<std::size_t>(bytes_recvd);
+        conn.bytes_recvd += static_cast<std::uint64_t>(bytes_recvd);
+        ++conn.recv_calls;
+        stats_.add(1, static_cast<std::uint64_t>(bytes_recvd));
+        conn.last_active_at = connection::clock::now();
+
+        if (config_.verbose)
+            util::log_info("on_incoming_data fd={}, spliced {} bytes", fd, bytes_recvd);
+
+        flush_status const status = flush_pipe(conn);
+        if (status == flush_status::Failed)
+            return close_connection(fd);
+
+        if (status == flush_status::Pending) {
+            // Peer isn't keeping up. Leave the rest in the kernel until
+            // the pipe drains.
+            conn.read_paused = true;
+            return conn.write_armed || set_write_interest(conn, true);
+        }
+    }
+
+    return true;
+}
+
+
+tcp_echo_server::flush_status
+tcp_echo_server::flush_ring(connection& conn)
+{
+    while (!conn.out.empty()) {
+        std::span<char const> const pending = conn.out.readable();
+        ::ssize_t const bytes_sent
+                = ::send(conn.fd, pending.data(), pending.size(), MSG_NOSIGNAL);
+        if (bytes_sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return flush_status::Pending;
+            if (errno == EINTR)
+                continue;
+
+            stats_.add_errors();
+
+            util::log_error("error: send: {}", std::strerror(errno));
+            return flush_status::Failed;
+        }
+
+        conn.out.consume(static_cast<std::size_t>(bytes_sent));
+        conn.bytes_sent += static_cast<std::uint64_t>(bytes_sent);
+    }
+
+    return flush_status::Drained;
+}
+
+
+tcp_echo_server::flush_status
+tcp_echo_server::flush_pipe(connection& conn)
+{
+    while (conn.pipe_bytes > 0) {
+        ::ssize_t const bytes_sent = ::splice(conn.pipe_rd, nullptr, conn.fd, nullptr,
+                conn.pipe_bytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (bytes_sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return flush_status::Pending;
+            if (errno == EINTR)
+                continue;
+
+            stats_.add_errors();
+
+            util::log_error("error: splice: {}", std::strerror(errno));
+            return flush_status::Failed;
+        }
+
+        conn.pipe_bytes -= static_cast<std::size_t>(bytes_sent);
+        conn.bytes_sent += static_cast<std::uint64_t>(bytes_sent);
+    }
+
+    return flush_status::Drained;
+}
+
+
+bool
+tcp_echo_server::set_write_interest(connection& conn, bool enable)
+{
     epoll_event event{};
-    event.events = (EPOLLIN | EPOLLET);
-    event.data.fd = accepted_sock;
-    if (int rv = ::epoll_ctl(epollfd_, EPOLL_CTL_ADD, accepted_sock, &event); rv == -1) {
-        std::println(stderr, "error: epoll_ctl (EPOLL_CTL_ADD): {}", std::strerror(errno));
+    event.events = enable ? (EPOLLIN | EPOLLOUT | EPOLLET) : (EPOLLIN | EPOLLET);
+    event.data.fd = conn.fd;
+    if (int rv = ::epoll_ctl(epollfd_, EPOLL_CTL_MOD, conn.fd, &event); rv == -1) {
+        util::log_error("error: epoll_ctl (EPOLL_CTL_MOD): {}", std::strerror(errno));
         return false;
     }
 
+    conn.write_armed = enable;
     return true;
 }
 
 
 bool
-tcp_echo_server::on_incoming_data(int fd)
+tcp_echo_server::close_connection(int fd)
 {
-    char buf[IncomingBufferSizeBytes];
+    if (connection const* conn = clients_.find(fd); conn != nullptr && conn->pipe_rd != -1) {
+        ::close(conn->pipe_rd);
+        ::close(conn->pipe_wr);
+    }
+
+    [[maybe_unused]] bool const erased = clients_.erase(fd);
+    assert(erased);
 
-    ::ssize_t const bytes_recvd = ::recv(fd, &buf, sizeof(buf), 0);
-    if (bytes_recvd == -1) {
-        std::println(stderr, "error: recv: {}", std::strerror(errno));
+    if (int rv = ::epoll_ctl(epollfd_, EPOLL_CTL_DEL, fd, nullptr); rv == -1) {
+        util::log_error("error: epoll_ctl (EPOLL_CTL_DEL): {}", std::strerror(errno));
+        ::close(fd);
         return false;
     }
 
-    // Client disconnected
-    if (bytes_recvd == 0) {
-        std::println(stderr, "error: on_incoming_data: client on fd {} disconnected", fd);
+    if (int rv = ::close(fd); rv == -1) {
+        util::log_error("error: close: {}", std::strerror(errno));
+        return false;
+    }
 
-        auto itr = std::find(clients_.begin(), clients_.end(), fd);
-        assert(itr != clients_.end());
-        clients_.erase(itr);
+    // A descriptor, and likely some memory, is free again
+    return accepting_ || resume_accepting();
+}
 
-        epoll_event event{};
-        event.events = (EPOLLIN | EPOLLET);
-        event.data.fd = fd;
-        int const result = ::epoll_ctl(epollfd_, EPOLL_CTL_DEL, fd, &event);
-        if (result == -1) {
-            std::println(stderr, "error: epoll_ctl (EPOLL_CTL_DEL): {}", std::strerror(errno));
-            return false;
-        }
 
-        assert(::close(fd) != -1);
-        return true;
+bool
+tcp_echo_server::pause_accepting()
+{
+    epoll_event event{};
+    event.data.fd = sockfd_;
+    if (::epoll_ctl(epollfd_, EPOLL_CTL_MOD, sockfd_, &event) == -1) {
+        util::log_error("error: epoll_ctl (EPOLL_CTL_MOD): {}", std::strerror(errno));
+        return false;
     }
 
-    // Echo
-    ::ssize_t const bytes_sent = ::send(fd, &buf, static_cast<std::size_t>(bytes_recvd), 0);
-    if (bytes_sent == -1) {
-        std::println(stderr, "error: send: {}", std::strerror(errno));
+    accepting_ = false;
+    resume_accept_ = clock::now() + std::chrono::milliseconds(AcceptRetryMsecs);
+    return true;
+}
+
+
+bool
+tcp_echo_server::resume_accepting()
+{
+    // Edge-triggered, but modifying the registration reports the
+    // listener again if connections are already pending
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = sockfd_;
+    if (::epoll_ctl(epollfd_, EPOLL_CTL_MOD, sockfd_, &event) == -1) {
+        util::log_error("error: epoll_ctl (EPOLL_CTL_MOD): {}", std::strerror(errno));
         return false;
     }
 
-    buf[bytes_recvd - 1] = '\0'; // NOLINT
-    std::println("on_incoming_data fd={}, buf={}", fd, buf);
+    accepting_ = true;
     return true;
 }
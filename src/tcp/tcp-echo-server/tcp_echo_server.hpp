@@ -1,15 +1,37 @@
 #pragma once
 
-#include <vector>
+#include "connection_table.hpp"
+#include "util/buffer_pool.hpp"
+#include "util/stats.hpp"
+#include <chrono>
+#include <cstdint>
 
 
+struct server_config
+{
+    bool zero_copy = false;  ///< echo with splice(2) through a per-connection pipe
+    bool spin = false;       ///< poll epoll in a tight loop instead of blocking
+    int busy_poll_usecs = 0; ///< SO_BUSY_POLL on each connection, 0 to disable
+    bool verbose = false;    ///< print every message received
+};
+
 /*  \class  TcpEchoServer
- *  \brief  FIXME
+ *  \brief  Single-threaded epoll echo server. The listening socket is
+ *          bound with SO_REUSEPORT, so several instances (one per
+ *          worker thread) may listen on the same port and the kernel
+ *          will load-balance incoming connections between them.
+ *          When spinning, epoll_wait is called with a zero timeout so
+ *          the thread never sleeps; combined with SO_BUSY_POLL, the
+ *          non-blocking reads that follow also poll the device queue,
+ *          trading a core for the wakeup latency of every message.
  */
 class tcp_echo_server
 {
 public:
-    tcp_echo_server();
+    /// \param stats Updated for every message and error; only by the
+    ///        thread that calls run()
+    /// \throws std::exception On error
+    tcp_echo_server(std::uint16_t port, server_config const& config, util::stat_counters& stats);
     ~tcp_echo_server();
 
     // No copies/moves
@@ -27,24 +49,71 @@ private:
     /// \return \c false on error
     bool on_incoming_connection(int fd);
 
-    /// Called on incoming data
+    /// Called on incoming data. Reads until the socket would block,
+    /// echoing as it goes and queuing anything send() doesn't accept.
     /// \return \c false on error
     bool on_incoming_data(int fd);
 
+    /// Called when a socket with queued output becomes writable
+    /// \return \c false on error
+    bool on_outgoing_ready(int fd);
+
+    /// Zero-copy counterpart of on_incoming_data: moves data from the
+    /// socket into the connection's pipe and from there back out to
+    /// the socket.
+    /// \return \c false on error
+    bool splice_echo(connection& conn);
+
+    enum class flush_status
+    {
+        Drained, ///< nothing left to send
+        Pending, ///< socket would block, data remains queued
+        Failed,  ///< socket error
+    };
+
+    /// Send queued output until empty or the socket would block
+    flush_status flush_ring(connection& conn);
+    flush_status flush_pipe(connection& conn);
+
+    /// Add or remove EPOLLOUT from the events registered for conn
+    /// \return \c false on error
+    bool set_write_interest(connection& conn, bool enable);
+
+    /// Remove fd from epoll and the connection table and close it
+    /// \return \c false on error
+    bool close_connection(int fd);
+
+    /// Stop watching the listener, until a client goes or
+    /// AcceptRetryMsecs have passed
+    /// \return \c false on error
+    bool pause_accepting();
+
+    /// \return \c false on error
+    bool resume_accepting();
+
 private:
+    using clock = std::chrono::steady_clock;
+
     enum
     {
-        ListenBacklog = 10,             ///< max num of pending connections
-        EpollMaxEvents = 20,            ///< max num of pending epoll events
-        EpollTimeoutMsecs = 10,         ///< num of milliseconds to block on epoll_wait
-        IncomingBufferSizeBytes = 1024, ///< size of recv buffer
-        ListenPort = 42483,             ///< default listening port
+        ListenBacklog = 10,              ///< max num of pending connections
+        EpollMaxEvents = 20,             ///< max num of pending epoll events
+        EpollTimeoutMsecs = 10,          ///< num of milliseconds to block on epoll_wait
+        IncomingBufferSizeBytes = 65536, ///< size of recv buffer
+        OutputBufferSizeBytes = 65536,   ///< max num of queued bytes per connection
+        AcceptRetryMsecs = 100,          ///< how long to stop accepting when out of fds
     };
 
 private:
-    int port_{ListenPort};     ///< port to listen on
-    int sockfd_{-1};           ///< listening socket
-    int epollfd_{-1};          ///< epoll file descriptor
-    std::vector<int> clients_; ///< list of client connected sockets
+    std::uint16_t port_{0};           ///< port to listen on
+    server_config config_;            ///< zero-copy, spinning and busy-poll settings
+    bool prefer_busy_poll_{false};    ///< SO_PREFER_BUSY_POLL permitted, so set on connections
+    util::stat_counters& stats_;      ///< msgs, bytes and errors of this server
+    int sockfd_{-1};                  ///< listening socket
+    int epollfd_{-1};                 ///< epoll file descriptor
+    connection_table clients_;        ///< connected clients, indexed by fd
+    util::pooled_buffer in_buf_;      ///< recv buffer, shared by all connections
+    bool accepting_{true};            ///< listener is watched for connections
+    clock::time_point resume_accept_; ///< when to accept again, if not accepting_
 
 }; // class TcpEchoServer
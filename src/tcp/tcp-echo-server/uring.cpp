@@ -0,0 +1,234 @@
+#include "uring.hpp"
+#include <sys/mman.h>    // ::mmap, ::munmap
+#include <sys/syscall.h> // __NR_io_uring_*
+#include <unistd.h>      // ::close, ::syscall
+#include <algorithm>     // std::max
+#include <cerrno>
+#include <cstring> // std::memset, std::strerror
+#include <stdexcept>
+#include <string>
+
+
+namespace {
+    int
+    io_uring_setup(unsigned entries, io_uring_params* params)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int
+    io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return static_cast<int>(
+                ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int
+    io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    template <typename T>
+    T*
+    at_offset(void* base, std::uint32_t offset)
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+
+    void*
+    map_or_throw(std::size_t size, int fd, off_t offset, char const* what)
+    {
+        int const flags = (fd == -1) ? (MAP_PRIVATE | MAP_ANONYMOUS) : (MAP_SHARED | MAP_POPULATE);
+        void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, offset);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error(std::string("mmap (") + what + "): " + std::strerror(errno));
+        return addr;
+    }
+
+} // namespace
+
+
+uring::uring(unsigned entries)
+{
+    // Completions are only ever reaped by the thread that submits, so
+    // let the kernel defer task work until we ask for completions.
+    // Fall back to default behavior on kernels that predate these flags.
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4; // multishot ops post many completions per submission
+    fd_ = io_uring_setup(entries, &params);
+    if (fd_ == -1 && errno == EINVAL) {
+        params = io_uring_params{};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        fd_ = io_uring_setup(entries, &params);
+    }
+    if (fd_ == -1)
+        throw std::runtime_error(std::string("io_uring_setup: ") + std::strerror(errno));
+
+    try {
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        // Since 5.4 both rings live in a single mapping
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+            sq_ring_ = map_or_throw(sq_ring_size_, fd_, IORING_OFF_SQ_RING, "sq ring");
+            cq_ring_ = sq_ring_;
+        } else {
+            sq_ring_ = map_or_throw(sq_ring_size_, fd_, IORING_OFF_SQ_RING, "sq ring");
+            cq_ring_ = map_or_throw(cq_ring_size_, fd_, IORING_OFF_CQ_RING, "cq ring");
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map_or_throw(sqes_size_, fd_, IORING_OFF_SQES, "sqes"));
+    } catch (...) {
+        release();
+        throw;
+    }
+
+    sq_head_ = at_offset<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = at_offset<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_array_ = at_offset<unsigned>(sq_ring_, params.sq_off.array);
+    sq_mask_ = *at_offset<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sqe_tail_ = *sq_tail_;
+
+    // Submission entries are used in order, so the indirection array
+    // is a fixed identity mapping.
+    for (unsigned i = 0; i < sq_entries_; ++i)
+        sq_array_[i] = i;
+
+    cq_head_ = at_offset<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = at_offset<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *at_offset<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = at_offset<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+}
+
+
+uring::~uring()
+{
+    release();
+}
+
+
+void
+uring::release()
+{
+    if (buffers_ != nullptr)
+        ::munmap(buffers_, buffers_size_);
+    if (buf_ring_ != nullptr)
+        ::munmap(buf_ring_, buf_ring_size_);
+    if (sqes_ != nullptr)
+        ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+        ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != nullptr)
+        ::munmap(sq_ring_, sq_ring_size_);
+    if (fd_ != -1)
+        ::close(fd_);
+
+    buffers_ = nullptr;
+    buf_ring_ = nullptr;
+    sqes_ = nullptr;
+    cq_ring_ = sq_ring_ = nullptr;
+    fd_ = -1;
+}
+
+
+bool
+uring::supports(std::initializer_list<io_uring_op> ops) const
+{
+    constexpr std::size_t MaxOps = 256;
+    alignas(io_uring_probe) char buf[sizeof(io_uring_probe) + MaxOps * sizeof(io_uring_probe_op)]
+            = {};
+    auto* const probe = reinterpret_cast<io_uring_probe*>(buf);
+    if (io_uring_register(fd_, IORING_REGISTER_PROBE, probe, MaxOps) == -1)
+        return false; // predates probing (5.6), and so every op we need
+
+    for (io_uring_op const op : ops) {
+        if (op >= probe->ops_len || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0)
+            return false;
+    }
+    return true;
+}
+
+
+io_uring_sqe*
+uring::get_sqe()
+{
+    if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        if (submit_and_wait(0) < 0)
+            return nullptr;
+        if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+            return nullptr;
+    }
+
+    io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    ++sqe_tail_;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+
+int
+uring::submit_and_wait(unsigned wait_nr)
+{
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    unsigned const to_submit = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+    // GETEVENTS is needed even when not waiting so that deferred task
+    // work (and therefore completions) gets run.
+    int const rv = io_uring_enter(fd_, to_submit, wait_nr, IORING_ENTER_GETEVENTS);
+    if (rv == -1)
+        return -errno;
+    return rv;
+}
+
+
+void
+uring::setup_buffers(std::uint16_t bgid, unsigned count, std::size_t buf_size)
+{
+    if (count == 0 || count > 32768 || (count & (count - 1)) != 0)
+        throw std::runtime_error("setup_buffers: count must be a power of two <= 32768");
+
+    buf_ring_size_ = count * sizeof(io_uring_buf);
+    buf_ring_ = static_cast<io_uring_buf_ring*>(
+            map_or_throw(buf_ring_size_, -1, 0, "provided buffer ring"));
+    buf_mask_ = count - 1;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<std::uint64_t>(buf_ring_);
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+    if (int rv = io_uring_register(fd_, IORING_REGISTER_PBUF_RING, &reg, 1); rv == -1) {
+        throw std::runtime_error(
+                std::string("io_uring_register (IORING_REGISTER_PBUF_RING): ")
+                + std::strerror(errno));
+    }
+
+    buf_size_ = buf_size;
+    buffers_size_ = count * buf_size;
+    buffers_ = static_cast<char*>(map_or_throw(buffers_size_, -1, 0, "provided buffers"));
+
+    for (unsigned bid = 0; bid < count; ++bid)
+        recycle_buffer(static_cast<std::uint16_t>(bid));
+}
+
+
+void
+uring::recycle_buffer(std::uint16_t bid)
+{
+    // The ring tail overlays the reserved field of the first entry, so
+    // entries must be filled in field by field. Entries are addressed
+    // from the start of the ring rather than through the bufs member:
+    // some uapi headers declare it with an empty struct in front, which
+    // is one byte (not zero) in c++ and shifts bufs to offset 8.
+    std::uint16_t const tail = buf_ring_->tail;
+    io_uring_buf& buf = reinterpret_cast<io_uring_buf*>(buf_ring_)[tail & buf_mask_];
+    buf.addr = reinterpret_cast<std::uint64_t>(buffer(bid));
+    buf.len = static_cast<std::uint32_t>(buf_size_);
+    buf.bid = bid;
+    __atomic_store_n(&buf_ring_->tail, static_cast<std::uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
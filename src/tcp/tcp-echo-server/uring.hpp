@@ -0,0 +1,119 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+
+/*  \class  uring
+ *  \brief  Minimal io_uring wrapper built directly on the kernel
+ *          interface (no liburing). Owns the submission and completion
+ *          rings and, optionally, one provided-buffer ring used for
+ *          buffer selection by recv.
+ */
+class uring
+{
+public:
+    /// \throws std::exception If io_uring is unavailable or setup fails
+    explicit uring(unsigned entries);
+    ~uring();
+
+    // No copies/moves
+    uring(uring const&) = delete;
+    uring(uring&&) = delete;
+    uring& operator=(uring const&) = delete;
+    uring&& operator=(uring&&) = delete;
+
+    /// \return \c true if the kernel supports every one of ops
+    bool supports(std::initializer_list<io_uring_op> ops) const;
+
+    /// Next free submission entry, zeroed. Submits pending entries to
+    /// make room if the submission queue is full.
+    /// \return \c nullptr on error
+    io_uring_sqe* get_sqe();
+
+    /// \return Num of submission entries available without submitting
+    unsigned
+    sq_space_left() const
+    {
+        return sq_entries_ - (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE));
+    }
+
+    /// Submit pending entries and wait for at least wait_nr completions
+    /// \return Num of entries submitted, or -errno on error
+    int submit_and_wait(unsigned wait_nr);
+
+    /// Invoke fn on each available completion, then release them all
+    /// back to the kernel
+    /// \return Num of completions processed
+    template <typename Fn>
+    unsigned
+    for_each_cqe(Fn&& fn)
+    {
+        unsigned head = *cq_head_;
+        unsigned const tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned n = 0;
+        for (; head != tail; ++head, ++n)
+            fn(cqes_[head & cq_mask_]);
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    /// Register a provided-buffer ring of count buffers (a power of two)
+    /// of buf_size bytes each, as buffer group bgid. Buffers are
+    /// identified by index [0, count).
+    /// \throws std::exception On error
+    void setup_buffers(std::uint16_t bgid, unsigned count, std::size_t buf_size);
+
+    /// \return Address of buffer bid
+    char*
+    buffer(std::uint16_t bid) const
+    {
+        return buffers_ + static_cast<std::size_t>(bid) * buf_size_;
+    }
+
+    std::size_t
+    buffer_size() const
+    {
+        return buf_size_;
+    }
+
+    /// Hand buffer bid back to the kernel for use by future recvs
+    void recycle_buffer(std::uint16_t bid);
+
+private:
+    /// Unmap everything and close the ring
+    void release();
+
+private:
+    int fd_{-1}; ///< io_uring file descriptor
+
+    // submission queue
+    void* sq_ring_{nullptr};
+    std::size_t sq_ring_size_{0};
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned* sq_array_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned sq_entries_{0};
+    io_uring_sqe* sqes_{nullptr};
+    std::size_t sqes_size_{0};
+    unsigned sqe_tail_{0}; ///< local tail, published on submit
+
+    // completion queue
+    void* cq_ring_{nullptr};
+    std::size_t cq_ring_size_{0};
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    io_uring_cqe* cqes_{nullptr};
+
+    // provided buffers
+    io_uring_buf_ring* buf_ring_{nullptr};
+    std::size_t buf_ring_size_{0};
+    unsigned buf_mask_{0};
+    char* buffers_{nullptr};
+    std::size_t buffers_size_{0};
+    std::size_t buf_size_{0};
+};
@@ -0,0 +1,502 @@
+#include "uring_echo_server.hpp"
+#include "listen_socket.hpp"
+#include "util/logger.hpp"
+#include <sys/socket.h> // ::listen, ::shutdown, ::socketpair, MSG_*
+#include <unistd.h>     // ::close, ::write
+#include <algorithm>    // std::min
+#include <cassert>
+#include <cerrno>
+#include <cstring> // std::strerror
+#include <print>
+#include <stdexcept> // std::runtime_error
+#include <string>
+
+
+namespace {
+    // user_data layout: | op (8) | generation (24) | fd (32) |
+    constexpr std::uint64_t
+    make_user_data(std::uint8_t op, std::uint32_t gen, int fd)
+    {
+        return (static_cast<std::uint64_t>(op) << 56)
+                | (static_cast<std::uint64_t>(gen & 0xffffffU) << 32)
+                | static_cast<std::uint32_t>(fd);
+    }
+
+    constexpr std::uint8_t
+    user_data_op(std::uint64_t user_data)
+    {
+        return static_cast<std::uint8_t>(user_data >> 56);
+    }
+
+    constexpr std::uint32_t
+    user_data_gen(std::uint64_t user_data)
+    {
+        return static_cast<std::uint32_t>(user_data >> 32) & 0xffffffU;
+    }
+
+    constexpr int
+    user_data_fd(std::uint64_t user_data)
+    {
+        return static_cast<int>(static_cast<std::uint32_t>(user_data));
+    }
+
+} // namespace
+
+
+uring_echo_server::uring_echo_server(std::uint16_t port, util::stat_counters& stats)
+        : port_(port)
+        , stats_(stats)
+        , ring_(RingEntries)
+        , conns_()
+        , starved_()
+{
+    // 5.19 has buffer rings and multishot accept, but not multishot
+    // recv, which every connection needs
+    if (!ring_.supports({IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND,
+                IORING_OP_ASYNC_CANCEL, IORING_OP_TIMEOUT}))
+        throw std::runtime_error("io_uring ops unsupported");
+    ring_.setup_buffers(BufferGroup, BufferCount, BufferSizeBytes);
+    check_multishot_recv();
+
+    accept_retry_.tv_nsec = AcceptRetryMsecs * 1'000'000L;
+    sockfd_ = open_listen_socket(port_);
+}
+
+
+uring_echo_server::~uring_echo_server()
+{
+    ::close(sockfd_);
+
+    for (std::size_t fd = 0; fd < conns_.size(); ++fd) {
+        if (conns_[fd].open)
+            ::close(static_cast<int>(fd));
+    }
+}
+
+
+bool
+uring_echo_server::run()
+{
+    // Start listening
+    if (int rv = ::listen(sockfd_, ListenBacklog); rv == -1) {
+        std::println(stderr, "error: listen: {}", std::strerror(errno));
+        return false;
+    }
+    std::println("listening on port {} (io_uring)", port_);
+
+    if (!arm_accept())
+        return false;
+
+    for (;;) {
+        int const rv = ring_.submit_and_wait(1);
+        if (rv < 0 && rv != -EINTR && rv != -EAGAIN && rv != -EBUSY) {
+            util::log_error("error: io_uring_enter: {}", std::strerror(-rv));
+            return false;
+        }
+
+        bool ok = true;
+        ring_.for_each_cqe([this, &ok](io_uring_cqe const& cqe) {
+            if (!ok)
+                return;
+
+            int const fd = user_data_fd(cqe.user_data);
+            auto const type = static_cast<op>(user_data_op(cqe.user_data));
+            switch (type) {
+                case op::Accept:
+                    ok = on_accept(cqe);
+                    break;
+                case op::Recv:
+                    ok = on_recv(fd, cqe);
+                    break;
+                case op::Send:
+                    ok = on_send(fd, cqe);
+                    break;
+                case op::Cancel:
+                    break; // nothing to do; the recv itself completes with -ECANCELED
+                case op::AcceptRetry:
+                    ok = arm_accept();
+                    break;
+                case op::Probe:
+                    break; // all reaped by check_multishot_recv()
+                default:
+                    assert(false);
+                    break;
+            }
+        });
+        if (!ok)
+            return false;
+
+        // Connections that ran the buffer ring dry get another go once
+        // some buffers have been handed back.
+        if (buffers_recycled_ && !starved_.empty()) {
+            std::vector<int> starved;
+            starved.swap(starved_);
+            for (int fd : starved) {
+                conn_state const& conn = conns_[static_cast<std::size_t>(fd)];
+                if (conn.open && !conn.recv_armed && !conn.eof && !conn.failed
+                        && queued(conn) < MaxQueuedPerConn) {
+                    if (!arm_recv(fd))
+                        return false;
+                }
+            }
+        }
+        buffers_recycled_ = false;
+    }
+
+    return true;
+}
+
+
+void
+uring_echo_server::check_multishot_recv()
+{
+    int fds[2] = {-1, -1};
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, static_cast<int*>(fds)) == -1)
+        throw std::runtime_error(std::string("socketpair: ") + std::strerror(errno));
+
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (sqe == nullptr) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        throw std::runtime_error("check_multishot_recv: submission queue full");
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fds[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BufferGroup;
+    sqe->user_data = make_user_data(static_cast<std::uint8_t>(op::Probe), 0, fds[0]);
+
+    // A byte, then eof: a kernel with multishot recv completes with the
+    // byte and keeps the recv armed until the eof ends it; one without
+    // fails it at once with -EINVAL
+    char const byte = 'x';
+    bool ok = ::write(fds[1], &byte, 1) == 1;
+    ::close(fds[1]);
+
+    bool done = false;
+    bool multishot = false;
+    while (ok && !done) {
+        if (int rv = ring_.submit_and_wait(1); rv < 0 && rv != -EINTR) {
+            ok = false;
+            break;
+        }
+        ring_.for_each_cqe([this, &done, &multishot](io_uring_cqe const& cqe) {
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                auto const bid = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                ring_.recycle_buffer(bid);
+            }
+            if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_MORE))
+                multishot = true;
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+                done = true;
+        });
+    }
+    ::close(fds[0]);
+
+    if (!ok || !multishot)
+        throw std::runtime_error("multishot recv unsupported");
+}
+
+
+bool
+uring_echo_server::arm_accept()
+{
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (sqe == nullptr) {
+        util::log_error("error: arm_accept: submission queue full");
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = sockfd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = make_user_data(static_cast<std::uint8_t>(op::Accept), 0, sockfd_);
+    return true;
+}
+
+
+bool
+uring_echo_server::arm_accept_retry()
+{
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (sqe == nullptr) {
+        util::log_error("error: arm_accept_retry: submission queue full");
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&accept_retry_);
+    sqe->len = 1;
+    sqe->user_data = make_user_data(static_cast<std::uint8_t>(op::AcceptRetry), 0, sockfd_);
+    return true;
+}
+
+
+bool
+uring_echo_server::arm_recv(int fd)
+{
+    conn_state& conn = conns_[static_cast<std::size_t>(fd)];
+
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (sqe == nullptr) {
+        util::log_error("error: arm_recv: submission queue full");
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BufferGroup;
+    sqe->user_data = make_user_data(static_cast<std::uint8_t>(op::Recv), conn.gen, fd);
+
+    conn.recv_armed = true;
+    return true;
+}
+
+
+bool
+uring_echo_server::cancel_recv(int fd)
+{
+    conn_state& conn = conns_[static_cast<std::size_t>(fd)];
+    if (conn.cancelling)
+        return true;
+
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (sqe == nullptr) {
+        util::log_error("error: cancel_recv: submission queue full");
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = make_user_data(static_cast<std::uint8_t>(op::Recv), conn.gen, fd);
+    sqe->user_data = make_user_data(static_cast<std::uint8_t>(op::Cancel), conn.gen, fd);
+
+    conn.cancelling = true;
+    return true;
+}
+
+
+bool
+uring_echo_server::submit_sends(int fd)
+{
+    conn_state& conn = conns_[static_cast<std::size_t>(fd)];
+    assert(conn.inflight == 0);
+
+    // Sends for one socket must not overtake each other, so the queue
+    // goes out as a single chain. MSG_WAITALL turns a short send into a
+    // chain break; the rest of the chain is then cancelled and
+    // resubmitted from where the short send left off. A chain must not
+    // be split across submissions, so make room for all of it first.
+    std::size_t const count = std::min<std::size_t>(queued(conn), MaxChainLength);
+    if (ring_.sq_space_left() < count) {
+        if (int rv = ring_.submit_and_wait(0); rv < 0 && rv != -EINTR) {
+            util::log_error("error: submit_sends: io_uring_enter: {}", std::strerror(-rv));
+            return false;
+        }
+    }
+    if (ring_.sq_space_left() < count) {
+        util::log_error("error: submit_sends: submission queue full");
+        return false;
+    }
+
+    std::size_t const end = conn.head + count;
+    for (std::size_t i = conn.head; i < end; ++i) {
+        pending_send const& entry = conn.queue[i];
+
+        io_uring_sqe* sqe = ring_.get_sqe();
+        assert(sqe != nullptr);
+
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<std::uint64_t>(ring_.buffer(entry.bid) + entry.offset);
+        sqe->len = entry.len - entry.offset;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->flags = (i + 1 < end) ? IOSQE_IO_LINK : 0;
+        sqe->user_data = make_user_data(static_cast<std::uint8_t>(op::Send), conn.gen, fd);
+        ++conn.inflight;
+    }
+
+    return true;
+}
+
+
+bool
+uring_echo_server::on_accept(io_uring_cqe const& cqe)
+{
+    if (cqe.res < 0) {
+        util::log_error("error: accept: {}", std::strerror(-cqe.res));
+        stats_.add_errors();
+
+        // Out of descriptors or memory. The connection is still pending,
+        // so accepting again straight away would fail again straight
+        // away; wait a while instead.
+        bool const exhausted = cqe.res == -EMFILE || cqe.res == -ENFILE || cqe.res == -ENOBUFS
+                || cqe.res == -ENOMEM;
+        if (exhausted && !(cqe.flags & IORING_CQE_F_MORE))
+            return arm_accept_retry();
+    } else {
+        int const fd = cqe.res;
+        util::log_info("client connected on fd {}", fd);
+
+        auto const ufd = static_cast<std::size_t>(fd);
+        if (ufd >= conns_.size())
+            conns_.resize(ufd + 1);
+
+        conn_state& conn = conns_[ufd];
+        conn.open = true;
+        conn.eof = false;
+        conn.failed = false;
+        conn.cancelling = false;
+        conn.inflight = 0;
+        conn.head = 0;
+        conn.queue.clear();
+
+        if (!arm_recv(fd))
+            return false;
+    }
+
+    // Multishot accept stays armed unless the kernel says otherwise
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+        return arm_accept();
+
+    return true;
+}
+
+
+bool
+uring_echo_server::on_recv(int fd, io_uring_cqe const& cqe)
+{
+    conn_state& conn = conns_[static_cast<std::size_t>(fd)];
+    assert(conn.open && user_data_gen(cqe.user_data) == (conn.gen & 0xffffffU));
+
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        conn.recv_armed = false;
+        conn.cancelling = false;
+    }
+
+    if (cqe.res > 0) {
+        assert(cqe.flags & IORING_CQE_F_BUFFER);
+        stats_.add(1, static_cast<std::uint64_t>(cqe.res));
+        auto const bid = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+        if (conn.failed) {
+            ring_.recycle_buffer(bid);
+            buffers_recycled_ = true;
+        } else {
+            conn.queue.emplace_back(pending_send{bid, 0, static_cast<std::uint32_t>(cqe.res)});
+        }
+
+        // Backpressure: stop receiving from a peer that isn't reading
+        // its echoes. Receiving resumes once the queue drains.
+        if (conn.recv_armed && queued(conn) >= MaxQueuedPerConn) {
+            if (!cancel_recv(fd))
+                return false;
+        }
+    } else if (cqe.res == 0) {
+        util::log_info("client on fd {} disconnected", fd);
+        conn.eof = true;
+    } else if (cqe.res == -ENOBUFS) {
+        // Every provided buffer is waiting to be echoed
+        starved_.emplace_back(fd);
+    } else if (cqe.res != -ECANCELED) {
+        util::log_error("error: recv: {}", std::strerror(-cqe.res));
+        stats_.add_errors();
+        conn.failed = true;
+    }
+
+    if (conn.inflight == 0 && queued(conn) > 0 && !conn.failed) {
+        if (!submit_sends(fd))
+            return false;
+    }
+
+    // The multishot recv can end for reasons other than the ones above
+    // (e.g., a completion queue overflow, or a backpressure cancel
+    // racing with the queue draining). Re-arm if nothing is holding it
+    // back.
+    if (!conn.recv_armed && !conn.eof && !conn.failed && cqe.res != -ENOBUFS
+            && queued(conn) < MaxQueuedPerConn) {
+        if (!arm_recv(fd))
+            return false;
+    }
+
+    maybe_close(fd);
+    return true;
+}
+
+
+bool
+uring_echo_server::on_send(int fd, io_uring_cqe const& cqe)
+{
+    conn_state& conn = conns_[static_cast<std::size_t>(fd)];
+    assert(conn.open && conn.inflight > 0);
+    --conn.inflight;
+
+    if (cqe.res >= 0) {
+        // Chained sends complete in order, and one short send cancels
+        // the rest, so a successful send always belongs to the front.
+        pending_send& front = conn.queue[conn.head];
+        front.offset += static_cast<std::uint32_t>(cqe.res);
+        if (front.offset == front.len) {
+            ring_.recycle_buffer(front.bid);
+            buffers_recycled_ = true;
+            ++conn.head;
+        }
+    } else if (cqe.res != -ECANCELED) {
+        util::log_error("error: send: {}", std::strerror(-cqe.res));
+        stats_.add_errors();
+        conn.failed = true;
+    }
+
+    if (conn.inflight > 0)
+        return true; // rest of chain still outstanding
+
+    if (conn.head == conn.queue.size()) {
+        conn.head = 0;
+        conn.queue.clear();
+    }
+
+    if (conn.failed) {
+        if (conn.recv_armed && !cancel_recv(fd))
+            return false;
+    } else if (queued(conn) > 0) {
+        if (!submit_sends(fd))
+            return false;
+    } else if (!conn.recv_armed && !conn.eof) {
+        // Queue drained after backpressure (or buffer starvation)
+        if (!arm_recv(fd))
+            return false;
+    }
+
+    maybe_close(fd);
+    return true;
+}
+
+
+void
+uring_echo_server::maybe_close(int fd)
+{
+    conn_state& conn = conns_[static_cast<std::size_t>(fd)];
+    if (!conn.eof && !conn.failed)
+        return;
+    if (conn.recv_armed || conn.inflight > 0)
+        return;
+
+    // A failed socket won't take its echo, so hand the buffers back
+    if (conn.failed) {
+        for (std::size_t i = conn.head; i < conn.queue.size(); ++i)
+            ring_.recycle_buffer(conn.queue[i].bid);
+        buffers_recycled_ = true;
+        conn.head = 0;
+        conn.queue.clear();
+    }
+    if (queued(conn) > 0)
+        return;
+
+    ::close(fd);
+    conn.open = false;
+    ++conn.gen;
+}
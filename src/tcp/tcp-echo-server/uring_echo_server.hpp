@@ -0,0 +1,124 @@
+#pragma once
+
+#include "uring.hpp"
+#include "util/stats.hpp"
+#include <linux/time_types.h> // __kernel_timespec
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/*  \class  uring_echo_server
+ *  \brief  Single-threaded echo server driven by io_uring instead of
+ *          epoll. Connections are accepted with one multishot accept,
+ *          data arrives through a multishot recv per connection into
+ *          kernel-selected buffers from a provided-buffer ring, and
+ *          each received buffer is echoed back with a send before being
+ *          returned to the ring. Queued sends for a connection are
+ *          submitted as one linked chain so they go out in order.
+ *          Requires Linux 6.0 or later; the constructor checks that
+ *          the kernel has everything needed, so that a caller can fall
+ *          back before any connection is accepted.
+ */
+class uring_echo_server
+{
+public:
+    /// \param stats Updated for every message and error; only by the
+    ///        thread that calls run()
+    /// \throws std::exception If io_uring, or any op or feature used,
+    ///         is unavailable
+    uring_echo_server(std::uint16_t port, util::stat_counters& stats);
+    ~uring_echo_server();
+
+    // No copies/moves
+    uring_echo_server(uring_echo_server const&) = delete;
+    uring_echo_server(uring_echo_server&&) = delete;
+    uring_echo_server& operator=(uring_echo_server const&) = delete;
+    uring_echo_server&& operator=(uring_echo_server&&) = delete;
+
+    /// Start the server and begin listening on socket.
+    /// \return \c false on error
+    bool run();
+
+private:
+    enum class op : std::uint8_t
+    {
+        Accept = 1,
+        Recv,
+        Send,
+        Cancel,
+        AcceptRetry, ///< timeout before accepting again
+        Probe,       ///< recv issued by check_multishot_recv()
+    };
+
+    /// A received buffer waiting to be echoed
+    struct pending_send
+    {
+        std::uint16_t bid = 0;    ///< provided buffer id
+        std::uint32_t offset = 0; ///< num of bytes already sent
+        std::uint32_t len = 0;    ///< num of bytes received
+    };
+
+    struct conn_state
+    {
+        bool open = false;
+        bool recv_armed = false;         ///< multishot recv outstanding
+        bool cancelling = false;         ///< cancel of recv outstanding
+        bool eof = false;                ///< peer shut down, close once queue drains
+        bool failed = false;             ///< socket error, close once idle
+        std::uint32_t gen = 0;           ///< bumped on close to detect stale completions
+        unsigned inflight = 0;           ///< num of sends submitted, not completed
+        std::size_t head = 0;            ///< index of first entry in queue
+        std::vector<pending_send> queue; ///< received buffers, in order
+    };
+
+    /// Multishot recv (6.0) can't be probed for like an opcode, so try
+    /// one on a socketpair
+    /// \throws std::exception If unsupported
+    void check_multishot_recv();
+
+    /// \return \c false on error
+    bool arm_accept();
+    bool arm_accept_retry();
+    bool arm_recv(int fd);
+    bool cancel_recv(int fd);
+    bool submit_sends(int fd);
+
+    /// \return \c false on error
+    bool on_accept(io_uring_cqe const&);
+    bool on_recv(int fd, io_uring_cqe const&);
+    bool on_send(int fd, io_uring_cqe const&);
+
+    /// Close fd if it has no outstanding operations and nothing left
+    /// to send
+    void maybe_close(int fd);
+
+    std::size_t
+    queued(conn_state const& conn) const
+    {
+        return conn.queue.size() - conn.head;
+    }
+
+private:
+    enum
+    {
+        ListenBacklog = 10,     ///< max num of pending connections
+        RingEntries = 1024,     ///< num of submission queue entries
+        BufferGroup = 0,        ///< provided buffer group id
+        BufferCount = 4096,     ///< num of provided buffers (power of two)
+        BufferSizeBytes = 4096, ///< size of each provided buffer
+        MaxQueuedPerConn = 16,  ///< stop receiving once this many buffers await echo
+        MaxChainLength = 64,    ///< max num of linked sends submitted at once
+        AcceptRetryMsecs = 100, ///< how long to stop accepting when out of fds
+    };
+
+private:
+    std::uint16_t port_{0};            ///< port to listen on
+    util::stat_counters& stats_;       ///< msgs, bytes and errors of this server
+    int sockfd_{-1};                   ///< listening socket
+    uring ring_;                       ///< submission/completion rings
+    std::vector<conn_state> conns_;    ///< per-connection state, indexed by fd
+    std::vector<int> starved_;         ///< fds whose recv ran out of buffers
+    bool buffers_recycled_{false};     ///< buffers returned since starved_ was last retried
+    __kernel_timespec accept_retry_{}; ///< read by the kernel when the timeout is submitted
+};
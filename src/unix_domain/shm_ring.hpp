@@ -0,0 +1,421 @@
+#pragma once
+
+#include "util/concurrency.hpp"
+#include <fcntl.h>       // ::fcntl, F_ADD_SEALS, F_GET_SEALS, F_SETFL
+#include <sys/eventfd.h> // ::eventfd, ::eventfd_read, ::eventfd_write
+#include <sys/mman.h>    // ::memfd_create, ::mmap, ::munmap
+#include <sys/socket.h>  // ::recvmsg, ::sendmsg, SCM_RIGHTS
+#include <sys/stat.h>    // ::fstat
+#include <unistd.h>      // ::close, ::ftruncate, ::readlink
+#include <algorithm>     // std::min
+#include <array>
+#include <atomic>
+#include <bit> // std::bit_ceil, std::has_single_bit
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcpy, std::strerror
+#include <new>     // std::launder
+#include <span>
+#include <stdexcept> // std::runtime_error
+#include <string>
+#include <string_view>
+
+
+/// Same-host transport for unix-client and unix-server. The client
+/// creates a byte ring in a memfd and sends the memfd, along with two
+/// eventfds, over the unix socket (SCM_RIGHTS). From then on it reads
+/// stdin straight into the shared ring and the server parses messages
+/// straight out of it, so data is never copied through a socket buffer
+/// and nothing is signalled while the server keeps up; an eventfd is
+/// only written when the other side has said it is going to sleep.
+namespace shm {
+    constexpr std::uint32_t Magic = 0x474e5253; ///< "SRNG"
+    constexpr std::uint32_t Version = 1;
+
+    /// Sent, with the descriptors, as the first bytes on the socket
+    struct hello
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+    };
+
+    /// Start of the shared memory; the data follows on the next page.
+    /// Both processes update it, so only lock-free atomics may be used.
+    struct control
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t capacity; ///< num of data bytes, a power of two
+
+        alignas(util::CacheLineSize) std::atomic<std::uint64_t> tail; ///< total bytes committed
+        std::atomic<std::uint32_t> producer_waiting; ///< producer sleeps until space_fd is written
+
+        alignas(util::CacheLineSize) std::atomic<std::uint64_t> head; ///< total bytes consumed
+        std::atomic<std::uint32_t> consumer_waiting; ///< consumer sleeps until data_fd is written
+    };
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+    /*  \class  ring
+     *  \brief  Single-producer, single-consumer byte ring in shared
+     *          memory, with one process on each side. Data is accessed
+     *          in place through writable()/readable(), which return the
+     *          largest contiguous region at the back/front of the ring.
+     *          Before blocking, a side arms its wakeup and then checks
+     *          the ring once more; the other side writes the eventfd
+     *          only if it sees the wakeup armed, so while both keep up
+     *          no system calls are made at all.
+     */
+    class ring
+    {
+    public:
+        /// Page holding the control block
+        static constexpr std::size_t DataOffset = 4096;
+
+        /// Creates the shared memory and eventfds (the producer's side)
+        /// \throws std::runtime_error On error
+        explicit ring(std::size_t capacity)
+        {
+            capacity = std::bit_ceil(capacity < DataOffset ? DataOffset : capacity);
+            try {
+                memfd_ = ::memfd_create("shm_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+                if (memfd_ == -1)
+                    fail("memfd_create");
+                if (::ftruncate(memfd_, static_cast<off_t>(DataOffset + capacity)) == -1)
+                    fail("ftruncate");
+
+                // The consumer can't be made to fault (SIGBUS) by the
+                // memory shrinking under it
+                if (::fcntl(memfd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+                        == -1)
+                    fail("fcntl(F_ADD_SEALS)");
+
+                data_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                space_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                if (data_fd_ == -1 || space_fd_ == -1)
+                    fail("eventfd");
+
+                map(DataOffset + capacity);
+                auto* const ctl = new (base_) control{};
+                ctl->magic = Magic;
+                ctl->version = Version;
+                ctl->capacity = capacity;
+                ctl_ = ctl;
+                mask_ = capacity - 1;
+            } catch (...) {
+                release();
+                throw;
+            }
+        }
+
+        /// Adopts the descriptors sent by a producer, taking ownership
+        /// of them even on error (the consumer's side). The producer is
+        /// another process, so every descriptor is checked to be what
+        /// it claims before it is used.
+        /// \throws std::runtime_error On error or if the memory isn't a ring
+        ring(int memfd, int data_fd, int space_fd)
+                : memfd_(memfd)
+                , data_fd_(data_fd)
+                , space_fd_(space_fd)
+        {
+            try {
+                // Only memfds (and other shmem files) can be sealed
+                int const seals = ::fcntl(memfd_, F_GET_SEALS);
+                if (seals == -1)
+                    fail("fcntl(F_GET_SEALS)");
+                if ((seals & F_SEAL_SHRINK) == 0)
+                    throw std::runtime_error("memory may shrink");
+
+                struct stat st{};
+                if (::fstat(memfd_, &st) == -1)
+                    fail("fstat");
+                if (!S_ISREG(st.st_mode))
+                    throw std::runtime_error("memory isn't a memfd");
+                auto const size = static_cast<std::size_t>(st.st_size);
+                if (size <= DataOffset || !std::has_single_bit(size - DataOffset))
+                    throw std::runtime_error("invalid size");
+
+                // A blocking pipe, say, passed off as an eventfd would
+                // hang the consumer on its first clear()
+                for (int const fd : {data_fd_, space_fd_}) {
+                    if (!is_eventfd(fd))
+                        throw std::runtime_error("wakeup isn't an eventfd");
+                    int const flags = ::fcntl(fd, F_GETFL);
+                    if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+                        fail("fcntl(F_SETFL)");
+                }
+
+                map(size);
+                auto* const ctl = std::launder(reinterpret_cast<control*>(base_));
+                if (ctl->magic != Magic || ctl->version != Version
+                        || ctl->capacity != size - DataOffset)
+                    throw std::runtime_error("invalid header");
+                ctl_ = ctl;
+                mask_ = ctl->capacity - 1;
+                cached_tail_ = ctl->head.load(std::memory_order_acquire);
+            } catch (...) {
+                release();
+                throw;
+            }
+        }
+
+        ~ring()
+        {
+            release();
+        }
+
+        // No copies/moves
+        ring(ring const&) = delete;
+        ring(ring&&) = delete;
+        ring& operator=(ring const&) = delete;
+        ring&& operator=(ring&&) = delete;
+
+        std::size_t
+        capacity() const
+        {
+            return mask_ + 1;
+        }
+
+        /// Backs the shared memory; sent to the consumer
+        int
+        memfd() const
+        {
+            return memfd_;
+        }
+
+        /// Written when data is committed while the consumer is waiting
+        int
+        data_fd() const
+        {
+            return data_fd_;
+        }
+
+        /// Written when data is consumed while the producer is waiting
+        int
+        space_fd() const
+        {
+            return space_fd_;
+        }
+
+        /// Producer only. Largest contiguous region of free space.
+        std::span<char>
+        writable()
+        {
+            std::uint64_t const tail = ctl_->tail.load(std::memory_order_relaxed);
+            if (tail - cached_head_ == capacity())
+                cached_head_ = ctl_->head.load(std::memory_order_acquire);
+
+            std::size_t const offset = tail & mask_;
+            std::size_t const len = std::min<std::size_t>(
+                    capacity() - (tail - cached_head_), capacity() - offset);
+            return {data() + offset, len};
+        }
+
+        /// Producer only. Publish n bytes written to writable().
+        /// \return \c false if the consumer couldn't be woken
+        bool
+        commit(std::size_t n)
+        {
+            ctl_->tail.fetch_add(n, std::memory_order_release);
+            return wake(ctl_->consumer_waiting, data_fd_);
+        }
+
+        /// Producer only. Call before waiting on space_fd().
+        /// \return \c false if space appeared, so there's no need to wait
+        bool
+        arm_space_wakeup()
+        {
+            return arm(ctl_->producer_waiting, [this] { return !writable().empty(); });
+        }
+
+        /// Consumer only. Largest contiguous region of committed data.
+        std::span<char const>
+        readable()
+        {
+            std::uint64_t const head = ctl_->head.load(std::memory_order_relaxed);
+            if (head == cached_tail_)
+                cached_tail_ = ctl_->tail.load(std::memory_order_acquire);
+
+            // The producer is another process; don't trust it to stay
+            // within the ring
+            std::size_t const offset = head & mask_;
+            std::size_t const len = std::min<std::size_t>(
+                    std::min<std::uint64_t>(cached_tail_ - head, capacity()),
+                    capacity() - offset);
+            return {data() + offset, len};
+        }
+
+        /// Consumer only. Release n bytes read from readable().
+        /// \return \c false if the producer couldn't be woken
+        bool
+        consume(std::size_t n)
+        {
+            ctl_->head.fetch_add(n, std::memory_order_release);
+            return wake(ctl_->producer_waiting, space_fd_);
+        }
+
+        /// Consumer only. Call before waiting on data_fd().
+        /// \return \c false if data appeared, so there's no need to wait
+        bool
+        arm_data_wakeup()
+        {
+            return arm(ctl_->consumer_waiting, [this] { return !readable().empty(); });
+        }
+
+        /// Reset an eventfd after waking on it
+        static void
+        clear(int fd)
+        {
+            eventfd_t value = 0;
+            ::eventfd_read(fd, &value);
+        }
+
+    private:
+        [[noreturn]] static void
+        fail(char const* what)
+        {
+            throw std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+        }
+
+        static bool
+        is_eventfd(int fd)
+        {
+            std::string const path = "/proc/self/fd/" + std::to_string(fd);
+            char target[64] = {};
+            ssize_t const n = ::readlink(path.c_str(), static_cast<char*>(target), sizeof(target));
+            return n > 0
+                    && std::string_view(static_cast<char const*>(target), static_cast<std::size_t>(n))
+                    == "anon_inode:[eventfd]";
+        }
+
+        void
+        map(std::size_t size)
+        {
+            void* const addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd_, 0);
+            if (addr == MAP_FAILED)
+                fail("mmap");
+            base_ = static_cast<char*>(addr);
+            size_ = size;
+        }
+
+        void
+        release()
+        {
+            if (base_ != nullptr)
+                ::munmap(base_, size_);
+            for (int const fd : {memfd_, data_fd_, space_fd_}) {
+                if (fd != -1)
+                    ::close(fd);
+            }
+        }
+
+        char*
+        data() const
+        {
+            return base_ + DataOffset;
+        }
+
+        /// Wake the other side if it armed its wakeup. The fence orders
+        /// the index just published before the flag is read; arm()
+        /// mirrors it, so either this sees the flag or that sees the
+        /// index.
+        static bool
+        wake(std::atomic<std::uint32_t>& waiting, int fd)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiting.load(std::memory_order_relaxed) == 0
+                    || waiting.exchange(0, std::memory_order_relaxed) == 0)
+                return true;
+            return ::eventfd_write(fd, 1) == 0;
+        }
+
+        template <typename Ready>
+        static bool
+        arm(std::atomic<std::uint32_t>& waiting, Ready ready)
+        {
+            waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!ready())
+                return true;
+            waiting.store(0, std::memory_order_relaxed);
+            return false;
+        }
+
+    private:
+        int memfd_{-1};                ///< backs the shared memory
+        int data_fd_{-1};              ///< eventfd, wakes the consumer
+        int space_fd_{-1};             ///< eventfd, wakes the producer
+        char* base_{nullptr};          ///< control block, then data
+        std::size_t size_{0};          ///< size of the mapping
+        control* ctl_{nullptr};        ///< shared indices and wakeup flags
+        std::size_t mask_{0};          ///< capacity - 1
+        std::uint64_t cached_head_{0}; ///< producer's copy of ctl_->head
+        std::uint64_t cached_tail_{0}; ///< consumer's copy of ctl_->tail
+    };
+
+    /// Send the hello and the ring's descriptors over a connected unix
+    /// stream socket
+    /// \return \c false on error, with errno set
+    inline bool
+    send_ring(int sock, ring const& r)
+    {
+        hello const msg{.magic = Magic, .version = Version};
+        iovec iov{.iov_base = const_cast<hello*>(&msg), .iov_len = sizeof(msg)}; // NOLINT
+
+        std::array<int, 3> const fds = {r.memfd(), r.data_fd(), r.space_fd()};
+        alignas(cmsghdr) char control_buf[CMSG_SPACE(sizeof(fds))] = {};
+
+        msghdr mh{};
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = static_cast<char*>(control_buf);
+        mh.msg_controllen = sizeof(control_buf);
+
+        cmsghdr* const cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+
+        return ::sendmsg(sock, &mh, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(msg));
+    }
+
+    /// As recv(), but also collects the descriptors of a ring sent with
+    /// the data. Any other descriptors are closed.
+    /// \param fds Set to the memfd, data_fd and space_fd, or all -1
+    /// \return As recvmsg()
+    inline ssize_t
+    recv_ring_fds(int sock, void* buf, std::size_t len, std::array<int, 3>& fds)
+    {
+        fds = {-1, -1, -1};
+        iovec iov{.iov_base = buf, .iov_len = len};
+        alignas(cmsghdr) char control_buf[CMSG_SPACE(sizeof(fds))] = {};
+
+        msghdr mh{};
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = static_cast<char*>(control_buf);
+        mh.msg_controllen = sizeof(control_buf);
+
+        ssize_t const n = ::recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+        if (n == -1)
+            return n;
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&mh); cmsg != nullptr; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+            std::size_t const count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (std::size_t i = 0; i < count; ++i) {
+                int fd = -1;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (count == fds.size() && (mh.msg_flags & MSG_CTRUNC) == 0)
+                    fds[i] = fd;
+                else
+                    ::close(fd);
+            }
+        }
+        return n;
+    }
+
+} // namespace shm
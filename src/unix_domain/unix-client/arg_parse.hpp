@@ -0,0 +1,109 @@
+#pragma once
+
+#include "version.h"
+#include "unix_domain/unix_socket.hpp"
+#include "util/compiler.hpp"
+#include <getopt.h>
+#include <cstdio>  // std::FILE
+#include <cstdlib> // std::exit
+#include <filesystem>
+#include <print>
+
+
+struct cli_args
+{
+    unix_socket::type type = unix_socket::type::Stream;
+    bool shm = false;
+    bool zero_copy = false;
+};
+
+
+inline cli_args
+arg_parse(int argc, char** argv)
+{
+    auto usage = [](std::FILE* outerr, std::filesystem::path const& app) {
+        std::print(outerr,
+                "usage: {} [-hmvz] [-t <type>]\n"
+                "Sends stdin to unix-server.\n"
+                "optional arguments:\n"
+                "  -h, --help               this output\n"
+                "  -m, --shm                hand the server a shared-memory ring and send\n"
+                "                           through it instead of the socket (stream only)\n"
+                "  -t, --type=<type>        socket type: 'stream', or 'seqpacket' or 'dgram'\n"
+                "                           to send each line as one timestamped message,\n"
+                "                           batched with sendmmsg (default stream)\n"
+                "  -v, --version            version\n"
+                "  -z, --zero-copy          move stdin to the socket inside the kernel with\n"
+                "                           splice(2) or sendfile(2); copies if stdin\n"
+                "                           doesn't support either (stream only)\n",
+                app.c_str());
+        std::exit(outerr == stdout ? EXIT_SUCCESS : EXIT_FAILURE);
+    };
+
+    auto const app = std::filesystem::path(argv[0]).filename();
+
+    cli_args args;
+    while (true) {
+        static constexpr option long_options[] = {
+                {"help", no_argument, nullptr, 'h'},
+                {"shm", no_argument, nullptr, 'm'},
+                {"type", required_argument, nullptr, 't'},
+                {"version", no_argument, nullptr, 'v'},
+                {"zero-copy", no_argument, nullptr, 'z'},
+                {nullptr, 0, nullptr, 0},
+        };
+
+        int const c = ::getopt_long(
+                argc, argv, "hmt:vz", static_cast<option const*>(long_options), nullptr);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'h':
+                usage(stdout, app);
+                break;
+
+            case 'm':
+                args.shm = true;
+                break;
+
+            case 't':
+                if (!unix_socket::parse_type(optarg, args.type)) {
+                    std::println(stderr, "invalid socket type: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'v':
+                std::println("app_version={}\n{}", ::VERSION, get_version_info_multiline());
+                std::exit(EXIT_SUCCESS);
+                break;
+
+            case 'z':
+                args.zero_copy = true;
+                break;
+
+            case '?':
+            default:
+                usage(stderr, app);
+                break;
+        }
+    } // while
+
+    if (optind != argc) {
+        std::println(stderr, "unexpected argument: {}\n", argv[optind]);
+        usage(stderr, app);
+    }
+
+    if (args.shm && args.zero_copy) {
+        std::println(stderr, "--shm and --zero-copy can't be used together\n");
+        usage(stderr, app);
+    }
+
+    if ((args.shm || args.zero_copy) && args.type != unix_socket::type::Stream) {
+        std::println(stderr, "--shm and --zero-copy need a stream socket\n");
+        usage(stderr, app);
+    }
+
+    return args;
+}
@@ -1,52 +1,407 @@
-#include <sys/socket.h> // ::connect, ::socket
-#include <sys/un.h>     // sockaddr_un
-#include <unistd.h>     // ::read, ::write
-#include <cerrno>       // errno
-#include <cstdio>       // std::fprintf, std::printf
-#include <cstdlib>      // EXIT_FAILURE, EXIT_SUCCESS
-#include <cstring>      // std::strerror, std::strncpy
+#include "arg_parse.hpp"
+#include "unix_domain/shm_ring.hpp"
+#include "unix_domain/unix_socket.hpp"
+#include <fcntl.h>        // ::fcntl, ::splice, F_SETPIPE_SZ
+#include <poll.h>         // ::poll
+#include <sys/sendfile.h> // ::sendfile
+#include <sys/socket.h>   // ::connect, ::sendmmsg, ::socket
+#include <sys/stat.h>     // ::fstat
+#include <sys/uio.h>      // iovec
+#include <sys/un.h>       // sockaddr_un
+#include <unistd.h>       // ::read, ::write
+#include <algorithm>      // std::min
+#include <cerrno>         // errno
+#include <chrono>
+#include <cstdint>
+#include <cstdio>  // std::fprintf, std::printf
+#include <cstdlib> // EXIT_FAILURE, EXIT_SUCCESS
+#include <cstring> // std::memchr, std::memmove, std::strerror
 #include <print>
+#include <span>
+#include <vector>
 
 
-constexpr char const* SocketPath = "\0socket";
-constexpr std::size_t BufferSize = 1024;
+constexpr std::size_t BufferSize = 1 << 20;
+constexpr std::size_t SendBatchSize = 64;
+constexpr std::size_t RingSize = 4 << 20;
+constexpr int PipeSize = 1 << 20;
+
+
+namespace {
+    /// Write all of [data, data+len), resuming after partial writes
+    /// \return \c false on error
+    bool
+    write_all(int fd, char const* data, std::size_t len)
+    {
+        while (len != 0) {
+            ::ssize_t const wbytes = ::write(fd, data, len);
+            if (wbytes == -1) {
+                if (errno == EINTR)
+                    continue;
+                std::println(stderr, "error: write: {}", std::strerror(errno));
+                return false;
+            }
+            data += wbytes;
+            len -= static_cast<std::size_t>(wbytes);
+        }
+        return true;
+    }
+
+    /// Copy in to out through a user-space buffer until eof
+    /// \return \c false on error
+    bool
+    copy_stream(int in, int out)
+    {
+        std::vector<char> buf(BufferSize);
+        for (;;) {
+            ::ssize_t const rbytes = ::read(in, buf.data(), buf.size());
+            if (rbytes == -1) {
+                if (errno == EINTR)
+                    continue;
+                std::println(stderr, "error: read: {}", std::strerror(errno));
+                return false;
+            }
+            if (rbytes == 0)
+                return true;
+            if (!write_all(out, buf.data(), static_cast<std::size_t>(rbytes)))
+                return false;
+        }
+    }
+
+    enum class splice_status
+    {
+        Done,        ///< reached eof
+        Unsupported, ///< nothing lost, copy the rest instead
+        Failed,      ///< error
+    };
+
+    /// \return \c true if errno means the descriptors can't be spliced
+    bool
+    splice_unsupported()
+    {
+        return errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP;
+    }
+
+    /// Move all n bytes in pipe_rd to out
+    /// \return \c false on error
+    bool
+    drain_pipe(int pipe_rd, int out, std::size_t n)
+    {
+        while (n != 0) {
+            ::ssize_t const moved = ::splice(
+                    pipe_rd, nullptr, out, nullptr, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (moved == -1) {
+                if (errno == EINTR)
+                    continue;
+                std::println(stderr, "error: splice: {}", std::strerror(errno));
+                return false;
+            }
+            n -= static_cast<std::size_t>(moved);
+        }
+        return true;
+    }
+
+    /// Move in to out inside the kernel until eof: with sendfile(2) if
+    /// in is a regular file, splice(2) if it is a pipe, and otherwise
+    /// splice(2) through a pipe of our own. Where a call isn't
+    /// supported, the data it didn't move is still in the source.
+    splice_status
+    splice_stream(int in, int out)
+    {
+        struct stat st{};
+        if (::fstat(in, &st) == -1) {
+            std::println(stderr, "error: fstat: {}", std::strerror(errno));
+            return splice_status::Failed;
+        }
+
+        if (S_ISREG(st.st_mode)) {
+            for (;;) {
+                ::ssize_t const moved = ::sendfile(out, in, nullptr, BufferSize);
+                if (moved == -1) {
+                    if (errno == EINTR)
+                        continue;
+                    if (splice_unsupported())
+                        return splice_status::Unsupported;
+                    std::println(stderr, "error: sendfile: {}", std::strerror(errno));
+                    return splice_status::Failed;
+                }
+                if (moved == 0)
+                    return splice_status::Done;
+            }
+        }
+
+        if (S_ISFIFO(st.st_mode)) {
+            // Fewer, larger splices; the writer may not allow it, which
+            // costs nothing but speed
+            ::fcntl(in, F_SETPIPE_SZ, PipeSize);
+            for (;;) {
+                ::ssize_t const moved = ::splice(
+                        in, nullptr, out, nullptr, BufferSize, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (moved == -1) {
+                    if (errno == EINTR)
+                        continue;
+                    if (splice_unsupported())
+                        return splice_status::Unsupported;
+                    std::println(stderr, "error: splice: {}", std::strerror(errno));
+                    return splice_status::Failed;
+                }
+                if (moved == 0)
+                    return splice_status::Done;
+            }
+        }
+
+        int fds[2] = {-1, -1};
+        if (::pipe2(static_cast<int*>(fds), O_CLOEXEC) == -1) {
+            std::println(stderr, "error: pipe2: {}", std::strerror(errno));
+            return splice_status::Failed;
+        }
+        ::fcntl(fds[1], F_SETPIPE_SZ, PipeSize);
+
+        // The pipe is drained before the next splice into it, so a
+        // failure to fill it never strands any data
+        splice_status status = splice_status::Done;
+        for (;;) {
+            ::ssize_t const moved
+                    = ::splice(in, nullptr, fds[1], nullptr, BufferSize, SPLICE_F_MOVE);
+            if (moved == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (splice_unsupported()) {
+                    status = splice_status::Unsupported;
+                } else {
+                    std::println(stderr, "error: splice: {}", std::strerror(errno));
+                    status = splice_status::Failed;
+                }
+                break;
+            }
+            if (moved == 0)
+                break;
+            if (!drain_pipe(fds[0], out, static_cast<std::size_t>(moved))) {
+                status = splice_status::Failed;
+                break;
+            }
+        }
+
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return status;
+    }
+
+    /// Wait until the server has made room in the ring
+    /// \return \c false on error or if the server went away
+    bool
+    wait_for_space(shm::ring& ring, int fd)
+    {
+        if (!ring.arm_space_wakeup())
+            return true;
+
+        pollfd fds[2] = {{.fd = ring.space_fd(), .events = POLLIN, .revents = 0},
+                {.fd = fd, .events = POLLIN | POLLRDHUP, .revents = 0}};
+        while (::poll(static_cast<pollfd*>(fds), 2, /*timeout=*/-1) == -1) {
+            if (errno != EINTR) {
+                std::println(stderr, "error: poll: {}", std::strerror(errno));
+                return false;
+            }
+        }
+
+        // The server never writes to the socket, so any event on it
+        // means it has closed the connection
+        if (fds[1].revents != 0) {
+            std::println(stderr, "error: server closed the connection");
+            return false;
+        }
+
+        shm::ring::clear(ring.space_fd());
+        return true;
+    }
+
+    /// Hand the server a ring over fd, then read stdin straight into it
+    /// until eof
+    /// \return \c false on error
+    bool
+    send_via_shm(int fd)
+    {
+        shm::ring ring(RingSize);
+        if (!shm::send_ring(fd, ring)) {
+            std::println(stderr, "error: sendmsg: {}", std::strerror(errno));
+            return false;
+        }
+
+        for (;;) {
+            std::span<char> const space = ring.writable();
+            if (space.empty()) {
+                if (!wait_for_space(ring, fd))
+                    return false;
+                continue;
+            }
+
+            ::ssize_t const rbytes = ::read(STDIN_FILENO, space.data(), space.size());
+            if (rbytes == -1) {
+                if (errno == EINTR)
+                    continue;
+                std::println(stderr, "error: read: {}", std::strerror(errno));
+                return false;
+            }
+            if (rbytes == 0)
+                return true; // the server drains the rest once we disconnect
+
+            if (!ring.commit(static_cast<std::size_t>(rbytes))) {
+                std::println(stderr, "error: eventfd_write: {}", std::strerror(errno));
+                return false;
+            }
+        }
+    }
+
+    /// Send each line of stdin as one message, a batch at a time with
+    /// sendmmsg. Every message gathers the batch's shared header and a
+    /// line still in the read buffer, so nothing is copied. Lines too
+    /// long for one message are sent in pieces.
+    /// \return \c false on error
+    bool
+    send_messages(int fd)
+    {
+        constexpr std::size_t MaxPayload
+                = unix_socket::MaxMessageSize - sizeof(unix_socket::header);
+
+        unix_socket::header hdr{};
+        std::vector<char> buf(BufferSize);
+        std::vector<iovec> iovs(2 * SendBatchSize);
+        std::vector<mmsghdr> msgs(SendBatchSize);
+        for (std::size_t i = 0; i < SendBatchSize; ++i) {
+            iovs[2 * i] = {.iov_base = &hdr, .iov_len = sizeof(hdr)};
+            msgs[i].msg_hdr.msg_iov = &iovs[2 * i];
+            msgs[i].msg_hdr.msg_iovlen = 2;
+        }
+
+        std::size_t batch = 0;   // num of messages queued in msgs
+        std::uint64_t sent = 0;  // num of messages sent
+        std::uint64_t bytes = 0; // num of payload bytes sent
+        std::uint64_t calls = 0; // num of sendmmsg calls
+        auto const start = std::chrono::steady_clock::now();
+
+        auto flush = [&] {
+            hdr.send_time_nsec = unix_socket::now_nsec();
+            std::size_t done = 0;
+            while (done < batch) {
+                int const n = ::sendmmsg(fd, msgs.data() + done,
+                        static_cast<unsigned>(batch - done), /*flags=*/0);
+                if (n == -1) {
+                    if (errno == EINTR)
+                        continue;
+                    std::println(stderr, "error: sendmmsg: {}", std::strerror(errno));
+                    return false;
+                }
+                ++calls;
+                done += static_cast<std::size_t>(n);
+            }
+            sent += batch;
+            batch = 0;
+            return true;
+        };
+
+        auto add = [&](char const* data, std::size_t len) {
+            iovs[2 * batch + 1] = {.iov_base = const_cast<char*>(data), .iov_len = len}; // NOLINT
+            bytes += len;
+            return ++batch < SendBatchSize || flush();
+        };
+
+        std::size_t len = 0; // bytes in buf, the start of a line
+        for (;;) {
+            ::ssize_t const rbytes = ::read(STDIN_FILENO, buf.data() + len, buf.size() - len);
+            if (rbytes == -1) {
+                if (errno == EINTR)
+                    continue;
+                std::println(stderr, "error: read: {}", std::strerror(errno));
+                return false;
+            }
+            if (rbytes == 0)
+                break;
+            len += static_cast<std::size_t>(rbytes);
+
+            char const* pos = buf.data();
+            char const* const end = buf.data() + len;
+            while (pos != end) {
+                auto const avail = static_cast<std::size_t>(end - pos);
+                auto const* const newline = static_cast<char const*>(
+                        std::memchr(pos, '\n', std::min(avail, MaxPayload + 1)));
+                if (newline != nullptr) {
+                    if (!add(pos, static_cast<std::size_t>(newline - pos)))
+                        return false;
+                    pos = newline + 1;
+                } else if (avail >= MaxPayload) {
+                    if (!add(pos, MaxPayload))
+                        return false;
+                    pos += MaxPayload;
+                } else {
+                    break;
+                }
+            }
+
+            // The batch points into buf, so send it before moving the
+            // incomplete line to the front
+            if (!flush())
+                return false;
+            len = static_cast<std::size_t>(end - pos);
+            std::memmove(buf.data(), pos, len);
+        }
+
+        if (len != 0 && !add(buf.data(), len))
+            return false;
+        if (!flush())
+            return false;
+
+        double const secs
+                = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double const per_call
+                = calls != 0 ? static_cast<double>(sent) / static_cast<double>(calls) : 0.0;
+        std::println("sent {} msgs in {} sendmmsg calls ({:.1f} per call) msgs/s={:.0f} "
+                     "MB/s={:.2f}",
+                sent, calls, per_call, static_cast<double>(sent) / secs,
+                static_cast<double>(bytes) / secs / 1e6);
+        return true;
+    }
+
+} // namespace
 
 
 int
-main(int, char**)
+main(int argc, char** argv)
 {
     try {
-        int const fd = ::socket(AF_UNIX, SOCK_STREAM, /*protocol=*/0);
+        cli_args const args = arg_parse(argc, argv);
+
+        int const fd = ::socket(AF_UNIX, unix_socket::to_sock_type(args.type), /*protocol=*/0);
         if (fd == -1) {
             std::println(stderr, "error: socket: {}", std::strerror(errno));
             return 1;
         }
 
-        sockaddr_un addr = {};
-        addr.sun_family = AF_UNIX;
-        std::strncpy(static_cast<char*>(addr.sun_path), SocketPath, sizeof(addr.sun_path) - 1);
-
-        int rv = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        // A datagram socket is connected too, which fixes where every
+        // message goes and lets sendmmsg leave the address out
+        sockaddr_un addr{};
+        socklen_t const addrlen = unix_socket::server_address(args.type, addr);
+        int rv = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), addrlen);
         if (rv == -1) {
             std::println(stderr, "error: connect: {}", std::strerror(errno));
             return 1;
         }
 
-        char buf[BufferSize];
-        ::ssize_t rbytes = 0;
-        do {
-            rbytes = ::read(STDIN_FILENO, static_cast<void*>(buf), sizeof(buf));
-            ssize_t wbytes
-                    = ::write(fd, static_cast<void const*>(buf), static_cast<std::size_t>(rbytes));
-            if (wbytes == -1) {
-                std::println(stderr, "error: write: {}", std::strerror(errno));
-                return 1;
-            }
+        if (args.type != unix_socket::type::Stream)
+            return send_messages(fd) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-            if (wbytes < rbytes) {
-                std::println(stderr, "error: partial write");
-            }
-        } while (rbytes > 0);
+        if (args.shm)
+            return send_via_shm(fd) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+        if (args.zero_copy) {
+            splice_status const status = splice_stream(STDIN_FILENO, fd);
+            if (status == splice_status::Failed)
+                return EXIT_FAILURE;
+            if (status == splice_status::Done)
+                return EXIT_SUCCESS;
+        }
+
+        if (!copy_stream(STDIN_FILENO, fd))
+            return EXIT_FAILURE;
     } catch (std::exception const& e) {
         std::fprintf(stderr, "error: exception: %s\n", e.what());
         return EXIT_FAILURE;
@@ -1,3 +1,4 @@
-MODULE_CXXFLAGS := -fno-rtti
+MODULE_CXXFLAGS  := -fno-rtti
+MODULE_LIBRARIES := util
 
 $(call add-executable-module,$(get-path))
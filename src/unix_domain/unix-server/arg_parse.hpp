@@ -0,0 +1,91 @@
+#pragma once
+
+#include "version.h"
+#include "unix_domain/unix_socket.hpp"
+#include "util/compiler.hpp"
+#include <getopt.h>
+#include <cstdio>  // std::FILE
+#include <cstdlib> // std::exit
+#include <filesystem>
+#include <print>
+
+
+struct cli_args
+{
+    unix_socket::type type = unix_socket::type::Stream;
+    bool verbose = false;
+};
+
+
+inline cli_args
+arg_parse(int argc, char** argv)
+{
+    auto usage = [](std::FILE* outerr, std::filesystem::path const& app) {
+        std::print(outerr,
+                "usage: {} [-hvV] [-t <type>]\n"
+                "optional arguments:\n"
+                "  -h, --help               this output\n"
+                "  -t, --type=<type>        socket type: 'stream' for newline-terminated\n"
+                "                           messages, or 'seqpacket' or 'dgram' for one\n"
+                "                           message per packet, batched with recvmmsg and\n"
+                "                           with latency reported (default stream)\n"
+                "  -v, --version            version\n"
+                "  -V, --verbose            print every message received and every client\n"
+                "                           that connects or disconnects (slow; throughput\n"
+                "                           is reported once a second regardless)\n",
+                app.c_str());
+        std::exit(outerr == stdout ? EXIT_SUCCESS : EXIT_FAILURE);
+    };
+
+    auto const app = std::filesystem::path(argv[0]).filename();
+
+    cli_args args;
+    while (true) {
+        static constexpr option long_options[] = {
+                {"help", no_argument, nullptr, 'h'},
+                {"type", required_argument, nullptr, 't'},
+                {"verbose", no_argument, nullptr, 'V'},
+                {"version", no_argument, nullptr, 'v'},
+                {nullptr, 0, nullptr, 0},
+        };
+
+        int const c = ::getopt_long(
+                argc, argv, "ht:vV", static_cast<option const*>(long_options), nullptr);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'h':
+                usage(stdout, app);
+                break;
+
+            case 't':
+                if (!unix_socket::parse_type(optarg, args.type)) {
+                    std::println(stderr, "invalid socket type: {}", optarg);
+                    usage(stderr, app);
+                }
+                break;
+
+            case 'v':
+                std::println("app_version={}\n{}", ::VERSION, get_version_info_multiline());
+                std::exit(EXIT_SUCCESS);
+                break;
+
+            case 'V':
+                args.verbose = true;
+                break;
+
+            case '?':
+            default:
+                usage(stderr, app);
+                break;
+        }
+    } // while
+
+    if (optind != argc) {
+        std::println(stderr, "unexpected argument: {}\n", argv[optind]);
+        usage(stderr, app);
+    }
+
+    return args;
+}
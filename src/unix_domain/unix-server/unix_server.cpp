@@ -0,0 +1,577 @@
+#include "unix_server.hpp"
+#include "util/logger.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h> // ::eventfd_write
+#include <sys/socket.h>  // socket calls
+#include <sys/un.h>      // sockaddr_un
+#include <unistd.h>      // ::close
+#include <algorithm>     // std::min
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring> // std::memchr, std::memcpy, std::strerror
+#include <exception>
+#include <print>
+#include <span>
+#include <stdexcept> // std::runtime_error
+#include <string>
+
+
+unix_server::unix_server(server_config const& config, util::stat_counters& stats)
+        : config_(config)
+        , stats_(stats)
+        , clients_()
+        , backlog_()
+        , turn_()
+        , in_buf_(util::buffer_pool::instance().acquire(IncomingBufferSizeBytes))
+        , batch_buf_()
+        , iovs_()
+        , msgs_()
+        , latency_()
+{
+    if (!in_buf_)
+        throw std::runtime_error("buffer_pool: out of memory");
+
+    if (config_.type != unix_socket::type::Stream) {
+        batch_buf_.resize(RecvBatchSize * unix_socket::MaxMessageSize);
+        iovs_.resize(RecvBatchSize);
+        msgs_.resize(RecvBatchSize);
+        for (std::size_t i = 0; i < RecvBatchSize; ++i) {
+            iovs_[i].iov_base = batch_buf_.data() + i * unix_socket::MaxMessageSize;
+            iovs_[i].iov_len = unix_socket::MaxMessageSize;
+            msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    int const sock_type = unix_socket::to_sock_type(config_.type);
+    sockfd_ = ::socket(AF_UNIX, sock_type | SOCK_NONBLOCK | SOCK_CLOEXEC, /*protocol=*/0);
+    if (sockfd_ == -1)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+
+    sockaddr_un addr{};
+    socklen_t const addrlen = unix_socket::server_address(config_.type, addr);
+    if (::bind(sockfd_, reinterpret_cast<sockaddr*>(&addr), addrlen) == -1) {
+        int const error = errno;
+        ::close(sockfd_);
+        throw std::runtime_error(std::string("bind: ") + std::strerror(error));
+    }
+
+    epollfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd_ == -1) {
+        int const error = errno;
+        ::close(sockfd_);
+        throw std::runtime_error(std::string("epoll_create1: ") + std::strerror(error));
+    }
+}
+
+
+unix_server::~unix_server()
+{
+    ::close(sockfd_);
+    ::close(epollfd_);
+
+    for (auto const& c : clients_) {
+        if (c.fd != -1)
+            ::close(c.fd);
+    }
+}
+
+
+bool
+unix_server::run()
+{
+    bool const connected = config_.type != unix_socket::type::Datagram;
+    if (connected && ::listen(sockfd_, ListenBacklog) == -1) {
+        std::println(stderr, "error: listen: {}", std::strerror(errno));
+        return false;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = static_cast<std::uint32_t>(sockfd_);
+    if (::epoll_ctl(epollfd_, EPOLL_CTL_ADD, sockfd_, &event) == -1) {
+        std::println(stderr, "error: epoll_ctl: {}", std::strerror(errno));
+        return false;
+    }
+
+    // Only the message types carry timestamps to report on
+    bool const timed = config_.type != unix_socket::type::Stream;
+    auto next_report = clock::now() + std::chrono::milliseconds(ReportIntervalMsecs);
+
+    epoll_event events[EpollMaxEvents];
+    for (;;) {
+        // Wake up in time to report, or to accept again, even if nothing
+        // arrives; don't wait at all while clients are left with data
+        auto const until = [](clock::time_point when) {
+            auto const wait = std::chrono::ceil<std::chrono::milliseconds>(when - clock::now());
+            return static_cast<int>(std::max<std::chrono::milliseconds::rep>(wait.count(), 0));
+        };
+        int timeout = -1;
+        if (timed)
+            timeout = until(next_report);
+        if (!accepting_) {
+            int const retry = until(resume_accept_);
+            timeout = timeout == -1 ? retry : std::min(timeout, retry);
+        }
+        if (!backlog_.empty())
+            timeout = 0;
+
+        int const num_events = ::epoll_wait(
+                epollfd_, static_cast<epoll_event*>(events), EpollMaxEvents, timeout);
+        if (num_events == -1) {
+            if (errno == EINTR)
+                continue;
+            util::log_error("error: epoll_wait: {}", std::strerror(errno));
+            return false;
+        }
+
+        if (timed && clock::now() >= next_report) {
+            report();
+            next_report += std::chrono::milliseconds(ReportIntervalMsecs);
+        }
+
+        if (!accepting_ && clock::now() >= resume_accept_ && !resume_accepting())
+            return false;
+
+        for (int i = 0; i < num_events; ++i) {
+            std::uint64_t const key = events[i].data.u64; // NOLINT
+            auto const fd = static_cast<int>(static_cast<std::uint32_t>(key));
+            if (fd == sockfd_) {
+                bool const ok = connected ? on_incoming_connection() : on_incoming_messages(fd);
+                if (!ok)
+                    return false;
+                continue;
+            }
+
+            if ((key & RingEvent) != 0) {
+                client& c = clients_[static_cast<std::size_t>(fd)];
+                if (c.ring && !on_ring_data(c, MaxRingBytesPerWakeup))
+                    return false;
+                continue;
+            }
+
+            // Read even on EPOLLHUP/EPOLLERR: data sent before the
+            // client went away is still queued, and recv reports the
+            // error or eof after it.
+            bool const ok = config_.type == unix_socket::type::SeqPacket
+                    ? on_incoming_messages(fd)
+                    : on_incoming_data(fd);
+            if (!ok)
+                return false;
+        }
+
+        // Then give clients that hit their limit last time another turn,
+        // behind everyone with fresh data
+        turn_.swap(backlog_);
+        for (int const fd : turn_) {
+            client& c = clients_[static_cast<std::size_t>(fd)];
+            if (!c.backlogged)
+                continue; // closed since
+            c.backlogged = false;
+            if (!on_incoming_data(fd))
+                return false;
+        }
+        turn_.clear();
+    }
+
+    return true;
+}
+
+
+bool
+unix_server::on_incoming_connection()
+{
+    for (;;) {
+        int const fd = ::accept4(sockfd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            int const error = errno;
+            stats_.add_errors();
+            util::log_error("error: accept4: {}", std::strerror(error));
+            if (error != EMFILE && error != ENFILE && error != ENOBUFS && error != ENOMEM)
+                return false;
+
+            // Out of descriptors or memory. The listener is level-triggered,
+            // so leaving it in epoll would spin on the connections still
+            // pending; stop watching it until a client goes or a while has
+            // passed, rather than taking down every connected client.
+            return pause_accepting();
+        }
+
+        auto const ufd = static_cast<std::size_t>(fd);
+        if (ufd >= clients_.size())
+            clients_.resize(ufd + 1);
+        clients_[ufd].fd = fd;
+        ++num_clients_;
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = static_cast<std::uint32_t>(fd);
+        if (::epoll_ctl(epollfd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+            util::log_error("error: epoll_ctl (EPOLL_CTL_ADD): {}", std::strerror(errno));
+            close_client(fd);
+            return false;
+        }
+
+        if (config_.verbose)
+            util::log_info("client connected on fd {} ({} connected)", fd, num_clients_);
+    }
+}
+
+
+bool
+unix_server::on_incoming_data(int fd)
+{
+    auto const ufd = static_cast<std::size_t>(fd);
+    if (ufd >= clients_.size() || clients_[ufd].fd == -1)
+        return true;
+    client& c = clients_[ufd];
+
+    // Edge-triggered: keep reading until the kernel queue is empty, or
+    // until this client has had its share, when it goes to the back of
+    // the line rather than holding up the others
+    std::size_t total = 0;
+    for (;;) {
+        if (total >= MaxStreamBytesPerWakeup) {
+            if (!c.backlogged) {
+                c.backlogged = true;
+                backlog_.push_back(fd);
+            }
+            return true;
+        }
+
+        // Only the first message may carry a ring's descriptors
+        std::array<int, 3> fds = {-1, -1, -1};
+        ::ssize_t const bytes_recvd = c.first_read
+                ? shm::recv_ring_fds(fd, in_buf_.data(), in_buf_.capacity(), fds)
+                : ::recv(fd, in_buf_.data(), in_buf_.capacity(), 0);
+        if (bytes_recvd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
+
+            stats_.add_errors();
+            util::log_error("error: recv: {}", std::strerror(errno));
+            close_client(fd);
+            return true;
+        }
+
+        // Client disconnected; whatever it left unterminated is its
+        // last message.
+        if (bytes_recvd == 0) {
+            if (c.ring && !on_ring_data(c, SIZE_MAX))
+                return false;
+            if (c.fd == -1)
+                return true; // dropped while draining its ring
+            if (c.partial_len != 0)
+                on_message(fd, {c.partial.data(), c.partial_len});
+            if (config_.verbose)
+                util::log_info("client on fd {} disconnected", fd);
+            close_client(fd);
+            return true;
+        }
+
+        auto const len = static_cast<std::size_t>(bytes_recvd);
+        if (c.first_read) {
+            c.first_read = false;
+            if (fds[0] != -1) {
+                if (!on_ring_handshake(c, len, fds))
+                    return false;
+                if (c.fd == -1)
+                    return true; // rejected and closed
+                continue;
+            }
+        }
+
+        if (c.ring) {
+            stats_.add_errors();
+            util::log_error("error: fd {} sent data on the socket while using a ring", fd);
+            close_client(fd);
+            return true;
+        }
+
+        on_stream_data(c, in_buf_.data(), len);
+        if (c.fd == -1)
+            return true; // dropped
+        total += len;
+    }
+}
+
+
+bool
+unix_server::on_ring_handshake(client& c, std::size_t len, std::array<int, 3> const& fds)
+{
+    shm::hello hello{};
+    if (len == sizeof(hello))
+        std::memcpy(&hello, in_buf_.data(), sizeof(hello));
+
+    try {
+        if (hello.magic != shm::Magic || hello.version != shm::Version) {
+            for (int const fd : fds)
+                ::close(fd);
+            throw std::runtime_error("unexpected handshake");
+        }
+        c.ring = std::make_unique<shm::ring>(fds[0], fds[1], fds[2]);
+    } catch (std::exception const& e) {
+        stats_.add_errors();
+        util::log_error("error: fd {}: shm ring: {}", c.fd, e.what());
+        close_client(c.fd);
+        return true;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = RingEvent | static_cast<std::uint32_t>(c.fd);
+    if (::epoll_ctl(epollfd_, EPOLL_CTL_ADD, c.ring->data_fd(), &event) == -1) {
+        util::log_error("error: epoll_ctl (EPOLL_CTL_ADD): {}", std::strerror(errno));
+        close_client(c.fd);
+        return false;
+    }
+
+    if (config_.verbose)
+        util::log_info("client on fd {} using a {} byte shm ring", c.fd, c.ring->capacity());
+
+    // Anything committed before the ring was registered woke no one
+    return on_ring_data(c, MaxRingBytesPerWakeup);
+}
+
+
+bool
+unix_server::on_ring_data(client& c, std::size_t max_bytes)
+{
+    shm::ring& ring = *c.ring;
+    shm::ring::clear(ring.data_fd());
+
+    std::size_t total = 0;
+    for (;;) {
+        std::span<char const> const data = ring.readable();
+        if (data.empty()) {
+            if (ring.arm_data_wakeup())
+                return true; // sleep until the client commits more
+            continue;
+        }
+
+        on_stream_data(c, data.data(), data.size());
+        if (c.fd == -1)
+            return true; // dropped, and the ring with it
+        if (!ring.consume(data.size())) {
+            util::log_error("error: eventfd_write: {}", std::strerror(errno));
+            return false;
+        }
+
+        // Level-triggered, so an eventfd left readable brings us back
+        // after every other client has had its turn
+        total += data.size();
+        if (total >= max_bytes) {
+            if (::eventfd_write(ring.data_fd(), 1) == -1) {
+                util::log_error("error: eventfd_write: {}", std::strerror(errno));
+                return false;
+            }
+            return true;
+        }
+    }
+}
+
+
+void
+unix_server::on_stream_data(client& c, char const* data, std::size_t len)
+{
+    char const* const end = data + len;
+    while (data != end) {
+        auto const* const newline = static_cast<char const*>(
+                std::memchr(data, '\n', static_cast<std::size_t>(end - data)));
+
+        // Fast path: a whole message, nothing buffered ahead of it
+        if (c.partial_len == 0 && newline != nullptr) {
+            on_message(c.fd, {data, newline});
+            data = newline + 1;
+            continue;
+        }
+
+        // Otherwise extend the client's partial message, acquiring its
+        // buffer only now that it is needed
+        if (!c.partial) {
+            c.partial = util::buffer_pool::instance().acquire(MaxMessageSizeBytes);
+            if (!c.partial) {
+                stats_.add_errors();
+                util::log_error("error: fd {}: buffer_pool: out of memory", c.fd);
+                close_client(c.fd);
+                return;
+            }
+        }
+
+        char const* const stop = newline != nullptr ? newline : end;
+        std::size_t const n = std::min(static_cast<std::size_t>(stop - data),
+                c.partial.capacity() - c.partial_len);
+        std::memcpy(c.partial.data() + c.partial_len, data, n);
+        c.partial_len += n;
+        data += n;
+
+        if (data == newline || c.partial_len == c.partial.capacity()) {
+            on_message(c.fd, {c.partial.data(), c.partial_len});
+            c.partial_len = 0;
+            if (data == newline)
+                ++data;
+        }
+    }
+
+    // Hand an emptied buffer back to the pool rather than holding one
+    // per idle client.
+    if (c.partial_len == 0 && c.partial)
+        c.partial = util::pooled_buffer();
+}
+
+
+bool
+unix_server::on_incoming_messages(int fd)
+{
+    for (;;) {
+        int const n = ::recvmmsg(fd, msgs_.data(), RecvBatchSize, MSG_DONTWAIT, nullptr);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
+
+            stats_.add_errors();
+            util::log_error("error: recvmmsg: {}", std::strerror(errno));
+            if (fd == sockfd_)
+                return false;
+            close_client(fd);
+            return true;
+        }
+
+        std::uint64_t const now = unix_socket::now_nsec();
+        for (int i = 0; i < n; ++i) {
+            mmsghdr const& msg = msgs_[static_cast<std::size_t>(i)];
+
+            // Every message has a header, so an empty one can only be
+            // a seqpacket client's eof
+            if (msg.msg_len == 0 && fd != sockfd_) {
+                if (config_.verbose)
+                    util::log_info("client on fd {} disconnected", fd);
+                close_client(fd);
+                return true;
+            }
+
+            if ((msg.msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+                stats_.add_errors();
+                util::log_error("error: fd {}: message longer than {} bytes truncated", fd,
+                        unix_socket::MaxMessageSize);
+                continue;
+            }
+
+            on_timed_message(fd, static_cast<char const*>(msg.msg_hdr.msg_iov->iov_base),
+                    msg.msg_len, now);
+        }
+
+        // Non-blocking, so a short batch means the queue is empty
+        if (n < RecvBatchSize)
+            return true;
+    }
+}
+
+
+void
+unix_server::on_timed_message(int fd, char const* data, std::size_t len, std::uint64_t now_nsec)
+{
+    unix_socket::header hdr{};
+    if (len < sizeof(hdr)) {
+        stats_.add_errors();
+        util::log_error("error: fd {}: {} byte message is too short for a header", fd, len);
+        return;
+    }
+
+    std::memcpy(&hdr, data, sizeof(hdr));
+    latency_.record(now_nsec > hdr.send_time_nsec ? now_nsec - hdr.send_time_nsec : 0);
+    on_message(fd, {data + sizeof(hdr), len - sizeof(hdr)});
+}
+
+
+void
+unix_server::on_message(int fd, std::string_view msg)
+{
+    stats_.add(1, msg.size());
+
+    if (config_.verbose)
+        util::log_info("fd={} msg=[{}]", fd, msg);
+}
+
+
+void
+unix_server::report()
+{
+    util::histogram& h = latency_;
+    if (h.count() == 0)
+        return;
+
+    std::println("unix-server latency(ns) n={} min={} p50={} p90={} p99={} p99.9={} max={} "
+                 "mean={:.0f}",
+            h.count(), h.min(), h.percentile(50), h.percentile(90), h.percentile(99),
+            h.percentile(99.9), h.max(), h.mean());
+    h.reset();
+}
+
+
+void
+unix_server::close_client(int fd)
+{
+    ::close(fd); // also removes it from epoll
+
+    client& c = clients_[static_cast<std::size_t>(fd)];
+    c.fd = -1;
+    c.first_read = true;
+    c.partial = util::pooled_buffer();
+    c.partial_len = 0;
+    c.backlogged = false;
+    if (c.ring) {
+        // The client still holds the eventfd open, so closing our copy
+        // wouldn't take it out of epoll; a stale registration would keep
+        // firing for whichever client is given this fd next
+        ::epoll_ctl(epollfd_, EPOLL_CTL_DEL, c.ring->data_fd(), nullptr);
+        c.ring.reset();
+    }
+    --num_clients_;
+
+    // A descriptor, and likely some memory, is free again
+    if (!accepting_)
+        resume_accepting();
+}
+
+
+bool
+unix_server::pause_accepting()
+{
+    epoll_event event{};
+    event.data.u64 = static_cast<std::uint32_t>(sockfd_);
+    if (::epoll_ctl(epollfd_, EPOLL_CTL_MOD, sockfd_, &event) == -1) {
+        util::log_error("error: epoll_ctl (EPOLL_CTL_MOD): {}", std::strerror(errno));
+        return false;
+    }
+
+    accepting_ = false;
+    resume_accept_ = clock::now() + std::chrono::milliseconds(AcceptRetryMsecs);
+    return true;
+}
+
+
+bool
+unix_server::resume_accepting()
+{
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = static_cast<std::uint32_t>(sockfd_);
+    if (::epoll_ctl(epollfd_, EPOLL_CTL_MOD, sockfd_, &event) == -1) {
+        util::log_error("error: epoll_ctl (EPOLL_CTL_MOD): {}", std::strerror(errno));
+        return false;
+    }
+
+    accepting_ = true;
+    return true;
+}
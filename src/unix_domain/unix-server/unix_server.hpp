@@ -0,0 +1,162 @@
+#pragma once
+
+#include "unix_domain/shm_ring.hpp"
+#include "unix_domain/unix_socket.hpp"
+#include "util/buffer_pool.hpp"
+#include "util/histogram.hpp"
+#include "util/stats.hpp"
+#include <sys/socket.h> // mmsghdr
+#include <sys/uio.h>    // iovec
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+struct server_config
+{
+    unix_socket::type type = unix_socket::type::Stream; ///< and so how messages are framed
+    bool verbose = false;                               ///< print every message received
+};
+
+/*  \class  unix_server
+ *  \brief  Single-threaded, non-blocking epoll server for local clients
+ *          of an abstract unix stream socket. Each client's stream is
+ *          split into newline-terminated messages. Messages that arrive
+ *          whole are handled straight from the recv buffer; one that
+ *          arrives in pieces is held in that client's own buffer until
+ *          the rest of it does, so a slow or stalled client never holds
+ *          up the others, and a client is read only so much at a time
+ *          before the others get their turn, so a busy one doesn't
+ *          either.
+ *          A client may instead hand over a shared-memory ring (see
+ *          shm_ring.hpp) in its first message; its messages are then
+ *          parsed straight out of the ring whenever its eventfd fires,
+ *          and the socket only signals when the client has gone.
+ *          With a seqpacket or datagram socket the kernel keeps message
+ *          boundaries, so nothing is buffered per client; messages are
+ *          received up to RecvBatchSize at a time with recvmmsg, and
+ *          the timestamp each starts with is used to report latency.
+ */
+class unix_server
+{
+public:
+    /// \param stats Updated for every message and error; only by the
+    ///        thread that calls run()
+    /// \throws std::exception On error
+    unix_server(server_config const& config, util::stat_counters& stats);
+    ~unix_server();
+
+    // No copies/moves
+    unix_server(unix_server const&) = delete;
+    unix_server(unix_server&&) = delete;
+    unix_server& operator=(unix_server const&) = delete;
+    unix_server&& operator=(unix_server&&) = delete;
+
+    /// Start listening and serve clients until an error occurs
+    /// \return \c false on error
+    bool run();
+
+private:
+    struct client
+    {
+        int fd = -1;                     ///< connected socket, -1 if the slot is free
+        bool first_read = true;          ///< nothing received yet, may carry a ring
+        util::pooled_buffer partial;     ///< start of an incomplete message, if any
+        std::size_t partial_len = 0;     ///< num of bytes in partial
+        bool backlogged = false;         ///< in backlog_, data left unread
+        std::unique_ptr<shm::ring> ring; ///< shared-memory transport, if in use
+    };
+
+    /// Accept every pending connection
+    /// \return \c false on error
+    bool on_incoming_connection();
+
+    /// Stop watching the listener, until a client goes or
+    /// AcceptRetryMsecs have passed
+    /// \return \c false on error
+    bool pause_accepting();
+
+    /// \return \c false on error
+    bool resume_accepting();
+
+    /// Read until the socket would block, or MaxStreamBytesPerWakeup
+    /// have been read and the client is added to backlog_, handling
+    /// each complete message and buffering the rest
+    /// \return \c false on error
+    bool on_incoming_data(int fd);
+
+    /// Adopt the ring whose descriptors came with the client's first
+    /// message
+    /// \return \c false on error
+    bool on_ring_handshake(client& c, std::size_t len, std::array<int, 3> const& fds);
+
+    /// Parse what the client has committed to its ring. Stops after
+    /// max_bytes so one busy client can't starve the rest, making sure
+    /// to be woken again if it left data behind.
+    /// \return \c false on error
+    bool on_ring_data(client& c, std::size_t max_bytes);
+
+    /// Split data into messages, continuing any partial message. The
+    /// client is closed if its partial message can't be buffered.
+    void on_stream_data(client& c, char const* data, std::size_t len);
+
+    /// Receive messages from a seqpacket client, or from the datagram
+    /// socket, a batch at a time until the socket would block
+    /// \return \c false on error
+    bool on_incoming_messages(int fd);
+
+    /// Record the latency of a message that starts with a
+    /// unix_socket::header, then handle the rest of it
+    void on_timed_message(int fd, char const* data, std::size_t len, std::uint64_t now_nsec);
+
+    /// Called once for every complete message
+    void on_message(int fd, std::string_view msg);
+
+    /// Print latency percentiles since the last report
+    void report();
+
+    /// Close fd and free its slot
+    void close_client(int fd);
+
+private:
+    enum
+    {
+        ListenBacklog = 4096,             ///< max num of pending connections (capped by somaxconn)
+        EpollMaxEvents = 64,              ///< max num of pending epoll events
+        IncomingBufferSizeBytes = 65536,  ///< size of recv buffer
+        MaxMessageSizeBytes = 65536,      ///< longer messages are handled in pieces of this size
+        MaxRingBytesPerWakeup = 262144,   ///< max num of ring bytes parsed per event
+        MaxStreamBytesPerWakeup = 262144, ///< max num of socket bytes read per turn
+        AcceptRetryMsecs = 100,           ///< how long to stop accepting when out of fds
+        RecvBatchSize = 64,               ///< max num of messages per recvmmsg
+        ReportIntervalMsecs = 1000,       ///< how often to report latency
+    };
+
+    /// Set in epoll data for a ring's eventfd, whose low bits hold the
+    /// fd of the client's socket rather than the eventfd itself
+    static constexpr std::uint64_t RingEvent = std::uint64_t{1} << 32;
+
+    using clock = std::chrono::steady_clock;
+
+private:
+    server_config config_;            ///< socket type and verbosity
+    util::stat_counters& stats_;      ///< msgs, bytes and errors of this server
+    int sockfd_{-1};                  ///< listening socket
+    int epollfd_{-1};                 ///< epoll file descriptor
+    std::vector<client> clients_;     ///< indexed by fd
+    std::size_t num_clients_{0};      ///< num of connected clients
+    std::vector<int> backlog_;        ///< clients with data left after their turn
+    std::vector<int> turn_;           ///< backlog_ being served
+    bool accepting_{true};            ///< listener is in epoll
+    clock::time_point resume_accept_; ///< when to accept again, if not accepting_
+    util::pooled_buffer in_buf_;      ///< recv buffer, shared by all clients
+    std::vector<char> batch_buf_;     ///< message types: RecvBatchSize messages
+    std::vector<iovec> iovs_;         ///< iovs_[i] covers the i-th message of batch_buf_
+    std::vector<mmsghdr> msgs_;       ///< msgs_[i] scatters into iovs_[i]
+    util::histogram latency_;         ///< message types: send to receipt, in nanoseconds
+
+}; // class unix_server
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <sys/socket.h> // SOCK_DGRAM, SOCK_SEQPACKET, SOCK_STREAM
+#include <sys/un.h>     // sockaddr_un
+#include <time.h>       // ::clock_gettime
+#include <cstddef>      // offsetof
+#include <cstdint>
+#include <cstring> // std::memcpy
+#include <string_view>
+
+
+/// What unix-client and unix-server agree on: where the server listens
+/// for each socket type and, in the message-oriented types, how every
+/// message starts.
+namespace unix_socket {
+    enum class type
+    {
+        Stream,    ///< SOCK_STREAM, newline-terminated messages
+        SeqPacket, ///< SOCK_SEQPACKET, connected, boundaries kept
+        Datagram,  ///< SOCK_DGRAM, connectionless, boundaries kept
+    };
+
+    /// Largest message, header included, in the message-oriented types
+    constexpr std::size_t MaxMessageSize = 8192;
+
+    /// Put at the front of every message in the message-oriented types
+    /// so unix-server can measure latency. Both ends are on one host,
+    /// so a CLOCK_MONOTONIC timestamp means the same to each.
+    struct header
+    {
+        std::uint64_t send_time_nsec;
+    };
+
+    inline std::uint64_t
+    now_nsec()
+    {
+        timespec ts{};
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000UL
+                + static_cast<std::uint64_t>(ts.tv_nsec);
+    }
+
+    inline int
+    to_sock_type(type t)
+    {
+        switch (t) {
+            case type::SeqPacket:
+                return SOCK_SEQPACKET;
+            case type::Datagram:
+                return SOCK_DGRAM;
+            case type::Stream:
+            default:
+                return SOCK_STREAM;
+        }
+    }
+
+    /// \return \c false if str isn't "stream", "seqpacket" or "dgram"
+    inline bool
+    parse_type(std::string_view str, type& t)
+    {
+        if (str == "stream")
+            t = type::Stream;
+        else if (str == "seqpacket")
+            t = type::SeqPacket;
+        else if (str == "dgram")
+            t = type::Datagram;
+        else
+            return false;
+        return true;
+    }
+
+    /// Fill addr with the abstract address the server binds for t; a
+    /// socket type can only be bound to a name not already bound by
+    /// another, so each has its own
+    /// \return Length of the address
+    inline socklen_t
+    server_address(type t, sockaddr_un& addr)
+    {
+        using namespace std::string_view_literals;
+        std::string_view name = "\0socket"sv;
+        if (t == type::SeqPacket)
+            name = "\0socket.seqpacket"sv;
+        else if (t == type::Datagram)
+            name = "\0socket.dgram"sv;
+
+        addr = {};
+        addr.sun_family = AF_UNIX;
+        std::memcpy(static_cast<char*>(addr.sun_path), name.data(), name.size());
+        return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + name.size());
+    }
+
+} // namespace unix_socket
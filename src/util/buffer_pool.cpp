@@ -0,0 +1,254 @@
+#include "buffer_pool.hpp"
+#include <sys/mman.h> // ::madvise, ::mmap, ::munmap
+#include <algorithm>  // std::max
+#include <bit>        // std::bit_ceil, std::countr_zero
+#include <cstring>    // std::memcpy
+#include <mutex>
+
+
+namespace util {
+    namespace {
+        enum
+        {
+            CacheCapacity = 32, ///< max num of buffers per size class held by a thread
+            TransferBatch = 16, ///< num of buffers moved between a thread and the pool at once
+        };
+
+        // configure() may race with the first instance() on another
+        // thread, so the options are handed over under a lock
+        std::mutex options_mutex;
+        buffer_pool_options pending_options; ///< guarded by options_mutex
+        bool pool_created = false;           ///< guarded by options_mutex
+
+        /// Options for the pool being created; configure() fails from
+        /// now on
+        buffer_pool_options
+        take_options()
+        {
+            std::lock_guard<std::mutex> const lock(options_mutex);
+            pool_created = true;
+            return pending_options;
+        }
+
+        unsigned
+        size_class_of(std::size_t size)
+        {
+            std::size_t const rounded = std::bit_ceil(std::max(size, buffer_pool::MinBufferSize));
+            return static_cast<unsigned>(
+                    std::countr_zero(rounded) - std::countr_zero(buffer_pool::MinBufferSize));
+        }
+
+        // Free buffers are linked through their first bytes
+        char*
+        next_of(char* buf)
+        {
+            char* next = nullptr;
+            std::memcpy(static_cast<void*>(&next), buf, sizeof(next));
+            return next;
+        }
+
+        void
+        set_next(char* buf, char* next)
+        {
+            std::memcpy(buf, static_cast<void const*>(&next), sizeof(next));
+        }
+
+    } // namespace
+
+
+    /*  \struct thread_cache
+     *  \brief  Per-thread stacks of free buffers, one per size class.
+     *          Refilled from and drained to the shared free lists in
+     *          batches so the pool lock is only taken once per
+     *          TransferBatch operations.
+     */
+    struct thread_cache
+    {
+        struct bin
+        {
+            char* bufs[CacheCapacity];
+            unsigned count = 0;
+        };
+
+        bin bins[buffer_pool::NumSizeClasses];
+
+        thread_cache() = default;
+
+        // Hand everything back when the thread exits
+        ~thread_cache()
+        {
+            buffer_pool& pool = buffer_pool::instance();
+            for (unsigned sc = 0; sc < buffer_pool::NumSizeClasses; ++sc) {
+                if (bins[sc].count != 0)
+                    pool.drain(sc, static_cast<char* const*>(bins[sc].bufs), bins[sc].count);
+            }
+        }
+
+        thread_cache(thread_cache const&) = delete;
+        thread_cache(thread_cache&&) = delete;
+        thread_cache& operator=(thread_cache const&) = delete;
+        thread_cache&& operator=(thread_cache&&) = delete;
+    };
+
+    namespace {
+        thread_local thread_cache local_cache;
+    } // namespace
+
+
+    bool
+    buffer_pool::configure(buffer_pool_options const& options)
+    {
+        std::lock_guard<std::mutex> const lock(options_mutex);
+        if (pool_created)
+            return false;
+        pending_options = options;
+        return true;
+    }
+
+    buffer_pool&
+    buffer_pool::instance()
+    {
+        static buffer_pool pool(take_options());
+        return pool;
+    }
+
+    buffer_pool::buffer_pool(buffer_pool_options const& options)
+            : options_(options)
+            , mutex_()
+            , slabs_()
+    {}
+
+    buffer_pool::~buffer_pool()
+    {
+        for (slab const& s : slabs_)
+            ::munmap(s.addr, s.size);
+    }
+
+    pooled_buffer
+    buffer_pool::acquire(std::size_t size)
+    {
+        if (size > MaxBufferSize)
+            return {};
+
+        unsigned const sc = size_class_of(size);
+        thread_cache::bin& bin = local_cache.bins[sc];
+        if (bin.count == 0) {
+            bin.count = refill(sc, static_cast<char**>(bin.bufs), TransferBatch);
+            if (bin.count == 0)
+                return {};
+        }
+
+        return {bin.bufs[--bin.count], sc};
+    }
+
+    void
+    buffer_pool::release(char* buf, unsigned size_class)
+    {
+        thread_cache::bin& bin = local_cache.bins[size_class];
+        if (bin.count == CacheCapacity) {
+            bin.count -= TransferBatch;
+            drain(size_class, static_cast<char* const*>(bin.bufs) + bin.count, TransferBatch);
+        }
+        bin.bufs[bin.count++] = buf;
+    }
+
+    unsigned
+    buffer_pool::refill(unsigned size_class, char** out, unsigned count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        unsigned n = 0;
+        while (n < count) {
+            char* const buf = free_lists_[size_class];
+            if (buf == nullptr) {
+                if (!grow(size_class))
+                    break;
+                continue;
+            }
+            free_lists_[size_class] = next_of(buf);
+            out[n++] = buf;
+        }
+        return n;
+    }
+
+    void
+    buffer_pool::drain(unsigned size_class, char* const* bufs, unsigned count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (unsigned i = 0; i < count; ++i) {
+            set_next(bufs[i], free_lists_[size_class]);
+            free_lists_[size_class] = bufs[i];
+        }
+    }
+
+    bool
+    buffer_pool::grow(unsigned size_class)
+    {
+        if (mapped_bytes_ + SlabSize > options_.max_bytes)
+            return false;
+
+        // Populate up front so the first touch of a buffer on the data
+        // path doesn't page fault.
+        int const flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+        void* addr = MAP_FAILED;
+        bool huge = false;
+        if (options_.huge_pages) {
+            addr = ::mmap(nullptr, SlabSize, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+            huge = (addr != MAP_FAILED);
+        }
+        if (addr == MAP_FAILED) {
+            addr = ::mmap(nullptr, SlabSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (addr == MAP_FAILED)
+                return false;
+
+            // No hugetlbfs pages reserved; ask for transparent hugepages
+            // instead. Failure only costs tlb misses.
+            if (options_.huge_pages)
+                ::madvise(addr, SlabSize, MADV_HUGEPAGE);
+        }
+
+        slabs_.emplace_back(slab{addr, SlabSize, huge});
+        mapped_bytes_ += SlabSize;
+
+        // Thread in reverse so buffers are handed out in address order
+        std::size_t const buf_size = class_size(size_class);
+        char* const base = static_cast<char*>(addr);
+        for (std::size_t offset = SlabSize; offset >= buf_size; offset -= buf_size) {
+            char* const buf = base + offset - buf_size;
+            set_next(buf, free_lists_[size_class]);
+            free_lists_[size_class] = buf;
+        }
+
+        return true;
+    }
+
+    std::size_t
+    buffer_pool::mapped_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return mapped_bytes_;
+    }
+
+    bool
+    buffer_pool::huge_pages_active() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (slab const& s : slabs_) {
+            if (s.huge)
+                return true;
+        }
+        return false;
+    }
+
+
+    void
+    pooled_buffer::reset()
+    {
+        if (data_ == nullptr)
+            return;
+        buffer_pool::instance().release(data_, size_class_);
+        data_ = nullptr;
+    }
+
+} // namespace util
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <span>
+#include <vector>
+
+
+namespace util {
+    class pooled_buffer;
+
+    struct buffer_pool_options
+    {
+        bool huge_pages = false;           ///< back slabs with explicit hugepages
+        std::size_t max_bytes = 1UL << 30; ///< max num of bytes mapped, all classes
+    };
+
+    /*  \class  buffer_pool
+     *  \brief  Process-wide pool of I/O buffers in power-of-two size
+     *          classes from MinBufferSize to MaxBufferSize. Buffers are
+     *          carved out of large mmap'd slabs (optionally hugepage
+     *          backed) and recycled through per-thread caches, so once
+     *          warmed up acquiring and releasing a buffer neither takes a
+     *          lock nor calls malloc. Slabs are never returned to the
+     *          system while the process runs.
+     */
+    class buffer_pool
+    {
+    public:
+        static constexpr std::size_t MinBufferSize = 64;
+        static constexpr std::size_t MaxBufferSize = 65536;
+        static constexpr unsigned NumSizeClasses = 11; ///< 64 B .. 64 KiB
+        static constexpr std::size_t SlabSize = 2UL << 20;
+
+        /// Set options for the process-wide pool. Safe from any thread;
+        /// only takes effect before the first call to instance().
+        /// \return \c false if the pool has already been created
+        static bool configure(buffer_pool_options const&);
+
+        static buffer_pool& instance();
+
+        ~buffer_pool();
+
+        // No copies/moves
+        buffer_pool(buffer_pool const&) = delete;
+        buffer_pool(buffer_pool&&) = delete;
+        buffer_pool& operator=(buffer_pool const&) = delete;
+        buffer_pool&& operator=(buffer_pool&&) = delete;
+
+        /// Buffer of at least size bytes
+        /// \return Empty handle if size exceeds MaxBufferSize or the pool
+        ///         is out of memory
+        pooled_buffer acquire(std::size_t size);
+
+        static std::size_t
+        class_size(unsigned size_class)
+        {
+            return MinBufferSize << size_class;
+        }
+
+        /// \return Num of bytes mapped for slabs
+        std::size_t mapped_bytes() const;
+
+        /// \return \c true if any slab is backed by explicit hugepages
+        bool huge_pages_active() const;
+
+    private:
+        explicit buffer_pool(buffer_pool_options const&);
+
+        /// Move up to count free buffers of size_class from the shared
+        /// free list into out, mapping a new slab if needed
+        /// \return Num of buffers moved
+        unsigned refill(unsigned size_class, char** out, unsigned count);
+
+        /// Return count buffers of size_class to the shared free list
+        void drain(unsigned size_class, char* const* bufs, unsigned count);
+
+        /// Return one buffer, via the calling thread's cache
+        void release(char* buf, unsigned size_class);
+
+        /// Map a slab and thread its buffers onto the free list of
+        /// size_class. Caller holds mutex_.
+        /// \return \c false on error
+        bool grow(unsigned size_class);
+
+        friend class pooled_buffer;
+        friend struct thread_cache;
+
+    private:
+        struct slab
+        {
+            void* addr = nullptr;
+            std::size_t size = 0;
+            bool huge = false;
+        };
+
+        buffer_pool_options options_;
+        mutable std::mutex mutex_;              ///< guards everything below
+        char* free_lists_[NumSizeClasses] = {}; ///< intrusive, next ptr stored in buffer
+        std::vector<slab> slabs_;
+        std::size_t mapped_bytes_{0};
+    };
+
+
+    /*  \class  pooled_buffer
+     *  \brief  Move-only handle to a buffer from buffer_pool. The buffer
+     *          goes back to the pool when the handle is destroyed or
+     *          reset.
+     */
+    class pooled_buffer
+    {
+    public:
+        pooled_buffer() = default;
+
+        ~pooled_buffer()
+        {
+            reset();
+        }
+
+        pooled_buffer(pooled_buffer&& other) noexcept
+                : data_(other.data_)
+                , size_class_(other.size_class_)
+        {
+            other.data_ = nullptr;
+        }
+
+        pooled_buffer&
+        operator=(pooled_buffer&& other) noexcept
+        {
+            if (this != &other) {
+                reset();
+                data_ = other.data_;
+                size_class_ = other.size_class_;
+                other.data_ = nullptr;
+            }
+            return *this;
+        }
+
+        // No copies
+        pooled_buffer(pooled_buffer const&) = delete;
+        pooled_buffer& operator=(pooled_buffer const&) = delete;
+
+        char*
+        data() const
+        {
+            return data_;
+        }
+
+        /// \return Usable size, which may exceed the size requested
+        std::size_t
+        capacity() const
+        {
+            return data_ != nullptr ? buffer_pool::class_size(size_class_) : 0;
+        }
+
+        std::span<char>
+        span() const
+        {
+            return {data_, capacity()};
+        }
+
+        explicit
+        operator bool() const
+        {
+            return data_ != nullptr;
+        }
+
+        /// Return the buffer to the pool, leaving the handle empty
+        void reset();
+
+    private:
+        friend class buffer_pool;
+
+        pooled_buffer(char* data, unsigned size_class)
+                : data_(data)
+                , size_class_(size_class)
+        {}
+
+    private:
+        char* data_ = nullptr;
+        unsigned size_class_ = 0;
+    };
+
+} // namespace util
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "buffer_pool.hpp"
+#include <algorithm> // std::min
+#include <cstddef>
+#include <cstring> // std::memcpy
+#include <new>     // std::bad_alloc
+#include <span>
+
+
+namespace util {
+    /*  \class  byte_ring
+     *  \brief  Fixed-capacity, single-threaded FIFO of bytes. Storage
+     *          comes from buffer_pool, so capacity is rounded up to a
+     *          power of two and may not exceed
+     *          buffer_pool::MaxBufferSize. Data is accessed
+     *          in place through readable()/writable(), which return the
+     *          largest contiguous region at the front/back of the ring.
+     */
+    class byte_ring
+    {
+    public:
+        /// Constructs an empty ring with no storage
+        byte_ring() = default;
+
+        /// \throws std::bad_alloc If the pool can't supply the storage
+        explicit byte_ring(std::size_t capacity)
+                : buf_(buffer_pool::instance().acquire(capacity))
+                , mask_(buf_.capacity() - 1)
+        {
+            if (!buf_)
+                throw std::bad_alloc();
+        }
+
+        std::size_t
+        capacity() const
+        {
+            return buf_.capacity();
+        }
+
+        std::size_t
+        size() const
+        {
+            return tail_ - head_;
+        }
+
+        std::size_t
+        free_space() const
+        {
+            return capacity() - size();
+        }
+
+        bool
+        empty() const
+        {
+            return head_ == tail_;
+        }
+
+        bool
+        full() const
+        {
+            return size() == capacity();
+        }
+
+        /// Largest contiguous region of queued bytes, starting at the front
+        std::span<char const>
+        readable() const
+        {
+            if (empty())
+                return {};
+            std::size_t const offset = head_ & mask_;
+            return {buf_.data() + offset, std::min(size(), capacity() - offset)};
+        }
+
+        /// Largest contiguous region of free space, starting at the back
+        std::span<char>
+        writable()
+        {
+            if (full())
+                return {};
+            std::size_t const offset = tail_ & mask_;
+            return {buf_.data() + offset, std::min(free_space(), capacity() - offset)};
+        }
+
+        /// Mark n bytes written to writable() as queued
+        void
+        commit(std::size_t n)
+        {
+            tail_ += n;
+        }
+
+        /// Drop n bytes from the front
+        void
+        consume(std::size_t n)
+        {
+            head_ += n;
+        }
+
+        /// Copy as much of [data, data+len) into the ring as will fit
+        /// \return Num of bytes copied
+        std::size_t
+        write(void const* data, std::size_t len)
+        {
+            auto const* src = static_cast<char const*>(data);
+            std::size_t written = 0;
+            while (written < len) {
+                std::span<char> const dst = writable();
+                if (dst.empty())
+                    break;
+                std::size_t const n = std::min(dst.size(), len - written);
+                std::memcpy(dst.data(), src + written, n);
+                commit(n);
+                written += n;
+            }
+            return written;
+        }
+
+    private:
+        pooled_buffer buf_;
+        std::size_t mask_ = 0;
+        std::size_t head_ = 0; ///< total num of bytes consumed
+        std::size_t tail_ = 0; ///< total num of bytes committed
+    };
+
+} // namespace util
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <thread> // std::this_thread
+
+
+namespace util {
+    /// Alignment that keeps independently written data on separate cache
+    /// lines. Fixed rather than std::hardware_destructive_interference_size,
+    /// which is allowed to differ between translation units.
+    inline constexpr std::size_t CacheLineSize = 64;
+
+    /// Tell the cpu this is a spin-wait loop
+    inline void
+    cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    /*  \class  busy_spin
+     *  \brief  Wait strategy that never gives up the cpu. Lowest latency;
+     *          burns a core while idle.
+     */
+    struct busy_spin
+    {
+        void
+        operator()()
+        {
+            cpu_relax();
+        }
+
+        void
+        reset()
+        {}
+    };
+
+    /*  \class  yield_wait
+     *  \brief  Wait strategy that yields to other runnable threads.
+     */
+    struct yield_wait
+    {
+        void
+        operator()()
+        {
+            std::this_thread::yield();
+        }
+
+        void
+        reset()
+        {}
+    };
+
+    /*  \class  backoff_wait
+     *  \brief  Wait strategy that spins briefly, then yields, then sleeps,
+     *          so a short gap costs little latency and a long one costs
+     *          little cpu. Call reset() after work was found.
+     */
+    class backoff_wait
+    {
+    public:
+        void
+        operator()()
+        {
+            if (attempt_ < SpinLimit) {
+                cpu_relax();
+                ++attempt_;
+            } else if (attempt_ < YieldLimit) {
+                std::this_thread::yield();
+                ++attempt_;
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(SleepUsecs));
+            }
+        }
+
+        void
+        reset()
+        {
+            attempt_ = 0;
+        }
+
+    private:
+        static constexpr unsigned SpinLimit = 1000;  ///< num of waits spent spinning
+        static constexpr unsigned YieldLimit = 1100; ///< then yielding until this many
+        static constexpr int SleepUsecs = 50;        ///< then sleeping this long per wait
+        unsigned attempt_ = 0;
+    };
+
+} // namespace util
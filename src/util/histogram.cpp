@@ -0,0 +1,61 @@
+#include "histogram.hpp"
+#include <algorithm> // std::clamp, std::max, std::min
+#include <cmath>     // std::ceil
+
+
+namespace util {
+    void
+    histogram::merge(histogram const& other)
+    {
+        for (std::size_t i = 0; i < NumBuckets; ++i)
+            counts_[i] += other.counts_[i];
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void
+    histogram::reset()
+    {
+        *this = histogram();
+    }
+
+    double
+    histogram::mean() const
+    {
+        if (count_ == 0)
+            return 0.0;
+        return static_cast<double>(sum_) / static_cast<double>(count_);
+    }
+
+    std::uint64_t
+    histogram::percentile(double p) const
+    {
+        if (count_ == 0)
+            return 0;
+
+        p = std::clamp(p, 0.0, 100.0);
+        auto target = static_cast<std::uint64_t>(std::ceil(p / 100.0 * static_cast<double>(count_)));
+        target = std::max<std::uint64_t>(target, 1);
+
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < NumBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= target)
+                return std::min(highest_equivalent(i), max_);
+        }
+        return max_;
+    }
+
+    std::uint64_t
+    histogram::highest_equivalent(std::size_t index)
+    {
+        if (index < 2 * SubBuckets)
+            return index;
+        std::size_t const shift = index / SubBuckets - 1;
+        std::uint64_t const mantissa = index - shift * SubBuckets;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+} // namespace util
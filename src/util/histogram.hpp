@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <bit> // std::bit_width
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+
+namespace util {
+    /*  \class  histogram
+     *  \brief  Log-linear histogram of unsigned 64-bit values in the
+     *          style of HdrHistogram. Values below 2*SubBuckets are
+     *          counted exactly. Above that, every power-of-two range is
+     *          split into SubBuckets equal buckets, which keeps the
+     *          relative error under 1/SubBuckets across the whole range.
+     *          Recording is a few integer instructions and never
+     *          allocates.
+     */
+    class histogram
+    {
+    public:
+        static constexpr unsigned SubBucketBits = 6;
+        static constexpr std::uint64_t SubBuckets = 1U << SubBucketBits;
+        static constexpr std::size_t NumBuckets = (64 - SubBucketBits + 1) * SubBuckets;
+
+        void
+        record(std::uint64_t value)
+        {
+            ++counts_[index_of(value)];
+            ++count_;
+            sum_ += value;
+            if (value < min_)
+                min_ = value;
+            if (value > max_)
+                max_ = value;
+        }
+
+        /// Add all values recorded in other
+        void merge(histogram const& other);
+
+        void reset();
+
+        std::uint64_t
+        count() const
+        {
+            return count_;
+        }
+
+        /// \return 0 if empty
+        std::uint64_t
+        min() const
+        {
+            return count_ != 0 ? min_ : 0;
+        }
+
+        std::uint64_t
+        max() const
+        {
+            return max_;
+        }
+
+        /// \return 0 if empty
+        double mean() const;
+
+        /// Smallest recorded value v such that at least p percent of all
+        /// values are <= v, to within bucket precision
+        /// \param p In the range [0, 100]
+        /// \return 0 if empty
+        std::uint64_t percentile(double p) const;
+
+    private:
+        static std::size_t
+        index_of(std::uint64_t value)
+        {
+            if (value < 2 * SubBuckets)
+                return value;
+            int const shift = std::bit_width(value) - 1 - static_cast<int>(SubBucketBits);
+            return static_cast<std::size_t>(shift) * SubBuckets + (value >> shift);
+        }
+
+        /// \return Largest value that maps to bucket index
+        static std::uint64_t highest_equivalent(std::size_t index);
+
+    private:
+        std::array<std::uint64_t, NumBuckets> counts_{};
+        std::uint64_t count_{0};
+        std::uint64_t sum_{0};
+        std::uint64_t min_{std::numeric_limits<std::uint64_t>::max()};
+        std::uint64_t max_{0};
+    };
+
+} // namespace util
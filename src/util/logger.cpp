@@ -0,0 +1,120 @@
+#include "logger.hpp"
+#include <algorithm> // std::min, std::stable_sort
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <print>
+
+
+namespace util {
+    logger&
+    logger::instance()
+    {
+        static logger log;
+        return log;
+    }
+
+    logger::logger()
+            : mutex_()
+            , rings_()
+            , batch_()
+            , thread_([this](std::stop_token stop) { run(std::move(stop)); })
+    {}
+
+    logger::~logger()
+    {
+        thread_.request_stop();
+        thread_.join();
+        flush();
+    }
+
+    void
+    logger::flush()
+    {
+        while (drain() != 0) {}
+    }
+
+    logger::ring&
+    logger::local_ring()
+    {
+        // Hands the ring back for reuse when the thread exits; whatever
+        // it queued is still written
+        struct owner
+        {
+            thread_ring* r = nullptr;
+
+            ~owner()
+            {
+                if (r != nullptr)
+                    r->owned.store(false, std::memory_order_release);
+            }
+        };
+        thread_local owner local;
+
+        if (local.r == nullptr) [[unlikely]] {
+            std::lock_guard<std::mutex> const lock(mutex_);
+            for (auto& r : rings_) {
+                if (!r->owned.load(std::memory_order_acquire)) {
+                    r->owned.store(true, std::memory_order_relaxed);
+                    local.r = r.get();
+                    break;
+                }
+            }
+            if (local.r == nullptr)
+                local.r = rings_.emplace_back(std::make_unique<thread_ring>()).get();
+        }
+        return local.r->records;
+    }
+
+    std::size_t
+    logger::drain()
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+
+        for (auto& r : rings_) {
+            detail::log_record rec;
+            while (r->records.try_pop(rec))
+                batch_.push_back(rec);
+        }
+
+        std::stable_sort(batch_.begin(), batch_.end(),
+                [](auto const& a, auto const& b) { return a.time_nsec < b.time_nsec; });
+
+        for (auto const& rec : batch_) {
+            std::FILE* const out
+                    = rec.level == static_cast<std::uint32_t>(log_level::Error) ? stderr : stdout;
+            std::println(out, "{}", rec.decode({rec.fmt, rec.fmt_len}, rec.args.data()));
+        }
+
+        std::uint64_t const dropped = dropped_.exchange(0, std::memory_order_relaxed);
+        if (dropped != 0)
+            std::println(stderr, "warning: {} log messages dropped", dropped);
+
+        std::size_t const n = batch_.size();
+        batch_.clear();
+        return n;
+    }
+
+    void
+    logger::run(std::stop_token stop)
+    {
+        // Log calls make no syscalls, so nothing wakes this thread;
+        // backing off keeps an idle process from being woken every
+        // interval, and the wait still ends as soon as stop is requested
+        std::mutex mutex;
+        std::condition_variable_any stopped;
+        auto idle = std::chrono::microseconds(IdleSleepMinUsecs);
+        while (!stop.stop_requested()) {
+            if (drain() != 0) {
+                idle = std::chrono::microseconds(IdleSleepMinUsecs);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            stopped.wait_for(lock, stop, idle, [] { return false; });
+            idle = std::min(idle * 2, std::chrono::microseconds(IdleSleepMaxUsecs));
+        }
+    }
+
+} // namespace util
@@ -0,0 +1,252 @@
+#pragma once
+
+#include "spsc_ring.hpp"
+#include <time.h> // ::clock_gettime
+#include <algorithm> // std::min
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcpy
+#include <format>
+#include <memory> // std::unique_ptr
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread> // std::jthread
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+
+namespace util {
+    enum class log_level : std::uint8_t
+    {
+        Info,  ///< written to stdout
+        Error, ///< written to stderr
+    };
+
+    namespace detail {
+        template <typename T>
+        concept log_string = std::is_same_v<std::decay_t<T>, char const*>
+                || std::is_same_v<std::decay_t<T>, char*>
+                || std::is_same_v<std::decay_t<T>, std::string>
+                || std::is_same_v<std::decay_t<T>, std::string_view>;
+
+        template <typename T>
+        concept log_value = std::is_trivially_copyable_v<std::decay_t<T>> && !log_string<T>;
+
+        /// How an argument is kept in a record: strings by value, as a
+        /// view into the record once decoded
+        template <typename T>
+        using log_stored_t = std::conditional_t<log_string<T>, std::string_view, std::decay_t<T>>;
+
+        /// One log call, formatted later by the logger thread
+        struct log_record
+        {
+            using decoder = std::string (*)(std::string_view fmt, char const* args);
+
+            static constexpr std::size_t Size = 256;
+            static constexpr std::size_t HeaderSize = sizeof(decoder) + sizeof(char const*)
+                    + sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t);
+            static constexpr std::size_t ArgsSize = Size - HeaderSize;
+
+            decoder decode = nullptr;
+            char const* fmt = nullptr;    ///< string literal; never copied
+            std::uint64_t time_nsec = 0;  ///< CLOCK_MONOTONIC, to order threads' records
+            std::uint32_t fmt_len = 0;
+            std::uint32_t level = 0;      ///< log_level
+            std::array<char, ArgsSize> args;
+        };
+        static_assert(sizeof(log_record) == log_record::Size);
+
+        /// Appends arguments to a record. Fixed-size arguments and string
+        /// length prefixes are always reserved; string bytes share the rest.
+        class log_writer
+        {
+        public:
+            explicit log_writer(char* out, std::size_t string_room)
+                    : out_(out)
+                    , string_room_(string_room)
+            {}
+
+            template <typename T>
+            void
+            put(T const& value)
+            {
+                if constexpr (log_string<T>) {
+                    std::string_view const sv(value);
+                    auto const len = static_cast<std::uint16_t>(std::min(sv.size(), string_room_));
+                    std::memcpy(out_, &len, sizeof(len));
+                    std::memcpy(out_ + sizeof(len), sv.data(), len);
+                    out_ += sizeof(len) + len;
+                    string_room_ -= len;
+                } else {
+                    std::memcpy(out_, &value, sizeof(value));
+                    out_ += sizeof(value);
+                }
+            }
+
+        private:
+            char* out_;
+            std::size_t string_room_;
+        };
+
+        template <typename T>
+        T
+        log_read(char const*& in)
+        {
+            if constexpr (std::is_same_v<T, std::string_view>) {
+                std::uint16_t len = 0;
+                std::memcpy(&len, in, sizeof(len));
+                std::string_view const sv(in + sizeof(len), len);
+                in += sizeof(len) + len;
+                return sv;
+            } else {
+                T value;
+                std::memcpy(&value, in, sizeof(value));
+                in += sizeof(value);
+                return value;
+            }
+        }
+
+        template <typename... Args>
+        std::string
+        log_decode(std::string_view fmt, [[maybe_unused]] char const* args)
+        {
+            // Braced initialization reads the arguments in order
+            std::tuple<log_stored_t<Args>...> values{log_read<log_stored_t<Args>>(args)...};
+            return std::apply(
+                    [fmt](auto&... v) { return std::vformat(fmt, std::make_format_args(v...)); },
+                    values);
+        }
+
+        /// Bytes needed by the fixed-size arguments, plus the length
+        /// prefix of each string
+        template <typename... Args>
+        constexpr std::size_t
+        log_fixed_size()
+        {
+            return ((log_string<Args> ? sizeof(std::uint16_t) : sizeof(std::decay_t<Args>)) + ...
+                    + 0);
+        }
+
+    } // namespace detail
+
+    /*  \class  logger
+     *  \brief  Deferred logger for hot paths. A log call copies a pointer
+     *          to its (literal) format string, a decoder instantiated for
+     *          its argument types and the raw argument bytes into a
+     *          fixed-size record on the calling thread's own
+     *          lock-free ring; formatting and writing happen on a
+     *          background thread, so the caller makes no syscalls and
+     *          does no formatting. Each pass of the background thread
+     *          writes what it picked up from every ring in timestamp
+     *          order, but a record queued just after a pass can follow
+     *          later-stamped ones written by it. Strings are copied and
+     *          truncated to fit the record. If a thread's ring is full,
+     *          the record is dropped and counted. While the rings stay
+     *          empty the thread polls less and less often. Everything
+     *          queued is written when the logger is destroyed at exit.
+     */
+    class logger
+    {
+    public:
+        static logger& instance();
+
+        ~logger();
+
+        // No copies/moves
+        logger(logger const&) = delete;
+        logger(logger&&) = delete;
+        logger& operator=(logger const&) = delete;
+        logger&& operator=(logger&&) = delete;
+
+        template <typename... Args>
+            requires((detail::log_string<Args> || detail::log_value<Args>) && ...)
+        void
+        log(log_level level, std::format_string<Args const&...> fmt, Args const&... args)
+        {
+            static_assert(detail::log_fixed_size<Args...>() <= detail::log_record::ArgsSize,
+                    "too many log arguments");
+
+            detail::log_record rec;
+            rec.decode = &detail::log_decode<Args...>;
+            std::string_view const f = fmt.get();
+            rec.fmt = f.data();
+            rec.fmt_len = static_cast<std::uint32_t>(f.size());
+            rec.level = static_cast<std::uint32_t>(level);
+            timespec ts{};
+            ::clock_gettime(CLOCK_MONOTONIC, &ts);
+            rec.time_nsec = static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000U
+                    + static_cast<std::uint64_t>(ts.tv_nsec);
+
+            detail::log_writer w(
+                    rec.args.data(), rec.args.size() - detail::log_fixed_size<Args...>());
+            (w.put(args), ...);
+
+            if (!local_ring().try_push(rec))
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /// Set up the calling thread's ring now rather than on its first
+        /// message, which would otherwise take a lock and allocate
+        void
+        add_thread()
+        {
+            local_ring();
+        }
+
+        /// Write everything queued so far before returning
+        void flush();
+
+    private:
+        using ring = spsc_ring<detail::log_record>;
+
+        struct thread_ring
+        {
+            ring records{RingCapacity};
+            std::atomic<bool> owned{true}; ///< false once its thread has exited
+        };
+
+        logger();
+
+        /// The calling thread's ring, created on first use
+        ring& local_ring();
+
+        /// Pop, order and write everything queued
+        /// \return Num of records written
+        std::size_t drain();
+
+        void run(std::stop_token stop);
+
+    private:
+        static constexpr std::size_t RingCapacity = 1024; ///< records per thread
+        static constexpr int IdleSleepMinUsecs = 1000;    ///< first poll interval when idle
+        static constexpr int IdleSleepMaxUsecs = 100'000; ///< doubled up to this while idle
+
+        std::mutex mutex_;                                ///< guards rings_ and draining
+        std::vector<std::unique_ptr<thread_ring>> rings_; ///< never shrinks
+        std::vector<detail::log_record> batch_;           ///< drained, not yet written
+        std::atomic<std::uint64_t> dropped_{0};           ///< records lost to full rings
+        std::jthread thread_;                             ///< last, so it stops first
+    };
+
+    /// Queue a message for stderr; a newline is appended
+    template <typename... Args>
+    void
+    log_error(std::format_string<Args const&...> fmt, Args const&... args)
+    {
+        logger::instance().log<Args...>(log_level::Error, fmt, args...);
+    }
+
+    /// Queue a message for stdout; a newline is appended
+    template <typename... Args>
+    void
+    log_info(std::format_string<Args const&...> fmt, Args const&... args)
+    {
+        logger::instance().log<Args...>(log_level::Info, fmt, args...);
+    }
+
+} // namespace util
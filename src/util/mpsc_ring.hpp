@@ -0,0 +1,203 @@
+#pragma once
+
+#include "concurrency.hpp"
+#include <atomic>
+#include <bit> // std::bit_ceil
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory> // std::unique_ptr
+#include <utility>
+
+
+namespace util {
+    /*  \class  mpsc_ring
+     *  \brief  Bounded, lock-free FIFO for any number of producer threads
+     *          and one consumer thread. Capacity is rounded up to a power
+     *          of two. Each slot carries a sequence number (Vyukov's
+     *          bounded queue) that says whether it is free for the
+     *          current lap or holds a published item, so producers only
+     *          contend on the tail index and never wait on each other to
+     *          finish writing. A batch push claims all its slots with a
+     *          single CAS on the tail. Items are popped in the order their
+     *          slots were claimed; a producer stalled between claiming and
+     *          publishing holds up the consumer until it finishes.
+     */
+    template <typename T>
+        requires std::default_initializable<T> && std::movable<T>
+    class mpsc_ring
+    {
+    public:
+        explicit mpsc_ring(std::size_t capacity)
+                : mask_(std::bit_ceil(capacity < 2 ? 2 : capacity) - 1)
+                , slots_(std::make_unique<slot[]>(mask_ + 1))
+        {
+            for (std::size_t i = 0; i <= mask_; ++i)
+                slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        // No copies/moves
+        mpsc_ring(mpsc_ring const&) = delete;
+        mpsc_ring(mpsc_ring&&) = delete;
+        mpsc_ring& operator=(mpsc_ring const&) = delete;
+        mpsc_ring&& operator=(mpsc_ring&&) = delete;
+
+        std::size_t
+        capacity() const
+        {
+            return mask_ + 1;
+        }
+
+        /// Exact only while no thread is pushing or popping. Counts
+        /// claimed slots, published or not.
+        std::size_t
+        size() const
+        {
+            return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+        }
+
+        bool
+        empty() const
+        {
+            return size() == 0;
+        }
+
+        /// Any thread
+        /// \return \c false if full
+        bool
+        try_push(T const& value)
+        {
+            return put(value);
+        }
+
+        /// Any thread. value is left untouched if the ring is full.
+        /// \return \c false if full
+        bool
+        try_push(T&& value)
+        {
+            return put(std::move(value));
+        }
+
+        /// Any thread. Copy as many of [items, items+n) as will fit,
+        /// claiming their slots with a single CAS on the tail.
+        /// \return Num of items pushed
+        std::size_t
+        try_push(T const* items, std::size_t n)
+        {
+            std::size_t pos = tail_.load(std::memory_order_relaxed);
+            std::size_t claimed = 0;
+            while (true) {
+                // The consumer frees slots in order and bumps head_ after
+                // releasing them, so every slot below head_ + capacity is
+                // free for this lap
+                std::size_t const used = pos - head_.load(std::memory_order_acquire);
+                if (used > capacity()) {
+                    pos = tail_.load(std::memory_order_relaxed); // pos is stale
+                    continue;
+                }
+                std::size_t const room = capacity() - used;
+                claimed = n < room ? n : room;
+                if (claimed == 0)
+                    return 0;
+                if (tail_.compare_exchange_weak(pos, pos + claimed, std::memory_order_relaxed))
+                    break;
+            }
+            for (std::size_t i = 0; i < claimed; ++i) {
+                slot& s = slots_[(pos + i) & mask_];
+                s.value = items[i];
+                s.seq.store(pos + i + 1, std::memory_order_release);
+            }
+            return claimed;
+        }
+
+        /// Any thread. Waits for room.
+        template <typename Wait = busy_spin>
+        void
+        push(T value, Wait wait = {})
+        {
+            while (!try_push(std::move(value)))
+                wait();
+        }
+
+        /// Consumer only
+        /// \return \c false if empty
+        bool
+        try_pop(T& value)
+        {
+            return try_pop(&value, 1) == 1;
+        }
+
+        /// Consumer only. Move up to max published items into out.
+        /// \return Num of items popped
+        std::size_t
+        try_pop(T* out, std::size_t max)
+        {
+            std::size_t const head = head_.load(std::memory_order_relaxed);
+            std::size_t n = 0;
+            for (; n < max; ++n) {
+                slot& s = slots_[(head + n) & mask_];
+                if (s.seq.load(std::memory_order_acquire) != head + n + 1)
+                    break;
+                out[n] = std::move(s.value);
+                s.seq.store(head + n + capacity(), std::memory_order_release);
+            }
+            if (n != 0)
+                head_.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+        /// Consumer only. Waits for an item.
+        template <typename Wait = busy_spin>
+        T
+        pop(Wait wait = {})
+        {
+            T value;
+            while (!try_pop(value))
+                wait();
+            return value;
+        }
+
+    private:
+        struct slot
+        {
+            std::atomic<std::size_t> seq{0}; ///< pos if free, pos+1 if published
+            T value{};
+        };
+
+        /// Claim the next slot and assign value only once it is ours
+        template <typename U>
+        bool
+        put(U&& value)
+        {
+            std::size_t pos = tail_.load(std::memory_order_relaxed);
+            slot* s = nullptr;
+            while (true) {
+                s = &slots_[pos & mask_];
+                std::size_t const seq = s->seq.load(std::memory_order_acquire);
+                auto const dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+                if (dif == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                } else if (dif < 0) {
+                    return false; // consumer hasn't freed it yet
+                } else {
+                    pos = tail_.load(std::memory_order_relaxed); // lost a race
+                }
+            }
+            s->value = std::forward<U>(value);
+            s->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Read-only after construction
+        std::size_t const mask_;
+        std::unique_ptr<slot[]> const slots_;
+
+        // Producers' line
+        alignas(CacheLineSize) std::atomic<std::size_t> tail_{0};
+
+        // Consumer's line; producers read head_ to size a batch push
+        alignas(CacheLineSize) std::atomic<std::size_t> head_{0};
+    };
+
+} // namespace util
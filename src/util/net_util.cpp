@@ -1,7 +1,9 @@
 #include "net_util.hpp"
 #include <arpa/inet.h>
 #include <ifaddrs.h> // ::freeifaddrs, ::getifaddrs
+#include <net/if.h>  // ifreq, IFNAMSIZ
 #include <netdb.h>   // ::getnameinfo, NI_MAXHOST, NI_MAXSERV
+#include <sys/ioctl.h>  // ::ioctl, SIOCGIFMTU
 #include <sys/socket.h>
 #include <sys/socket.h> // ::getnameinfo
 #include <sys/types.h>  // ::freeifaddrs, ::getifaddrs
@@ -13,11 +15,19 @@
 #include <cstdio> // std::fprintf, std::printf
 #include <cstdlib>
 #include <cstring> // std::strerror, std::strlen
+#include <format>
 #include <set>
 #include <stdexcept>
 #include <unordered_map>
 
 namespace net {
+    static_assert(parse_ip_port("239.255.0.1:30001")->port == 30001);
+    static_assert(parse_ip_port("239.255.0.1:30001")->addr[0] == 239);
+    static_assert(parse_ip_port("[::ffff:10.0.0.1]:1")->addr[15] == 1);
+    static_assert(parse_ip_port("[2001:db8::1]:0")->addr[1] == 0x01);
+    static_assert(!parse_ip_port("1.2.3:4") && !parse_ip_port("01.2.3.4:5"));
+    static_assert(!parse_ip_port("::1:5") && !parse_ip_port("1.2.3.4:65536"));
+
     char const*
     family_to_string(int family)
     {
@@ -73,7 +83,7 @@ namespace net {
                 map[name].stats = *static_cast<rtnl_link_stats*>(i->ifa_data);
             }
 
-            map[name].addresses.emplace_back(std::make_tuple(host, service));
+            map[name].addresses.push_back({.host = host, .service = service});
         }
         ::freeifaddrs(ifs);
 
@@ -86,22 +96,15 @@ namespace net {
     }
 
 
-    std::tuple<std::string, std::uint16_t>
-    parse_ip_port(std::string const& ip_port)
+    std::string
+    to_string(endpoint const& ep)
     {
-        static auto error = std::make_tuple("", 0);
-
-        std::string::size_type const colon = ip_port.find_first_of(':');
-        if (colon == std::string::npos)
-            return error;
-
-        std::string const ip = ip_port.substr(0, colon);
-        std::string const port = ip_port.substr(colon + 1);
-
-        if (ip.empty() || port.empty())
-            return error;
-
-        return std::make_tuple(ip, static_cast<std::uint16_t>(std::stoi(port)));
+        char host[INET6_ADDRSTRLEN] = {};
+        ::inet_ntop(ep.family, ep.addr.data(), static_cast<char*>(host), sizeof(host));
+        std::string_view const ip(static_cast<char const*>(host));
+        if (ep.family == AF_INET6)
+            return std::format("[{}]:{}", ip, ep.port);
+        return std::format("{}:{}", ip, ep.port);
     }
 
     std::string
@@ -150,4 +153,42 @@ namespace net {
         return address;
     }
 
+    int
+    interface_mtu(std::string_view name)
+    {
+        if (name.empty() || name.size() >= IFNAMSIZ)
+            return 0;
+
+        int const sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock == -1)
+            throw std::runtime_error(std::string("error: socket: ") + std::strerror(errno));
+
+        ifreq req = {};
+        std::memcpy(req.ifr_name, name.data(), name.size()); // NOLINT
+        int const rv = ::ioctl(sock, SIOCGIFMTU, &req);
+        int const error = errno;
+        ::close(sock);
+        if (rv == -1) {
+            if (error == ENODEV)
+                return 0;
+            throw std::runtime_error(
+                    std::string("error: ioctl(SIOCGIFMTU): ") + std::strerror(error));
+        }
+
+        return req.ifr_mtu; // NOLINT
+    }
+
+    bool
+    set_busy_poll(int sock, int usecs)
+    {
+        return ::setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == 0;
+    }
+
+    bool
+    set_prefer_busy_poll(int sock)
+    {
+        int const yes = 1;
+        return ::setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &yes, sizeof(yes)) == 0;
+    }
+
 } // namespace net
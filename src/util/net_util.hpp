@@ -1,20 +1,32 @@
 #pragma once
 
 #include <linux/if_link.h> // rtnl_link_stats
+#include <netinet/in.h>    // sockaddr_in, sockaddr_in6
+#include <sys/socket.h>    // sockaddr_storage, socklen_t, AF_*
+#include <array>
+#include <bit> // std::bit_cast
+#include <cstddef>
 #include <cstdint>
+#include <cstring> // std::memcpy
+#include <optional>
 #include <string>
 #include <string_view>
-#include <tuple>
 #include <vector>
 
 
 namespace net {
     struct interface
     {
+        struct address
+        {
+            std::string host;    ///< numeric ip, empty if not ipv4/6
+            std::string service; ///< numeric port
+        };
+
         std::string name;
         std::uint32_t flags = 0;
         std::vector<std::int32_t> families;
-        std::vector<std::tuple<std::string, std::string>> addresses;
+        std::vector<address> addresses;
         rtnl_link_stats stats{};
     };
 
@@ -24,13 +36,211 @@ namespace net {
     /// \returns Empty string if unknown family
     char const* family_to_string(int family);
 
-    /// Parses string of form "ip:port"
-    /// \returns Tuple of {empty string, 0} if invalid format
-    std::tuple<std::string, std::uint16_t> parse_ip_port(std::string const&);
+    /// Binary ip address and port, as produced by parse_ip_port
+    struct endpoint
+    {
+        int family = AF_UNSPEC;              ///< AF_INET or AF_INET6
+        std::array<std::uint8_t, 16> addr{}; ///< network byte order; ipv4 uses the first 4
+        std::uint16_t port = 0;              ///< host byte order
+
+        /// \return Ipv4 address as in in_addr::s_addr (network byte order)
+        constexpr std::uint32_t
+        ipv4() const
+        {
+            return std::bit_cast<std::uint32_t>(std::array<std::uint8_t, 4>{
+                    addr[0], addr[1], addr[2], addr[3]});
+        }
+
+        /// Fill storage with the sockaddr_in or sockaddr_in6 for this
+        /// endpoint
+        /// \return Length of the address written
+        socklen_t
+        to_sockaddr(sockaddr_storage& storage) const
+        {
+            storage = {};
+            if (family == AF_INET6) {
+                auto* const sa = reinterpret_cast<sockaddr_in6*>(&storage);
+                sa->sin6_family = AF_INET6;
+                sa->sin6_port = htons(port);
+                std::memcpy(&sa->sin6_addr, addr.data(), sizeof(sa->sin6_addr));
+                return sizeof(sockaddr_in6);
+            }
+            auto* const sa = reinterpret_cast<sockaddr_in*>(&storage);
+            sa->sin_family = AF_INET;
+            sa->sin_port = htons(port);
+            sa->sin_addr.s_addr = ipv4();
+            return sizeof(sockaddr_in);
+        }
+
+        friend constexpr bool operator==(endpoint const&, endpoint const&) = default;
+    };
+
+    namespace detail {
+        constexpr std::optional<std::uint32_t>
+        parse_number(std::string_view str, unsigned base, std::size_t max_digits)
+        {
+            if (str.empty() || str.size() > max_digits)
+                return std::nullopt;
+
+            std::uint32_t value = 0;
+            for (char const c : str) {
+                unsigned digit = base;
+                if (c >= '0' && c <= '9')
+                    digit = static_cast<unsigned>(c - '0');
+                else if (c >= 'a' && c <= 'f')
+                    digit = static_cast<unsigned>(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F')
+                    digit = static_cast<unsigned>(c - 'A' + 10);
+                if (digit >= base)
+                    return std::nullopt;
+                value = value * base + digit;
+            }
+            return value;
+        }
+
+        /// Dotted quad; like inet_pton, no leading zeros
+        constexpr bool
+        parse_ipv4(std::string_view str, std::uint8_t* out)
+        {
+            for (int i = 0; i < 4; ++i) {
+                std::size_t const dot = str.find('.');
+                if ((i < 3) == (dot == std::string_view::npos))
+                    return false;
+
+                std::string_view const octet = str.substr(0, dot);
+                auto const value = parse_number(octet, 10, 3);
+                if (!value || *value > 255 || (octet.size() > 1 && octet[0] == '0'))
+                    return false;
+                out[i] = static_cast<std::uint8_t>(*value);
+                str.remove_prefix(i < 3 ? dot + 1 : str.size());
+            }
+            return true;
+        }
+
+        /// RFC 4291 text form: up to 8 groups of 1-4 hex digits, at most
+        /// one "::", optionally ending in a dotted quad. No zone ids.
+        constexpr bool
+        parse_ipv6(std::string_view str, std::uint8_t* out)
+        {
+            std::array<std::uint8_t, 16> bytes{};
+            std::size_t n = 0;      // bytes parsed
+            bool has_gap = false;   // seen "::"
+            std::size_t gap = 0;    // bytes parsed before "::"
+            if (str.starts_with("::")) {
+                has_gap = true;
+                str.remove_prefix(2);
+            }
+
+            while (!str.empty()) {
+                std::size_t const colon = str.find(':');
+                std::string_view const group = str.substr(0, colon);
+
+                if (group.find('.') != std::string_view::npos) {
+                    // Embedded ipv4, only as the last 32 bits
+                    if (colon != std::string_view::npos || n > 12
+                            || !parse_ipv4(group, bytes.data() + n))
+                        return false;
+                    n += 4;
+                    break;
+                }
+
+                auto const value = parse_number(group, 16, 4);
+                if (!value || n == 16)
+                    return false;
+                bytes[n++] = static_cast<std::uint8_t>(*value >> 8);
+                bytes[n++] = static_cast<std::uint8_t>(*value);
+
+                if (colon == std::string_view::npos)
+                    break;
+                str.remove_prefix(colon + 1);
+                if (str.starts_with(':')) {
+                    if (has_gap)
+                        return false;
+                    has_gap = true;
+                    gap = n;
+                    str.remove_prefix(1);
+                } else if (str.empty()) {
+                    return false; // trailing single colon
+                }
+            }
+
+            if (has_gap ? n == 16 : n != 16)
+                return false;
+
+            // Zeros fill the gap: move what followed it to the end
+            std::size_t const tail = has_gap ? n - gap : 0;
+            for (std::size_t i = 0; i < 16; ++i)
+                out[i] = 0;
+            for (std::size_t i = 0; i < n - tail; ++i)
+                out[i] = bytes[i];
+            for (std::size_t i = 0; i < tail; ++i)
+                out[16 - tail + i] = bytes[n - tail + i];
+            return true;
+        }
+
+    } // namespace detail
+
+    /// Parses string of form "ip:port" or "[ipv6]:port" without
+    /// allocating; usable in constant expressions
+    /// \returns std::nullopt if invalid format, address or port
+    constexpr std::optional<endpoint>
+    parse_ip_port(std::string_view ip_port)
+    {
+        endpoint ep;
+        std::string_view host;
+        std::string_view port;
+
+        if (ip_port.starts_with('[')) {
+            std::size_t const close = ip_port.find(']');
+            if (close == std::string_view::npos || ip_port.substr(close + 1, 1) != ":")
+                return std::nullopt;
+            host = ip_port.substr(1, close - 1);
+            port = ip_port.substr(close + 2);
+            ep.family = AF_INET6;
+            if (!detail::parse_ipv6(host, ep.addr.data()))
+                return std::nullopt;
+        } else {
+            std::size_t const colon = ip_port.find(':');
+            if (colon == std::string_view::npos || ip_port.find(':', colon + 1) != ip_port.npos)
+                return std::nullopt; // no port, or an unbracketed ipv6 address
+            host = ip_port.substr(0, colon);
+            port = ip_port.substr(colon + 1);
+            ep.family = AF_INET;
+            if (!detail::parse_ipv4(host, ep.addr.data()))
+                return std::nullopt;
+        }
+
+        auto const value = detail::parse_number(port, 10, 5);
+        if (!value || *value > UINT16_MAX)
+            return std::nullopt;
+        ep.port = static_cast<std::uint16_t>(*value);
+        return ep;
+    }
+
+    /// \returns "ip:port", or "[ipv6]:port"
+    std::string to_string(endpoint const&);
 
     /// Resolve interface name to ip
     /// \returns Empty string if invalid interface
     /// \throws std::exception On unexpected error
     std::string resolve_interface(std::string_view);
 
+    /// Mtu of the named interface
+    /// \returns 0 if no such interface
+    /// \throws std::exception On unexpected error
+    int interface_mtu(std::string_view);
+
+    /// Have non-blocking reads on sock poll the device queue for up to
+    /// usecs before giving up (SO_BUSY_POLL). Raising usecs above
+    /// net.core.busy_read requires CAP_NET_ADMIN.
+    /// \return \c false on error, with errno set
+    bool set_busy_poll(int sock, int usecs);
+
+    /// Ask the kernel to leave the device queue to busy polling rather
+    /// than interrupts while sock is polling it (SO_PREFER_BUSY_POLL).
+    /// Needs Linux 5.11 and CAP_NET_ADMIN; busy polling works without
+    /// it, only with interrupts competing.
+    /// \return \c false on error, with errno set
+    bool set_prefer_busy_poll(int sock);
+
 } // namespace net
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "concurrency.hpp"
+#include <atomic>
+#include <bit> // std::bit_ceil
+#include <concepts>
+#include <cstddef>
+#include <memory> // std::unique_ptr
+#include <utility>
+
+
+namespace util {
+    /*  \class  spsc_ring
+     *  \brief  Bounded, lock-free FIFO for exactly one producer thread and
+     *          one consumer thread. Capacity is rounded up to a power of
+     *          two. The producer and consumer indices live on separate
+     *          cache lines, and each side keeps a cached copy of the
+     *          other's index so the shared line is only read when the
+     *          ring looks full (or empty). Batch operations publish all
+     *          their items with a single store.
+     */
+    template <typename T>
+        requires std::default_initializable<T> && std::movable<T>
+    class spsc_ring
+    {
+    public:
+        explicit spsc_ring(std::size_t capacity)
+                : mask_(std::bit_ceil(capacity < 2 ? 2 : capacity) - 1)
+                , slots_(std::make_unique<T[]>(mask_ + 1))
+        {}
+
+        // No copies/moves
+        spsc_ring(spsc_ring const&) = delete;
+        spsc_ring(spsc_ring&&) = delete;
+        spsc_ring& operator=(spsc_ring const&) = delete;
+        spsc_ring&& operator=(spsc_ring&&) = delete;
+
+        std::size_t
+        capacity() const
+        {
+            return mask_ + 1;
+        }
+
+        /// Exact only when called from the producer or consumer while
+        /// the other side is idle
+        std::size_t
+        size() const
+        {
+            return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+        }
+
+        bool
+        empty() const
+        {
+            return size() == 0;
+        }
+
+        /// Producer only
+        /// \return \c false if full
+        bool
+        try_push(T const& value)
+        {
+            return put(value);
+        }
+
+        /// Producer only. value is left untouched if the ring is full.
+        /// \return \c false if full
+        bool
+        try_push(T&& value)
+        {
+            return put(std::move(value));
+        }
+
+        /// Producer only. Copy as many of [items, items+n) as will fit.
+        /// \return Num of items pushed
+        std::size_t
+        try_push(T const* items, std::size_t n)
+        {
+            std::size_t const tail = tail_.load(std::memory_order_relaxed);
+            std::size_t room = capacity() - (tail - cached_head_);
+            if (room < n) {
+                cached_head_ = head_.load(std::memory_order_acquire);
+                room = capacity() - (tail - cached_head_);
+            }
+            n = n < room ? n : room;
+            for (std::size_t i = 0; i < n; ++i)
+                slots_[(tail + i) & mask_] = items[i];
+            if (n != 0)
+                tail_.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        /// Producer only. Waits for room.
+        template <typename Wait = busy_spin>
+        void
+        push(T value, Wait wait = {})
+        {
+            while (!try_push(std::move(value)))
+                wait();
+        }
+
+        /// Consumer only
+        /// \return \c false if empty
+        bool
+        try_pop(T& value)
+        {
+            std::size_t const head = head_.load(std::memory_order_relaxed);
+            if (head == cached_tail_) {
+                cached_tail_ = tail_.load(std::memory_order_acquire);
+                if (head == cached_tail_)
+                    return false;
+            }
+            value = std::move(slots_[head & mask_]);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Consumer only. Move up to max items into out.
+        /// \return Num of items popped
+        std::size_t
+        try_pop(T* out, std::size_t max)
+        {
+            std::size_t const head = head_.load(std::memory_order_relaxed);
+            std::size_t avail = cached_tail_ - head;
+            if (avail < max) {
+                cached_tail_ = tail_.load(std::memory_order_acquire);
+                avail = cached_tail_ - head;
+            }
+            std::size_t const n = max < avail ? max : avail;
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = std::move(slots_[(head + i) & mask_]);
+            if (n != 0)
+                head_.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+        /// Consumer only. Waits for an item.
+        template <typename Wait = busy_spin>
+        T
+        pop(Wait wait = {})
+        {
+            T value;
+            while (!try_pop(value))
+                wait();
+            return value;
+        }
+
+    private:
+        /// Assign value to the next slot only once it is known to be free
+        template <typename U>
+        bool
+        put(U&& value)
+        {
+            std::size_t const tail = tail_.load(std::memory_order_relaxed);
+            if (tail - cached_head_ > mask_) {
+                cached_head_ = head_.load(std::memory_order_acquire);
+                if (tail - cached_head_ > mask_)
+                    return false;
+            }
+            slots_[tail & mask_] = std::forward<U>(value);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Read-only after construction; shared by both sides
+        std::size_t const mask_;
+        std::unique_ptr<T[]> const slots_;
+
+        // Consumer's line
+        alignas(CacheLineSize) std::atomic<std::size_t> head_{0};
+        std::size_t cached_tail_{0}; ///< last tail_ seen by the consumer
+
+        // Producer's line
+        alignas(CacheLineSize) std::atomic<std::size_t> tail_{0};
+        std::size_t cached_head_{0}; ///< last head_ seen by the producer
+    };
+
+} // namespace util
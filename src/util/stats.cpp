@@ -0,0 +1,71 @@
+#include "stats.hpp"
+#include <print>
+#include <utility>
+
+
+namespace util {
+    stats_reporter::stats_reporter(std::string name, std::chrono::milliseconds interval)
+            : name_(std::move(name))
+            , interval_(interval)
+            , mutex_()
+            , cv_()
+            , counters_()
+            , thread_([this](std::stop_token stop) { run(std::move(stop)); })
+    {}
+
+    stats_reporter::~stats_reporter()
+    {
+        thread_.request_stop();
+        thread_.join();
+    }
+
+    stat_counters&
+    stats_reporter::add_thread()
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        return counters_.emplace_back();
+    }
+
+    stat_snapshot
+    stats_reporter::total() const
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        stat_snapshot sum;
+        for (auto const& c : counters_)
+            sum += c.load();
+        return sum;
+    }
+
+    void
+    stats_reporter::run(std::stop_token stop)
+    {
+        using clock = std::chrono::steady_clock;
+        stat_snapshot last;
+        auto last_time = clock::now();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            // Nothing notifies cv_; this is an interruptible sleep
+            cv_.wait_for(lock, stop, interval_, [] { return false; });
+            if (stop.stop_requested())
+                return;
+
+            stat_snapshot now;
+            for (auto const& c : counters_)
+                now += c.load();
+            auto const now_time = clock::now();
+
+            stat_snapshot const delta = now - last;
+            double const secs = std::chrono::duration<double>(now_time - last_time).count();
+            last = now;
+            last_time = now_time;
+            if (delta.msgs == 0 && delta.errors == 0 && delta.drops == 0)
+                continue;
+
+            std::println("{}: msgs/s={:.0f} MB/s={:.2f} errors={} drops={}", name_,
+                    static_cast<double>(delta.msgs) / secs,
+                    static_cast<double>(delta.bytes) / secs / 1e6, delta.errors, delta.drops);
+        }
+    }
+
+} // namespace util
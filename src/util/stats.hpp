@@ -0,0 +1,137 @@
+#pragma once
+
+#include "concurrency.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread> // std::jthread
+
+
+namespace util {
+    struct stat_snapshot
+    {
+        std::uint64_t msgs = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t errors = 0;
+        std::uint64_t drops = 0;
+
+        stat_snapshot&
+        operator+=(stat_snapshot const& other)
+        {
+            msgs += other.msgs;
+            bytes += other.bytes;
+            errors += other.errors;
+            drops += other.drops;
+            return *this;
+        }
+
+        friend stat_snapshot
+        operator-(stat_snapshot const& lhs, stat_snapshot const& rhs)
+        {
+            return {lhs.msgs - rhs.msgs, lhs.bytes - rhs.bytes, lhs.errors - rhs.errors,
+                    lhs.drops - rhs.drops};
+        }
+    };
+
+    /*  \class  stat_counters
+     *  \brief  Counters written by a single thread and read by the
+     *          reporter. With one writer, an update is a relaxed load
+     *          and store rather than a locked read-modify-write, and the
+     *          counters have a cache line to themselves, so counting
+     *          costs the hot path about as much as a plain increment.
+     */
+    class alignas(CacheLineSize) stat_counters
+    {
+    public:
+        /// Owning thread only
+        void
+        add(std::uint64_t msgs, std::uint64_t bytes)
+        {
+            bump(msgs_, msgs);
+            bump(bytes_, bytes);
+        }
+
+        /// Owning thread only
+        void
+        add_errors(std::uint64_t n = 1)
+        {
+            bump(errors_, n);
+        }
+
+        /// Owning thread only
+        void
+        add_drops(std::uint64_t n)
+        {
+            bump(drops_, n);
+        }
+
+        /// Any thread
+        stat_snapshot
+        load() const
+        {
+            return {msgs_.load(std::memory_order_relaxed), bytes_.load(std::memory_order_relaxed),
+                    errors_.load(std::memory_order_relaxed),
+                    drops_.load(std::memory_order_relaxed)};
+        }
+
+    private:
+        static void
+        bump(std::atomic<std::uint64_t>& counter, std::uint64_t n)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<std::uint64_t> msgs_{0};
+        std::atomic<std::uint64_t> bytes_{0};
+        std::atomic<std::uint64_t> errors_{0};
+        std::atomic<std::uint64_t> drops_{0};
+    };
+
+    /*  \class  stats_reporter
+     *  \brief  Hands out one stat_counters per thread and, from a
+     *          background thread, prints their combined rates every
+     *          interval in which anything was counted. The hot path never
+     *          touches stdout or a lock; the mutex is only taken when a
+     *          thread registers and once per interval.
+     */
+    class stats_reporter
+    {
+    public:
+        /// Starts reporting immediately
+        explicit stats_reporter(
+                std::string name, std::chrono::milliseconds interval = std::chrono::seconds(1));
+
+        /// Stops reporting; counters handed out become invalid
+        ~stats_reporter();
+
+        // No copies/moves
+        stats_reporter(stats_reporter const&) = delete;
+        stats_reporter(stats_reporter&&) = delete;
+        stats_reporter& operator=(stats_reporter const&) = delete;
+        stats_reporter&& operator=(stats_reporter&&) = delete;
+
+        /// Counters for the calling thread to update
+        stat_counters& add_thread();
+
+        /// Sum of all counters
+        stat_snapshot total() const;
+
+    private:
+        void run(std::stop_token stop);
+
+    private:
+        std::string name_;
+        std::chrono::milliseconds interval_;
+        mutable std::mutex mutex_;
+        std::condition_variable_any cv_;     ///< only used to sleep until stopped
+        std::deque<stat_counters> counters_; ///< deque, so references stay valid
+        std::jthread thread_;                ///< last, so it stops first
+    };
+
+} // namespace util
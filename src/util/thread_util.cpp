@@ -0,0 +1,108 @@
+#include "thread_util.hpp"
+#include <pthread.h> // ::pthread_self, ::pthread_setaffinity_np
+#include <sched.h>   // cpu_set_t, CPU_SET, CPU_SETSIZE, CPU_ZERO
+#include <unistd.h>  // ::sysconf
+#include <algorithm> // std::find
+#include <charconv>  // std::from_chars
+#include <cstring>   // std::strerror
+#include <fstream>
+#include <print>
+#include <stdexcept>
+#include <string>
+
+
+namespace util {
+    void
+    pin_thread(int cpu)
+    {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+            throw std::runtime_error("invalid cpu: " + std::to_string(cpu));
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        // pthread functions return the error number rather than setting errno
+        if (int rv = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); rv != 0) {
+            throw std::runtime_error(
+                    "pthread_setaffinity_np(" + std::to_string(cpu) + "): " + std::strerror(rv));
+        }
+    }
+
+    std::vector<int>
+    parse_cpu_list(std::string_view list)
+    {
+        static std::vector<int> const error;
+
+        // Cpus are numbered from 0 up to the num configured, online or
+        // not, and cpu_set_t can't hold more than CPU_SETSIZE of them
+        long const configured = ::sysconf(_SC_NPROCESSORS_CONF);
+        int const num_cpus = configured > 0 && configured < CPU_SETSIZE
+                ? static_cast<int>(configured)
+                : CPU_SETSIZE;
+
+        auto to_int = [num_cpus](std::string_view sv, int& value) {
+            auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), value);
+            return ec == std::errc() && ptr == sv.data() + sv.size() && value >= 0
+                    && value < num_cpus;
+        };
+
+        std::vector<int> cpus;
+        while (!list.empty()) {
+            std::string_view::size_type const comma = list.find(',');
+            std::string_view const item = list.substr(0, comma);
+            list = (comma == std::string_view::npos) ? std::string_view() : list.substr(comma + 1);
+
+            std::string_view::size_type const dash = item.find('-');
+            int first = 0;
+            int last = 0;
+            if (dash == std::string_view::npos) {
+                if (!to_int(item, first))
+                    return error;
+                last = first;
+            } else {
+                if (!to_int(item.substr(0, dash), first) || !to_int(item.substr(dash + 1), last))
+                    return error;
+                if (last < first)
+                    return error;
+            }
+
+            for (int cpu = first; cpu <= last; ++cpu)
+                cpus.emplace_back(cpu);
+        }
+
+        return cpus;
+    }
+
+    std::vector<int>
+    isolated_cpus()
+    {
+        std::ifstream file("/sys/devices/system/cpu/isolated");
+        std::string list;
+        if (!std::getline(file, list))
+            return {};
+        return parse_cpu_list(list);
+    }
+
+    void
+    check_isolation(std::vector<int> const& cpus, std::string_view who)
+    {
+        if (cpus.empty()) {
+            std::println(stderr,
+                    "warning: {}: spinning without --cpus; it may be moved between or share cpus",
+                    who);
+            return;
+        }
+
+        std::vector<int> const isolated = isolated_cpus();
+        for (int const cpu : cpus) {
+            if (std::find(isolated.begin(), isolated.end(), cpu) == isolated.end()) {
+                std::println(stderr,
+                        "warning: {}: cpu {} is not isolated (isolcpus=); other tasks may "
+                        "preempt it",
+                        who, cpu);
+            }
+        }
+    }
+
+} // namespace util
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+
+namespace util {
+    /// Pin the calling thread to a single cpu
+    /// \throws std::exception On error
+    void pin_thread(int cpu);
+
+    /// Parses a cpu list of the form "0,2,4-7"
+    /// \returns Empty vector if invalid format, or if a cpu is beyond
+    ///          the last one the system has
+    std::vector<int> parse_cpu_list(std::string_view);
+
+    /// Cpus removed from the scheduler's load balancing with the
+    /// isolcpus= boot parameter, as listed in
+    /// /sys/devices/system/cpu/isolated
+    /// \returns Empty vector if none or unknown
+    std::vector<int> isolated_cpus();
+
+    /// A spinning thread only gets a core to itself if it is pinned to a
+    /// cpu the scheduler leaves alone. Warns on stderr if cpus, those
+    /// the spinning threads are pinned to, is empty or not isolated.
+    /// \param who Names the threads in the warnings, e.g. "worker 1"
+    void check_isolation(std::vector<int> const& cpus, std::string_view who);
+
+} // namespace util